@@ -0,0 +1,45 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Helpers shared by the benchmarks, each one a single translation unit.
+
+static inline uint64_t bench_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*, so runs are repeatable and cheap next to what they measure
+static inline uint64_t bench_random(uint64_t* state){
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static int bench_compare_u64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts samples in place and returns the given percentile (0-100).
+static inline uint64_t bench_percentile(uint64_t* samples, size_t count, double percentile){
+    if (count == 0){
+        return 0;
+    }
+
+    qsort(samples, count, sizeof(uint64_t), bench_compare_u64);
+    size_t index = (size_t)((percentile / 100.0) * (double)(count - 1));
+    return samples[index];
+}
+
+#endif
@@ -0,0 +1,222 @@
+// Header
+#include "bench_common.h"
+#include "hashing_functionality.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Quality and speed of hash() next to the djb2 it replaced, over key sets
+// shaped like real ones. Quality is measured on the low bits the table
+// actually uses, hash & (buckets - 1), with four keys per bucket: the
+// chi-squared over the bucket counts divided by its degrees of freedom
+// (about 1 for a uniform hash), the longest bucket and the share of empty
+// buckets, which for a uniform hash is close to e^-4 = 1.8%. Speed is the
+// best of BENCH_ROUNDS rounds over the first BENCH_SPEED_KEYS keys, few
+// enough to stay in cache so the hash is timed rather than the memory;
+// djb2 is run with the NUL-terminated walk it needed.
+
+#define BENCH_KEY_ROOM          128
+#define BENCH_KEYS_PER_BUCKET   4
+#define BENCH_ROUNDS            5
+#define BENCH_SPEED_KEYS        2048
+#define BENCH_PASSES            1000    // Passes over those keys per timed round
+
+// Data
+
+typedef struct key_set_t{
+    const char* name;
+    char (*keys)[BENCH_KEY_ROOM];
+    size_t* lengths;
+    size_t count;
+    size_t bytes;
+} key_set_t;
+
+typedef uint64_t (*bench_hash_fn)(const char* key, size_t key_len);
+
+// Private API
+
+// The replaced hash, unchanged: one multiply per byte up to the NUL.
+static unsigned long djb2(const unsigned char* str){
+    unsigned long hash = 5381;
+    unsigned long c;
+
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash;
+}
+
+static uint64_t bench_djb2(const char* key, size_t key_len){
+    (void)key_len;
+    return djb2((const unsigned char*)key);
+}
+
+static uint64_t bench_seeded(const char* key, size_t key_len){
+    return hash(key, key_len);
+}
+
+static int key_set_init(key_set_t* set, const char* name, size_t count){
+    set->name = name;
+    set->keys = malloc(count * sizeof(*set->keys));
+    set->lengths = malloc(count * sizeof(size_t));
+    set->count = count;
+    set->bytes = 0;
+    return ((set->keys == NULL) || (set->lengths == NULL)) ? -1 : 0;
+}
+
+static void key_set_add(key_set_t* set, size_t i, int written){
+    set->lengths[i] = (size_t)written;
+    set->bytes += (size_t)written;
+}
+
+// Counters and ids handed out in order: "key:0", "key:1", ...
+static void key_set_sequential(key_set_t* set){
+    for (size_t i = 0; i < set->count; i++){
+        key_set_add(set, i, snprintf(set->keys[i], BENCH_KEY_ROOM, "key:%zu", i));
+    }
+}
+
+// Hierarchical keys with a skewed owner, as in bench_load_factor
+static void key_set_sessions(key_set_t* set){
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    size_t users = set->count / 8;
+    uint32_t* sessions = calloc(users, sizeof(uint32_t));
+    if (sessions == NULL){
+        set->count = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < set->count; i++){
+        double u = (double)(bench_random(&state) >> 11) / (double)(1ull << 53);
+        size_t user = (size_t)(u * u * u * (double)users);
+        key_set_add(set, i, snprintf(set->keys[i], BENCH_KEY_ROOM, "user:%zu:session:%u", user, sessions[user]++));
+    }
+    free(sessions);
+}
+
+// Random UUIDs in their usual text form
+static void key_set_uuids(key_set_t* set){
+    uint64_t state = 0xD1B54A32D192ED03ull;
+    for (size_t i = 0; i < set->count; i++){
+        uint64_t high = bench_random(&state);
+        uint64_t low = bench_random(&state);
+        key_set_add(set, i, snprintf(set->keys[i], BENCH_KEY_ROOM, "%08llx-%04llx-%04llx-%04llx-%012llx",
+                                     (unsigned long long)(high >> 32), (unsigned long long)((high >> 16) & 0xFFFF),
+                                     (unsigned long long)(high & 0xFFFF), (unsigned long long)(low >> 48),
+                                     (unsigned long long)(low & 0xFFFFFFFFFFFFull)));
+    }
+}
+
+// Long cache keys sharing a long prefix and differing near the end
+static void key_set_urls(key_set_t* set){
+    for (size_t i = 0; i < set->count; i++){
+        key_set_add(set, i, snprintf(set->keys[i], BENCH_KEY_ROOM,
+                                     "cache:https://static.example.com/assets/images/thumbnails/%zu.webp?w=%zu",
+                                     i, (i % 7) * 160));
+    }
+}
+
+static void key_set_free(key_set_t* set){
+    free(set->keys);
+    free(set->lengths);
+}
+
+static void report_quality(const key_set_t* set, const char* name, bench_hash_fn fn, size_t buckets){
+    size_t* counts = calloc(buckets, sizeof(size_t));
+    if (counts == NULL){
+        return;
+    }
+
+    size_t keys = buckets * BENCH_KEYS_PER_BUCKET;
+    keys = (keys < set->count) ? keys : set->count;
+    for (size_t i = 0; i < keys; i++){
+        counts[fn(set->keys[i], set->lengths[i]) & (buckets - 1)]++;
+    }
+
+    double expected = (double)keys / (double)buckets;
+    double chi_squared = 0.0;
+    size_t longest = 0;
+    size_t empty = 0;
+    for (size_t b = 0; b < buckets; b++){
+        double delta = (double)counts[b] - expected;
+        chi_squared += (delta * delta) / expected;
+        longest = (counts[b] > longest) ? counts[b] : longest;
+        empty += (counts[b] == 0);
+    }
+
+    printf("    %-7s %6zu buckets  chi2/df %8.2f  longest %5zu  empty %5.1f%%\n", name, buckets,
+           chi_squared / (double)(buckets - 1), longest, 100.0 * (double)empty / (double)buckets);
+    free(counts);
+}
+
+static void report_speed(const key_set_t* set, const char* name, bench_hash_fn fn){
+    uint64_t best = UINT64_MAX;
+    uint64_t sink = 0;
+    size_t keys = (set->count < BENCH_SPEED_KEYS) ? set->count : BENCH_SPEED_KEYS;
+    size_t bytes = 0;
+    for (size_t i = 0; i < keys; i++){
+        bytes += set->lengths[i];
+    }
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        uint64_t start = bench_now_ns();
+        for (int pass = 0; pass < BENCH_PASSES; pass++){
+            for (size_t i = 0; i < keys; i++){
+                sink += fn(set->keys[i], set->lengths[i]);
+            }
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    double hashes = (double)keys * BENCH_PASSES;
+    printf("    %-7s %7.2f ns/key  %7.2f GB/s  (%016llx)\n", name, (double)best / hashes,
+           (double)bytes * BENCH_PASSES / (double)best, (unsigned long long)sink);
+}
+
+static void bench_key_set(const key_set_t* set){
+    if (set->count == 0){
+        fprintf(stderr, "[ERROR] bench_key_set: No keys for %s.\n", set->name);
+        return;
+    }
+
+    printf("  %s: %zu keys, %.1f bytes on average\n", set->name, set->count,
+           (double)set->bytes / (double)set->count);
+
+    size_t sizes[] = { 1u << 10, 1u << 16 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        report_quality(set, "djb2", bench_djb2, sizes[i]);
+        report_quality(set, "hash()", bench_seeded, sizes[i]);
+    }
+
+    report_speed(set, "djb2", bench_djb2);
+    report_speed(set, "hash()", bench_seeded);
+}
+
+// Public API
+
+int main(void){
+    hash_init();
+
+    size_t count = (size_t)BENCH_KEYS_PER_BUCKET << 16;
+    key_set_t sets[4];
+    void (*fill[4])(key_set_t*) = { key_set_sequential, key_set_sessions, key_set_uuids, key_set_urls };
+    const char* names[4] = { "sequential", "sessions", "uuids", "urls" };
+
+    printf("bench_hash: %d keys per bucket; speed over %d keys, best of %d rounds of %d passes\n",
+           BENCH_KEYS_PER_BUCKET, BENCH_SPEED_KEYS, BENCH_ROUNDS, BENCH_PASSES);
+
+    for (size_t i = 0; i < 4; i++){
+        if (key_set_init(&sets[i], names[i], count) != 0){
+            fprintf(stderr, "[ERROR] main: Failed to allocate the keys.\n");
+            return 1;
+        }
+        fill[i](&sets[i]);
+        bench_key_set(&sets[i]);
+        key_set_free(&sets[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Header
+#include "bench_common.h"
+#include "hashtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fills a table that never resizes with hierarchical keys drawn from a
+// skewed id space (a few users own most sessions) until a SET fails or
+// LOAD_FACTOR_CAP is reached, then reports the load factor reached and the
+// SET latency percentiles per load band. Each SET is timed on its own, so
+// the figures include about one clock read of overhead.
+
+#define BENCH_BUCKETS       65536
+#define BENCH_USERS         100000
+#define LOAD_FACTOR_CAP     2.0
+#define LOAD_BANDS          8           // Bands of LOAD_FACTOR_CAP / LOAD_BANDS each
+
+// Private API
+
+// Power law over the users: cubing a uniform draw piles it up near 0.
+static uint32_t skewed_user(uint64_t* state){
+    double u = (double)(bench_random(state) >> 11) / (double)(1ull << 53);
+    return (uint32_t)(u * u * u * BENCH_USERS);
+}
+
+static void report_band(size_t band, uint64_t* samples, size_t count){
+    double band_width = LOAD_FACTOR_CAP / LOAD_BANDS;
+    if (count == 0){
+        return;
+    }
+
+    uint64_t p50 = bench_percentile(samples, count, 50.0);
+    uint64_t p99 = bench_percentile(samples, count, 99.0);
+    uint64_t p999 = bench_percentile(samples, count, 99.9);
+    printf("  load %.2f-%.2f  %8zu SETs  p50 %5llu ns  p99 %6llu ns  p99.9 %6llu ns\n",
+           (double)band * band_width, (double)(band + 1) * band_width, count,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999);
+}
+
+// Public API
+
+int main(void){
+    hashtable_t* table = table_create(BENCH_BUCKETS, LOCK_STRIPES_DEFAULT);
+    if (table == NULL){
+        fprintf(stderr, "[ERROR] main: Failed to create the table.\n");
+        return 1;
+    }
+
+    size_t slots = table_capacity(table);
+    size_t max_inserts = (size_t)(LOAD_FACTOR_CAP * (double)slots);
+    size_t band_size = max_inserts / LOAD_BANDS;
+
+    uint64_t* samples = malloc(max_inserts * sizeof(uint64_t));
+    uint32_t* sessions = calloc(BENCH_USERS, sizeof(uint32_t));
+    if ((samples == NULL) || (sessions == NULL)){
+        fprintf(stderr, "[ERROR] main: Failed to allocate the samples.\n");
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    void* value = table_value_inline("1", 1);
+    size_t inserted = 0;
+    int failure = 0;
+
+    while (inserted < max_inserts){
+        uint32_t user = skewed_user(&state);
+        char key[64];
+        int key_len = snprintf(key, sizeof(key), "user:%u:session:%u", user, sessions[user]++);
+
+        uint64_t start = bench_now_ns();
+        int status = table_set(table, (const unsigned char*)key, (size_t)key_len, value, NULL);
+        samples[inserted] = bench_now_ns() - start;
+
+        if (status != 0){
+            failure = status;
+            break;
+        }
+        inserted++;
+    }
+
+    printf("bench_load_factor: %zu buckets, %zu slots\n", (size_t)BENCH_BUCKETS, slots);
+    if (failure != 0){
+        printf("  first failure (%d) after %zu SETs, load factor %.3f\n", failure, inserted, table_load_factor(table));
+    } else{
+        printf("  no failure up to the cap, load factor %.3f\n", table_load_factor(table));
+    }
+
+    for (size_t band = 0; band * band_size < inserted; band++){
+        size_t first = band * band_size;
+        size_t count = ((inserted - first) < band_size) ? (inserted - first) : band_size;
+        report_band(band, samples + first, count);
+    }
+
+    uint64_t overall = bench_percentile(samples, inserted, 99.0);
+    printf("  all SETs p99 %llu ns\n", (unsigned long long)overall);
+
+    free(sessions);
+    free(samples);
+    table_destroy(table, NULL);
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Header
+#include "bench_common.h"
+#include "hashtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// What the ordered index costs and what it buys. The same hierarchical keys
+// (user:N:session:M, a few users owning most sessions) are inserted into and
+// deleted from a table without and with the index, then RANGE and PREFIX
+// queries are run against the indexed one: RANGE from a random key with a
+// few limits, PREFIX over the sessions of a random user. Every figure is the
+// best of BENCH_ROUNDS rounds.
+
+#define BENCH_BUCKETS       65536
+#define BENCH_KEYS          200000
+#define BENCH_USERS         20000
+#define BENCH_KEY_ROOM      40
+#define BENCH_ROUNDS        3
+#define BENCH_QUERIES       20000
+#define BENCH_PREFIX_LIMIT  1000        // The server's cap on one reply
+
+// Data
+
+typedef struct key_set_t{
+    char (*keys)[BENCH_KEY_ROOM];
+    size_t* lengths;
+    uint32_t* owners;              // User of each key, for the PREFIX queries
+} key_set_t;
+
+// Private API
+
+static void key_set_free(key_set_t* set){
+    free(set->keys);
+    free(set->lengths);
+    free(set->owners);
+}
+
+static int key_set_init(key_set_t* set){
+    set->keys = malloc(BENCH_KEYS * sizeof(*set->keys));
+    set->lengths = malloc(BENCH_KEYS * sizeof(size_t));
+    set->owners = malloc(BENCH_KEYS * sizeof(uint32_t));
+    uint32_t* sessions = calloc(BENCH_USERS, sizeof(uint32_t));
+    if ((set->keys == NULL) || (set->lengths == NULL) || (set->owners == NULL) || (sessions == NULL)){
+        free(sessions);
+        key_set_free(set);
+        return -1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < BENCH_KEYS; i++){
+        double u = (double)(bench_random(&state) >> 11) / (double)(1ull << 53);
+        uint32_t user = (uint32_t)(u * u * u * BENCH_USERS);
+        int written = snprintf(set->keys[i], BENCH_KEY_ROOM, "user:%u:session:%u", user, sessions[user]++);
+        set->lengths[i] = (size_t)written;
+        set->owners[i] = user;
+    }
+
+    free(sessions);
+    return 0;
+}
+
+static hashtable_t* bench_table(bool indexed){
+    hashtable_t* table = table_create(BENCH_BUCKETS, LOCK_STRIPES_DEFAULT);
+    if ((table != NULL) && indexed && (table_enable_ordered_index(table) != 0)){
+        table_destroy(table, NULL);
+        return NULL;
+    }
+    return table;
+}
+
+// Fills a fresh table and empties it again, timing both halves.
+static int bench_writes(const key_set_t* set, bool indexed){
+    uint64_t best_set = UINT64_MAX;
+    uint64_t best_del = UINT64_MAX;
+    void* value = table_value_inline("1", 1);
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        hashtable_t* table = bench_table(indexed);
+        if (table == NULL){
+            return -1;
+        }
+
+        uint64_t start = bench_now_ns();
+        for (size_t i = 0; i < BENCH_KEYS; i++){
+            table_set(table, (const unsigned char*)set->keys[i], set->lengths[i], value, NULL);
+        }
+        uint64_t middle = bench_now_ns();
+        for (size_t i = 0; i < BENCH_KEYS; i++){
+            table_delete(table, (const unsigned char*)set->keys[i], set->lengths[i], NULL);
+        }
+        uint64_t end = bench_now_ns();
+
+        best_set = ((middle - start) < best_set) ? (middle - start) : best_set;
+        best_del = ((end - middle) < best_del) ? (end - middle) : best_del;
+        table_destroy(table, NULL);
+    }
+
+    printf("  %-16s SET %6.1f ns/op  DEL %6.1f ns/op\n", indexed ? "with index" : "without index",
+           (double)best_set / BENCH_KEYS, (double)best_del / BENCH_KEYS);
+    return 0;
+}
+
+static void count_key(const unsigned char* key, size_t key_len, void* scan_context){
+    (void)key;
+    (void)key_len;
+    (*(size_t*)scan_context)++;
+}
+
+static void bench_ranges(hashtable_t* table, const key_set_t* set, size_t limit){
+    uint64_t best = UINT64_MAX;
+    size_t returned = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        uint64_t state = 0xD1B54A32D192ED03ull;
+        returned = 0;
+
+        uint64_t start = bench_now_ns();
+        for (size_t q = 0; q < BENCH_QUERIES; q++){
+            size_t k = (size_t)(bench_random(&state) % BENCH_KEYS);
+            table_range(table, (const unsigned char*)set->keys[k], set->lengths[k], NULL, 0, limit, count_key,
+                        &returned);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    printf("  RANGE LIMIT %-5zu %8.0f queries/s  %6.2f M keys/s\n", limit, BENCH_QUERIES * 1e9 / (double)best,
+           (double)returned * 1e3 / (double)best);
+}
+
+static void bench_prefixes(hashtable_t* table, const key_set_t* set){
+    uint64_t best = UINT64_MAX;
+    size_t returned = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        uint64_t state = 0xA0761D6478BD642Full;
+        returned = 0;
+
+        uint64_t start = bench_now_ns();
+        for (size_t q = 0; q < BENCH_QUERIES; q++){
+            // Users picked through their keys, so busy users come up as often as they write
+            uint32_t user = set->owners[bench_random(&state) % BENCH_KEYS];
+            char prefix[BENCH_KEY_ROOM];
+            int prefix_len = snprintf(prefix, sizeof(prefix), "user:%u:", user);
+            table_prefix(table, (const unsigned char*)prefix, (size_t)prefix_len, BENCH_PREFIX_LIMIT, count_key,
+                         &returned);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    printf("  PREFIX user:N:    %8.0f queries/s  %6.2f M keys/s  (%.1f keys per query)\n",
+           BENCH_QUERIES * 1e9 / (double)best, (double)returned * 1e3 / (double)best,
+           (double)returned / BENCH_QUERIES);
+}
+
+// Public API
+
+int main(void){
+    key_set_t set;
+    if (key_set_init(&set) != 0){
+        fprintf(stderr, "[ERROR] main: Failed to allocate the keys.\n");
+        return 1;
+    }
+
+    printf("bench_ordered_index: %d keys over %d users, best of %d rounds\n", BENCH_KEYS, BENCH_USERS, BENCH_ROUNDS);
+
+    if ((bench_writes(&set, false) != 0) || (bench_writes(&set, true) != 0)){
+        fprintf(stderr, "[ERROR] main: Failed to create the tables.\n");
+        return 1;
+    }
+
+    hashtable_t* table = bench_table(true);
+    if (table == NULL){
+        fprintf(stderr, "[ERROR] main: Failed to create the tables.\n");
+        return 1;
+    }
+
+    void* value = table_value_inline("1", 1);
+    for (size_t i = 0; i < BENCH_KEYS; i++){
+        table_set(table, (const unsigned char*)set.keys[i], set.lengths[i], value, NULL);
+    }
+
+    size_t limits[] = { 10, 100, 1000 };
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++){
+        bench_ranges(table, &set, limits[i]);
+    }
+    bench_prefixes(table, &set);
+
+    table_destroy(table, NULL);
+    key_set_free(&set);
+    return 0;
+}
@@ -0,0 +1,408 @@
+// Header
+
+// The parser and the reply path are private to the server, so the server is
+// built into the benchmark with its main renamed. It comes first, as in its
+// own build, for the socket options it needs.
+#define main server_main
+#include "server.c"
+#undef main
+
+#include "bench_common.h"
+
+// Read path throughput of parse_buffer next to the memmove parser it
+// replaced. A client pipelining K commands sends them as one read: the batch
+// is copied to the loop's read buffer, as the socket would, and handed to
+// the parser, which runs every command against a real table and gathers the
+// replies; those are then dropped instead of written. The old parser is
+// kept below unchanged but for its missing reset, reading through its own
+// buffer as it did and calling the same executor and reply path, so the
+// difference between the two is the parsing. GET hits BENCH_KEYS keys of
+// BENCH_VALUE_SIZE bytes, SET rewrites them. Every figure is the best of
+// BENCH_ROUNDS rounds of about BENCH_COMMANDS commands. GET logs every key
+// on stderr as it does in the server, so run it with 2>/dev/null; stderr is
+// buffered here, which leaves the formatting of the log in the figures but
+// not a write per command.
+
+#define BENCH_KEYS          4096
+#define BENCH_VALUE_SIZE    16
+#define BENCH_COMMANDS      262144
+#define BENCH_ROUNDS        3
+#define BENCH_COMMAND_ROOM  96
+
+// Data
+
+typedef enum bench_command_t{
+    BENCH_GET,
+    BENCH_SET,
+} bench_command_t;
+
+// State of the old parser, the fields it had in client_context_t
+typedef struct legacy_parser_t{
+    client_context_t* ctx;
+    char* buffer;
+    size_t buffer_used;
+    size_t buffer_capacity;
+    parser_state_t state;
+    size_t args_total;
+    size_t args_parsed;
+    size_t data_to_read;
+    char** temp_argv;
+    size_t* temp_arg_lengths;
+} legacy_parser_t;
+
+typedef void (*bench_parse_fn)(client_context_t* ctx, legacy_parser_t* legacy, loop_context_t* loop_ctx,
+                               size_t received);
+
+// Private API
+
+static void legacy_free_args(legacy_parser_t* parser){
+    if (parser->temp_argv) {
+        for (size_t i = 0; i < parser->args_parsed; i++) {
+            free(parser->temp_argv[i]);
+        }
+        free(parser->temp_argv);
+        parser->temp_argv = NULL;
+    }
+    if (parser->temp_arg_lengths) {
+        free(parser->temp_arg_lengths);
+        parser->temp_arg_lengths = NULL;
+    }
+}
+
+static void legacy_reset(legacy_parser_t* parser){
+    parser->state = PARSE_STATE_EXPECT_TYPE;
+    parser->args_total = 0;
+    parser->args_parsed = 0;
+    parser->data_to_read = 0;
+}
+
+static int legacy_append(legacy_parser_t* parser, const char* data, size_t len){
+    if (parser->buffer_used + len > parser->buffer_capacity) {
+        size_t new_capacity = (parser->buffer_capacity == 0) ? 1024 : parser->buffer_capacity * 2;
+        if (new_capacity < parser->buffer_used + len) {
+            new_capacity = parser->buffer_used + len;
+        }
+        char* new_buffer = realloc(parser->buffer, new_capacity);
+        if (new_buffer == NULL) {
+            return -1;
+        }
+        parser->buffer = new_buffer;
+        parser->buffer_capacity = new_capacity;
+    }
+    memcpy(parser->buffer + parser->buffer_used, data, len);
+    parser->buffer_used += len;
+    return 0;
+}
+
+// The parser before commands were parsed in place: every header, length
+// line and argument is memmoved off the front of the buffer and every
+// argument is copied to its own allocation. Errors stop it instead of
+// closing the client.
+static int legacy_parse_buffer(legacy_parser_t* parser){
+    bool err;
+
+    while (true) {
+        if (parser->state == PARSE_STATE_EXPECT_TYPE){
+            size_t leading_whitespace = 0;
+            while (leading_whitespace < parser->buffer_used &&
+                   (parser->buffer[leading_whitespace] == '\r' || parser->buffer[leading_whitespace] == '\n')){
+                leading_whitespace++;
+            }
+
+            if (leading_whitespace > 0){
+                memmove(parser->buffer, parser->buffer + leading_whitespace, parser->buffer_used - leading_whitespace);
+                parser->buffer_used -= leading_whitespace;
+            }
+
+            if (parser->buffer_used < 1){
+                break;
+            }
+
+            if (parser->buffer[0] != '*'){
+                return -1;
+            }
+
+            char* crlf = memchr(parser->buffer, '\r', parser->buffer_used);
+            if (!crlf || (crlf + 1 >= parser->buffer + parser->buffer_used) || *(crlf + 1) != '\n') {
+                break;
+            }
+
+            long n_args = strtol(parser->buffer + 1, NULL, 10);
+            if (n_args <= 0 || n_args > 1024) {
+                return -1;
+            }
+
+            parser->args_total = long_to_sizet(n_args, &err);
+            if (err) {
+                return -1;
+            }
+
+            parser->args_parsed = 0;
+            parser->state = PARSE_STATE_EXPECT_LENGTH;
+
+            size_t consumed = (size_t)((crlf + 2) - parser->buffer);
+            memmove(parser->buffer, parser->buffer + consumed, parser->buffer_used - consumed);
+            parser->buffer_used -= consumed;
+
+        } else if (parser->state == PARSE_STATE_EXPECT_LENGTH){
+            if (parser->buffer_used > 0 && parser->buffer[0] != '$') {
+                return -1;
+            }
+            if (parser->buffer_used < 1){
+                break;
+            }
+
+            char* crlf = memchr(parser->buffer, '\r', parser->buffer_used);
+            if ((crlf == NULL) || (crlf + 1 >= parser->buffer + parser->buffer_used) || *(crlf + 1) != '\n') {
+                break;
+            }
+
+            long len = strtol(parser->buffer + 1, NULL, 10);
+            if (len < 0 || len > 8192) {
+                return -1;
+            }
+
+            parser->data_to_read = long_to_sizet(len, &err);
+            if (err) {
+                return -1;
+            }
+
+            parser->state = PARSE_STATE_EXPECT_DATA;
+
+            size_t consumed = (size_t)((crlf + 2) - parser->buffer);
+            memmove(parser->buffer, parser->buffer + consumed, parser->buffer_used - consumed);
+            parser->buffer_used -= consumed;
+
+        } else if (parser->state == PARSE_STATE_EXPECT_DATA) {
+            if (parser->buffer_used < parser->data_to_read + 2) {
+                break;
+            }
+
+            if (parser->args_parsed == 0) {
+                parser->temp_argv = malloc(parser->args_total * sizeof(char*));
+                parser->temp_arg_lengths = malloc(parser->args_total * sizeof(size_t));
+                if (!parser->temp_argv || !parser->temp_arg_lengths) {
+                    legacy_free_args(parser);
+                    return -1;
+                }
+            }
+
+            parser->temp_argv[parser->args_parsed] = malloc(parser->data_to_read + 1);
+            if (parser->temp_argv[parser->args_parsed] == NULL) {
+                legacy_free_args(parser);
+                return -1;
+            }
+            memcpy(parser->temp_argv[parser->args_parsed], parser->buffer, parser->data_to_read);
+            parser->temp_argv[parser->args_parsed][parser->data_to_read] = '\0';
+            parser->temp_arg_lengths[parser->args_parsed] = parser->data_to_read;
+
+            parser->args_parsed++;
+
+            size_t consumed = parser->data_to_read + 2;
+            memmove(parser->buffer, parser->buffer + consumed, parser->buffer_used - consumed);
+            parser->buffer_used -= consumed;
+
+            if (parser->args_parsed == parser->args_total) {
+                char* command_name = parser->temp_argv[0];
+                int argc = sizet_to_int(parser->args_total - 1, &err);
+                if (err) {
+                    legacy_free_args(parser);
+                    return -1;
+                }
+
+                char** command_argv = (argc > 0) ? &parser->temp_argv[1] : NULL;
+                const size_t* args_lengths = (argc > 0) ? &parser->temp_arg_lengths[1] : NULL;
+
+                execute_result_t result = execute_command(parser->ctx->server_ctx, command_name, argc, command_argv,
+                                                          args_lengths, NULL);
+                int status = send_reply(parser->ctx, &result);
+
+                // The reset it was missing, so that it parses more than one command
+                legacy_free_args(parser);
+                legacy_reset(parser);
+
+                if (status != 0) {
+                    return -1;
+                }
+            } else {
+                parser->state = PARSE_STATE_EXPECT_LENGTH;
+            }
+        } else {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void parse_current(client_context_t* ctx, legacy_parser_t* legacy, loop_context_t* loop_ctx, size_t received){
+    (void)legacy;
+    client_parse_shared(ctx, loop_ctx, received);
+}
+
+static void parse_legacy(client_context_t* ctx, legacy_parser_t* legacy, loop_context_t* loop_ctx, size_t received){
+    if ((legacy_append(legacy, loop_ctx->read_buffer, received) != 0) || (legacy_parse_buffer(legacy) != 0)) {
+        fprintf(stderr, "[ERROR] parse_legacy: The old parser failed.\n");
+        uv_close((uv_handle_t*)&ctx->client_handle, NULL);
+    }
+}
+
+// Writes K commands back to back, each on a random key.
+static size_t batch_build(char* batch, bench_command_t kind, size_t k, uint64_t* state){
+    size_t length = 0;
+
+    for (size_t i = 0; i < k; i++){
+        char key[16];
+        int key_len = snprintf(key, sizeof(key), "key:%06u", (unsigned)(bench_random(state) % BENCH_KEYS));
+
+        int written;
+        if (kind == BENCH_GET){
+            written = snprintf(batch + length, BENCH_COMMAND_ROOM, "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", key_len, key);
+        } else{
+            written = snprintf(batch + length, BENCH_COMMAND_ROOM, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n%0*d\r\n",
+                               key_len, key, BENCH_VALUE_SIZE, BENCH_VALUE_SIZE, (int)i);
+        }
+        length += (size_t)written;
+    }
+
+    return length;
+}
+
+// Returns the best time of a round in ns, 0 when the parser gave up.
+static uint64_t bench_run(client_context_t* ctx, loop_context_t* loop_ctx, bench_parse_fn parse,
+                          const char* stream, const size_t* offsets, size_t batch_count){
+    legacy_parser_t legacy = {.ctx = ctx};
+    uint64_t best = UINT64_MAX;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        uint64_t start = bench_now_ns();
+        for (size_t b = 0; b < batch_count; b++){
+            size_t length = offsets[b + 1] - offsets[b];
+            memcpy(loop_ctx->read_buffer, stream + offsets[b], length);
+            parse(ctx, &legacy, loop_ctx, length);
+
+            // Stands for the write the loop would make
+            client_output_drop(ctx);
+            if (uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+                free(legacy.buffer);
+                return 0;
+            }
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    free(legacy.buffer);
+    return best;
+}
+
+static int bench_case(client_context_t* ctx, loop_context_t* loop_ctx, bench_command_t kind, size_t k){
+    // The batches back to back, each starting at its offset
+    size_t batch_count = BENCH_COMMANDS / k;
+    char* stream = malloc(BENCH_COMMANDS * BENCH_COMMAND_ROOM);
+    size_t* offsets = malloc((batch_count + 1) * sizeof(size_t));
+    if ((stream == NULL) || (offsets == NULL) || (k * BENCH_COMMAND_ROOM > READ_BUFFER_SIZE)){
+        free(stream);
+        free(offsets);
+        return -1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    offsets[0] = 0;
+    for (size_t b = 0; b < batch_count; b++){
+        offsets[b + 1] = offsets[b] + batch_build(stream + offsets[b], kind, k, &state);
+    }
+    size_t bytes = offsets[batch_count];
+
+    uint64_t legacy = bench_run(ctx, loop_ctx, parse_legacy, stream, offsets, batch_count);
+    uint64_t current = (legacy != 0) ? bench_run(ctx, loop_ctx, parse_current, stream, offsets, batch_count) : 0;
+    free(stream);
+    free(offsets);
+    if (current == 0){
+        return -1;
+    }
+
+    double commands = (double)(batch_count * k);
+    printf("  %s K=%-4zu  memmove %7.1f ns/cmd %7.1f MB/s   in place %7.1f ns/cmd %7.1f MB/s   x%.2f\n",
+           (kind == BENCH_GET) ? "GET" : "SET", k, (double)legacy / commands, (double)bytes * 1e3 / (double)legacy,
+           (double)current / commands, (double)bytes * 1e3 / (double)current, (double)legacy / (double)current);
+    return 0;
+}
+
+// Public API
+
+int main(void){
+    setvbuf(stderr, NULL, _IOFBF, 1 << 16);
+
+    char* options_argv[] = { "bench_parser", "65536", NULL };
+    server_options_t options;
+    if (parse_server_options(2, options_argv, &options) != 0){
+        return 1;
+    }
+
+    server_context_t server_ctx = {.reg = registry_create(), .db = NULL, .shards = NULL};
+    server_ctx.db = database_create(&options, 0, 0);
+    if ((server_ctx.reg == NULL) || (server_ctx.db == NULL)){
+        fprintf(stderr, "[ERROR] main: Failed to create the database.\n");
+        return 1;
+    }
+
+    uv_loop_t loop;
+    loop_context_t* loop_ctx = malloc(sizeof(loop_context_t));
+    client_context_t* ctx = calloc(1, sizeof(client_context_t));
+    if ((loop_ctx == NULL) || (ctx == NULL) || (uv_loop_init(&loop) != 0) || (loop_context_start(&loop, loop_ctx) != 0)){
+        fprintf(stderr, "[ERROR] main: Failed to set up the client.\n");
+        return 1;
+    }
+
+    // Never connected: the replies are dropped before anything is written
+    uv_tcp_init(&loop, &ctx->client_handle);
+    ctx->client_handle.data = ctx;
+    ctx->server_ctx = &server_ctx;
+    ctx->protocol = RESP_DEFAULT_VERSION;
+    reset_parser(ctx);
+
+    // Every key exists, so each GET replies with its value
+    size_t fill_count = BENCH_KEYS / 256;
+    for (size_t b = 0; b < fill_count; b++){
+        size_t length = 0;
+        for (size_t i = b * 256; i < (b + 1) * 256; i++){
+            char key[16];
+            int key_len = snprintf(key, sizeof(key), "key:%06zu", i);
+            length += (size_t)snprintf(loop_ctx->read_buffer + length, BENCH_COMMAND_ROOM,
+                                       "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n%0*zu\r\n", key_len, key,
+                                       BENCH_VALUE_SIZE, BENCH_VALUE_SIZE, i);
+        }
+        client_parse_shared(ctx, loop_ctx, length);
+        client_output_drop(ctx);
+    }
+
+    printf("bench_parser: %d keys, %d byte values, %d commands per round, best of %d rounds\n", BENCH_KEYS,
+           BENCH_VALUE_SIZE, BENCH_COMMANDS, BENCH_ROUNDS);
+
+    // A batch stays under REPLY_BATCH_MAX replies, which would be written
+    size_t ks[] = { 1, 16, 128, 256 };
+    bench_command_t kinds[] = { BENCH_GET, BENCH_SET };
+    for (size_t c = 0; c < 2; c++){
+        for (size_t i = 0; i < sizeof(ks) / sizeof(ks[0]); i++){
+            if (bench_case(ctx, loop_ctx, kinds[c], ks[i]) != 0){
+                fprintf(stderr, "[ERROR] main: The K=%zu case failed.\n", ks[i]);
+                return 1;
+            }
+        }
+    }
+
+    free_parser_resources(ctx);
+    uv_close((uv_handle_t*)&ctx->client_handle, NULL);
+    uv_close((uv_handle_t*)&loop_ctx->flush, NULL);
+    uv_close((uv_handle_t*)&loop_ctx->idle_sweep, NULL);
+    uv_run(&loop, UV_RUN_DEFAULT);
+    uv_loop_close(&loop);
+
+    free(ctx);
+    free(loop_ctx);
+    table_destroy(server_ctx.db, destroy_value_wrapper);
+    registry_destroy(&server_ctx.reg);
+    epoch_drain();
+    return 0;
+}
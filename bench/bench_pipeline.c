@@ -0,0 +1,265 @@
+// Header
+
+// The server runs in a thread of the benchmark with its main renamed, and
+// every uv_write it makes goes through __wrap_uv_write, which counts it (the
+// target links with --wrap=uv_write).
+#define main server_main
+#include "server.c"
+#undef main
+
+#include "bench_common.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Pipelining through the whole server: BENCH_CONNECTIONS clients each send
+// rounds of N GETs as a single packet and read all N replies before the next
+// round. Reported are the replies per second and the uv_write calls the
+// server made per round of one client, which batching should keep at one
+// whatever N is, as long as N stays within REPLY_BATCH_MAX. The arguments
+// are handed to the server after its DB_SIZE, e.g. --shards 2. GET logs
+// every key on stderr, so run it with 2>/dev/null.
+
+#define BENCH_CONNECTIONS   4
+#define BENCH_KEYS          4096
+#define BENCH_VALUE_SIZE    16
+#define BENCH_REPLIES       200000      // Per pipeline depth, over all clients
+#define BENCH_COMMAND_ROOM  64
+#define BENCH_CONNECT_TRIES 500         // 10 ms apart, while the server starts
+#define BENCH_OPTIONS_MAX   16
+
+// Data
+
+typedef struct bench_client_t{
+    pthread_t thread;
+    int fd;
+    size_t depth;
+    size_t rounds;
+    uint64_t seed;
+    bool failed;
+} bench_client_t;
+
+typedef struct server_args_t{
+    int argc;
+    char** argv;
+} server_args_t;
+
+static atomic_size_t write_calls;
+
+// Private API
+
+int __real_uv_write(uv_write_t* req, uv_stream_t* handle, const uv_buf_t bufs[], unsigned int nbufs,
+                    uv_write_cb cb);
+
+int __wrap_uv_write(uv_write_t* req, uv_stream_t* handle, const uv_buf_t bufs[], unsigned int nbufs,
+                    uv_write_cb cb){
+    atomic_fetch_add_explicit(&write_calls, 1, memory_order_relaxed);
+    return __real_uv_write(req, handle, bufs, nbufs, cb);
+}
+
+static void* server_run(void* arg){
+    server_args_t* args = arg;
+    server_main(args->argc, args->argv);
+    return NULL;
+}
+
+static int client_connect(void){
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(SERVER_PORT)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    for (int attempt = 0; attempt < BENCH_CONNECT_TRIES; attempt++){
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0){
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0){
+            return fd;
+        }
+        close(fd);
+
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = 10000000};
+        nanosleep(&pause, NULL);
+    }
+
+    return -1;
+}
+
+static int send_all(int fd, const char* data, size_t length){
+    while (length > 0){
+        ssize_t sent = send(fd, data, length, 0);
+        if (sent <= 0){
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Reads exactly length bytes of replies, each starting with lead.
+static int recv_replies(int fd, char* buffer, size_t length, char lead){
+    size_t received = 0;
+    while (received < length){
+        ssize_t got = recv(fd, buffer + received, length - received, 0);
+        if (got <= 0){
+            return -1;
+        }
+        received += (size_t)got;
+    }
+    return (buffer[0] == lead) ? 0 : -1;
+}
+
+// Every key gets its value through one connection, 256 SETs at a time.
+static int keys_fill(int fd){
+    char* batch = malloc(256 * BENCH_COMMAND_ROOM);
+    if (batch == NULL){
+        return -1;
+    }
+
+    for (size_t b = 0; b < BENCH_KEYS / 256; b++){
+        size_t length = 0;
+        for (size_t i = b * 256; i < (b + 1) * 256; i++){
+            length += (size_t)snprintf(batch + length, BENCH_COMMAND_ROOM,
+                                       "*3\r\n$3\r\nSET\r\n$10\r\nkey:%06zu\r\n$%d\r\n%0*zu\r\n", i,
+                                       BENCH_VALUE_SIZE, BENCH_VALUE_SIZE, i);
+        }
+
+        // "+OK\r\n" each
+        if ((send_all(fd, batch, length) != 0) || (recv_replies(fd, batch, 256 * 5, '+') != 0)){
+            free(batch);
+            return -1;
+        }
+    }
+
+    free(batch);
+    return 0;
+}
+
+static void* client_run(void* arg){
+    bench_client_t* client = arg;
+    size_t reply_length = 5 + BENCH_VALUE_SIZE + 2;     // "$16\r\n", the value, CRLF
+    char* batch = malloc(client->depth * BENCH_COMMAND_ROOM);
+    char* replies = malloc(client->depth * reply_length);
+    if ((batch == NULL) || (replies == NULL)){
+        client->failed = true;
+        free(batch);
+        free(replies);
+        return NULL;
+    }
+
+    for (size_t round = 0; round < client->rounds; round++){
+        size_t length = 0;
+        for (size_t i = 0; i < client->depth; i++){
+            length += (size_t)snprintf(batch + length, BENCH_COMMAND_ROOM, "*2\r\n$3\r\nGET\r\n$10\r\nkey:%06u\r\n",
+                                       (unsigned)(bench_random(&client->seed) % BENCH_KEYS));
+        }
+
+        if ((send_all(client->fd, batch, length) != 0) ||
+            (recv_replies(client->fd, replies, client->depth * reply_length, '$') != 0)){
+            client->failed = true;
+            break;
+        }
+    }
+
+    free(batch);
+    free(replies);
+    return NULL;
+}
+
+static int bench_depth(bench_client_t* clients, size_t depth){
+    size_t rounds = BENCH_REPLIES / (depth * BENCH_CONNECTIONS);
+    rounds = (rounds > 0) ? rounds : 1;
+
+    size_t writes_before = atomic_load(&write_calls);
+    uint64_t start = bench_now_ns();
+
+    size_t started = 0;
+    for (; started < BENCH_CONNECTIONS; started++){
+        clients[started].depth = depth;
+        clients[started].rounds = rounds;
+        if (pthread_create(&clients[started].thread, NULL, client_run, &clients[started]) != 0){
+            break;
+        }
+    }
+
+    bool failed = (started < BENCH_CONNECTIONS);
+    for (size_t i = 0; i < started; i++){
+        pthread_join(clients[i].thread, NULL);
+        failed = failed || clients[i].failed;
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+    size_t writes = atomic_load(&write_calls) - writes_before;
+    if (failed){
+        return -1;
+    }
+
+    double batches = (double)(rounds * BENCH_CONNECTIONS);
+    printf("  N=%-4zu %9.0f replies/s  %6.2f writes per batch  (%zu writes)\n", depth,
+           batches * (double)depth * 1e9 / (double)elapsed, (double)writes / batches, writes);
+    return 0;
+}
+
+// Public API
+
+int main(int argc, char** argv){
+    setvbuf(stderr, NULL, _IOFBF, 1 << 16);
+
+    char* server_argv[BENCH_OPTIONS_MAX + 2] = { "bench_pipeline", "65536" };
+    if (argc - 1 > BENCH_OPTIONS_MAX){
+        fprintf(stderr, "[ERROR] main: At most %d server options.\n", BENCH_OPTIONS_MAX);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++){
+        server_argv[i + 1] = argv[i];
+    }
+    server_args_t server_args = {.argc = argc + 1, .argv = server_argv};
+
+    // The server is never stopped, it goes away with the process
+    pthread_t server;
+    if (pthread_create(&server, NULL, server_run, &server_args) != 0){
+        fprintf(stderr, "[ERROR] main: Failed to start the server.\n");
+        return 1;
+    }
+    pthread_detach(server);
+
+    bench_client_t clients[BENCH_CONNECTIONS];
+    for (size_t i = 0; i < BENCH_CONNECTIONS; i++){
+        clients[i] = (bench_client_t){.fd = client_connect(), .seed = 0x9E3779B97F4A7C15ull * (i + 1)};
+        if (clients[i].fd < 0){
+            fprintf(stderr, "[ERROR] main: Failed to connect to port %d.\n", SERVER_PORT);
+            return 1;
+        }
+    }
+
+    if (keys_fill(clients[0].fd) != 0){
+        fprintf(stderr, "[ERROR] main: Failed to set the keys.\n");
+        return 1;
+    }
+
+    // Replies that went through no write of ours came from another server
+    if (atomic_load(&write_calls) == 0){
+        fprintf(stderr, "[ERROR] main: Port %d belongs to another server.\n", SERVER_PORT);
+        return 1;
+    }
+
+    printf("bench_pipeline: %d connections, %d keys of %d bytes, about %d replies per depth\n", BENCH_CONNECTIONS,
+           BENCH_KEYS, BENCH_VALUE_SIZE, BENCH_REPLIES);
+
+    size_t depths[] = { 1, 16, 100, 256, REPLY_BATCH_MAX };
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++){
+        if (bench_depth(clients, depths[i]) != 0){
+            fprintf(stderr, "[ERROR] main: The N=%zu case failed.\n", depths[i]);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < BENCH_CONNECTIONS; i++){
+        close(clients[i].fd);
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+// Header
+#include "bench_common.h"
+#include "hashtable.h"
+#include "hashing_functionality.h"
+#include "string_functionality.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Hit and miss probes against the control-byte buckets, compared with the
+// layout they replaced: per-slot in_use flags, full 64-bit hashes and
+// KEY_MAX_LEN key arrays walked one slot at a time, with the same overflow
+// chains. The reference is rebuilt here without locks, so it is compared
+// with a single-owner table (no locks either) and, for the cost of the
+// concurrent read path, with a shared one.
+
+#define BENCH_BUCKETS       16384
+#define BENCH_LOAD          0.75
+#define BENCH_PROBES        4000000
+#define BENCH_KEY_ROOM      32
+#define BENCH_ROUNDS        5           // The fastest round is reported
+
+// Data
+
+typedef struct __attribute__((aligned(64))) slot_walk_bucket_t{
+    uint8_t in_use[BUCKET_CAPACITY];
+    uint64_t hashes[BUCKET_CAPACITY];
+    unsigned char keys[BUCKET_CAPACITY][KEY_MAX_LEN];
+    void* values[BUCKET_CAPACITY];
+    struct slot_walk_bucket_t* next;
+} slot_walk_bucket_t;
+
+typedef struct probe_set_t{
+    char (*keys)[BENCH_KEY_ROOM];
+    size_t* lengths;
+    size_t count;
+} probe_set_t;
+
+// Private API
+
+static int probe_set_init(probe_set_t* set, const char* prefix, size_t count){
+    set->keys = malloc(count * sizeof(*set->keys));
+    set->lengths = malloc(count * sizeof(size_t));
+    set->count = count;
+    if ((set->keys == NULL) || (set->lengths == NULL)){
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++){
+        int written = snprintf(set->keys[i], BENCH_KEY_ROOM, "%s:%08zu", prefix, i);
+        set->lengths[i] = (size_t)written;
+    }
+    return 0;
+}
+
+static void probe_set_free(probe_set_t* set){
+    free(set->keys);
+    free(set->lengths);
+}
+
+static void slot_walk_insert(slot_walk_bucket_t* buckets, const char* key, size_t key_len){
+    uint64_t hash_full = hash(key, key_len);
+    slot_walk_bucket_t* bucket = &buckets[hash_full & (BENCH_BUCKETS - 1)];
+
+    while (true){
+        for (int i = 0; i < BUCKET_CAPACITY; i++){
+            if (!bucket->in_use[i]){
+                bucket->in_use[i] = 1;
+                bucket->hashes[i] = hash_full;
+                memcpy(bucket->keys[i], key, key_len + 1);
+                bucket->values[i] = bucket;
+                return;
+            }
+        }
+
+        if (bucket->next == NULL){
+            bucket->next = calloc(1, sizeof(slot_walk_bucket_t));
+            if (bucket->next == NULL){
+                return;
+            }
+        }
+        bucket = bucket->next;
+    }
+}
+
+static bool slot_walk_exist(slot_walk_bucket_t* buckets, const char* key, size_t key_len){
+    uint64_t hash_full = hash(key, key_len);
+
+    for (slot_walk_bucket_t* bucket = &buckets[hash_full & (BENCH_BUCKETS - 1)]; bucket != NULL; bucket = bucket->next){
+        for (int i = 0; i < BUCKET_CAPACITY; i++){
+            if (bucket->in_use[i] &&
+                bucket->hashes[i] == hash_full &&
+                ustrncmp(bucket->keys[i], (const unsigned char*)key, KEY_MAX_LEN) == 0){
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void slot_walk_free(slot_walk_bucket_t* buckets){
+    for (size_t i = 0; i < BENCH_BUCKETS; i++){
+        slot_walk_bucket_t* overflow = buckets[i].next;
+        while (overflow != NULL){
+            slot_walk_bucket_t* next = overflow->next;
+            free(overflow);
+            overflow = next;
+        }
+    }
+    free(buckets);
+}
+
+// Random order, so the probes do not walk memory in insertion order.
+static size_t* probe_order(size_t count, size_t probes){
+    size_t* order = malloc(probes * sizeof(size_t));
+    if (order == NULL){
+        return NULL;
+    }
+
+    uint64_t state = 0xD1B54A32D192ED03ull;
+    for (size_t i = 0; i < probes; i++){
+        order[i] = (size_t)(bench_random(&state) % count);
+    }
+    return order;
+}
+
+static void report(const char* layout, const char* kind, uint64_t elapsed_ns, size_t found){
+    printf("  %-28s %-5s %6.1f ns/probe  (%zu found)\n", layout, kind,
+           (double)elapsed_ns / BENCH_PROBES, found);
+}
+
+static void bench_slot_walk(slot_walk_bucket_t* buckets, const probe_set_t* set, const size_t* order,
+                            const char* kind){
+    uint64_t best = UINT64_MAX;
+    size_t found = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        found = 0;
+        uint64_t start = bench_now_ns();
+        for (size_t i = 0; i < BENCH_PROBES; i++){
+            found += slot_walk_exist(buckets, set->keys[order[i]], set->lengths[order[i]]);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+    report("slot walk (before)", kind, best, found);
+}
+
+static void bench_table(hashtable_t* table, const char* layout, const probe_set_t* set, const size_t* order,
+                        const char* kind){
+    uint64_t best = UINT64_MAX;
+    size_t found = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++){
+        found = 0;
+        uint64_t start = bench_now_ns();
+        for (size_t i = 0; i < BENCH_PROBES; i++){
+            found += table_exist(table, (const unsigned char*)set->keys[order[i]], set->lengths[order[i]]);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+    report(layout, kind, best, found);
+}
+
+// Public API
+
+int main(void){
+    size_t key_count = (size_t)(BENCH_LOAD * BENCH_BUCKETS * BUCKET_CAPACITY);
+
+    probe_set_t hits;
+    probe_set_t misses;
+    if ((probe_set_init(&hits, "key", key_count) != 0) || (probe_set_init(&misses, "miss", key_count) != 0)){
+        fprintf(stderr, "[ERROR] main: Failed to allocate the keys.\n");
+        return 1;
+    }
+
+    slot_walk_bucket_t* slot_walk = calloc(BENCH_BUCKETS, sizeof(slot_walk_bucket_t));
+    hashtable_t* owned = table_create(BENCH_BUCKETS, LOCK_STRIPES_DEFAULT);
+    hashtable_t* shared = table_create(BENCH_BUCKETS, LOCK_STRIPES_DEFAULT);
+    size_t* order = probe_order(key_count, BENCH_PROBES);
+    if ((slot_walk == NULL) || (owned == NULL) || (shared == NULL) || (order == NULL)){
+        fprintf(stderr, "[ERROR] main: Failed to create the tables.\n");
+        return 1;
+    }
+    table_set_single_owner(owned);
+
+    void* value = table_value_inline("1", 1);
+    for (size_t i = 0; i < key_count; i++){
+        const unsigned char* key = (const unsigned char*)hits.keys[i];
+        slot_walk_insert(slot_walk, hits.keys[i], hits.lengths[i]);
+        table_set(owned, key, hits.lengths[i], value, NULL);
+        table_set(shared, key, hits.lengths[i], value, NULL);
+    }
+
+    printf("bench_probe: %d buckets, %zu keys (load %.2f), best of %d rounds of %d probes\n", BENCH_BUCKETS,
+           key_count, BENCH_LOAD, BENCH_ROUNDS, BENCH_PROBES);
+
+    bench_slot_walk(slot_walk, &hits, order, "hit");
+    bench_table(owned, "control bytes, single owner", &hits, order, "hit");
+    bench_table(shared, "control bytes, shared", &hits, order, "hit");
+
+    bench_slot_walk(slot_walk, &misses, order, "miss");
+    bench_table(owned, "control bytes, single owner", &misses, order, "miss");
+    bench_table(shared, "control bytes, shared", &misses, order, "miss");
+
+    free(order);
+    table_destroy(shared, NULL);
+    table_destroy(owned, NULL);
+    slot_walk_free(slot_walk);
+    probe_set_free(&misses);
+    probe_set_free(&hits);
+    return 0;
+}
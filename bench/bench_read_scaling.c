@@ -0,0 +1,218 @@
+// Header
+#include "bench_common.h"
+#include "hashtable.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Read throughput of a shared table from 1 up to max_threads threads (first
+// argument, twice the online CPUs by default), doubling each step. Every
+// thread hammers the same small hot key set, so the readers share stripes
+// and buckets: GET is table_get through the optimistic path with a copier
+// that hands back the stored pointer, EXIST is table_exist. The last case
+// adds one thread rewriting the hot keys, so readers also pay for seqlock
+// retries and the locked fallback. Figures only mean something up to the
+// number of CPUs; past it the threads just time-share.
+
+#define BENCH_HOT_KEYS      1024
+#define BENCH_BUCKETS       4096
+#define BENCH_DURATION_NS   500000000ull    // Per thread count and case
+#define BENCH_KEY_ROOM      32
+
+// Data
+
+typedef enum bench_case_t{
+    BENCH_GET,
+    BENCH_EXIST,
+    BENCH_GET_WITH_WRITER,
+} bench_case_t;
+
+typedef struct __attribute__((aligned(64))) reader_t{
+    pthread_t thread;
+    uint64_t seed;
+    uint64_t ops;
+    uint64_t found;
+} reader_t;
+
+typedef struct bench_state_t{
+    hashtable_t* table;
+    bench_case_t kind;
+    atomic_bool start;
+    atomic_bool stop;
+} bench_state_t;
+
+typedef struct reader_args_t{
+    bench_state_t* state;
+    reader_t* reader;
+} reader_args_t;
+
+static char hot_keys[BENCH_HOT_KEYS][BENCH_KEY_ROOM];
+static size_t hot_lengths[BENCH_HOT_KEYS];
+static char hot_value[] = "a value stored out of line, longer than the inline limit";
+
+// Private API
+
+// Values are never freed here, so the reference handed out is the pointer.
+static void* value_borrow(void* value){
+    return value;
+}
+
+static void* reader_run(void* arg){
+    reader_args_t* args = arg;
+    bench_state_t* state = args->state;
+    reader_t* reader = args->reader;
+    uint64_t ops = 0;
+    uint64_t found = 0;
+
+    while (!atomic_load_explicit(&state->start, memory_order_acquire)){
+        // Spin until every thread is up
+    }
+
+    while (!atomic_load_explicit(&state->stop, memory_order_relaxed)){
+        for (int i = 0; i < 256; i++){
+            size_t k = (size_t)(bench_random(&reader->seed) % BENCH_HOT_KEYS);
+            const unsigned char* key = (const unsigned char*)hot_keys[k];
+            if (state->kind == BENCH_EXIST){
+                found += table_exist(state->table, key, hot_lengths[k]);
+            } else{
+                found += (table_get(state->table, key, hot_lengths[k], value_borrow) != NULL);
+            }
+        }
+        ops += 256;
+    }
+
+    reader->ops = ops;
+    reader->found = found;
+    return NULL;
+}
+
+static void* writer_run(void* arg){
+    bench_state_t* state = arg;
+    uint64_t seed = 0xA0761D6478BD642Full;
+
+    while (!atomic_load_explicit(&state->start, memory_order_acquire)){
+        // Spin until every thread is up
+    }
+
+    while (!atomic_load_explicit(&state->stop, memory_order_relaxed)){
+        size_t k = (size_t)(bench_random(&seed) % BENCH_HOT_KEYS);
+        table_set(state->table, (const unsigned char*)hot_keys[k], hot_lengths[k], hot_value, NULL);
+    }
+    return NULL;
+}
+
+// Returns the total reads per second, 0 when a thread could not start.
+static double bench_run(hashtable_t* table, bench_case_t kind, size_t thread_count, uint64_t* out_found){
+    reader_t* readers = aligned_alloc(64, thread_count * sizeof(reader_t));
+    reader_args_t* args = malloc(thread_count * sizeof(reader_args_t));
+    if ((readers == NULL) || (args == NULL)){
+        free(readers);
+        free(args);
+        return 0.0;
+    }
+
+    bench_state_t state = {.table = table, .kind = kind};
+    atomic_init(&state.start, false);
+    atomic_init(&state.stop, false);
+
+    size_t started = 0;
+    for (; started < thread_count; started++){
+        readers[started] = (reader_t){.seed = 0x9E3779B97F4A7C15ull * (started + 1)};
+        args[started] = (reader_args_t){.state = &state, .reader = &readers[started]};
+        if (pthread_create(&readers[started].thread, NULL, reader_run, &args[started]) != 0){
+            break;
+        }
+    }
+
+    pthread_t writer;
+    bool writer_started = (kind == BENCH_GET_WITH_WRITER) && (pthread_create(&writer, NULL, writer_run, &state) == 0);
+
+    uint64_t begin = bench_now_ns();
+    atomic_store_explicit(&state.start, true, memory_order_release);
+
+    struct timespec pause = {
+        .tv_sec = (time_t)(BENCH_DURATION_NS / 1000000000ull),
+        .tv_nsec = (long)(BENCH_DURATION_NS % 1000000000ull),
+    };
+    nanosleep(&pause, NULL);
+
+    atomic_store_explicit(&state.stop, true, memory_order_relaxed);
+    uint64_t ops = 0;
+    uint64_t found = 0;
+    for (size_t i = 0; i < started; i++){
+        pthread_join(readers[i].thread, NULL);
+        ops += readers[i].ops;
+        found += readers[i].found;
+    }
+    if (writer_started){
+        pthread_join(writer, NULL);
+    }
+    uint64_t elapsed = bench_now_ns() - begin;
+
+    bool complete = (started == thread_count) && ((kind != BENCH_GET_WITH_WRITER) || writer_started);
+    free(args);
+    free(readers);
+
+    *out_found = found;
+    return complete ? ((double)ops * 1e9 / (double)elapsed) : 0.0;
+}
+
+static void bench_case(hashtable_t* table, bench_case_t kind, const char* name, size_t max_threads){
+    printf("  %s\n", name);
+
+    double single = 0.0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2){
+        uint64_t found = 0;
+        double rate = bench_run(table, kind, threads, &found);
+        if (rate == 0.0){
+            fprintf(stderr, "[ERROR] bench_case: Failed to start %zu threads.\n", threads);
+            return;
+        }
+        single = (threads == 1) ? rate : single;
+
+        printf("    %3zu threads  %8.2f Mops/s  %6.2f Mops/s per thread  x%.2f  (%llu found)\n", threads,
+               rate / 1e6, rate / 1e6 / (double)threads, rate / single, (unsigned long long)found);
+    }
+}
+
+// Public API
+
+int main(int argc, char** argv){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = (cpus > 0) ? (size_t)cpus * 2 : 8;
+    if (argc > 1){
+        max_threads = strtoul(argv[1], NULL, 10);
+    }
+    if (max_threads == 0){
+        fprintf(stderr, "[ERROR] main: max_threads must be at least 1.\n");
+        return 1;
+    }
+
+    hashtable_t* table = table_create(BENCH_BUCKETS, LOCK_STRIPES_DEFAULT);
+    if (table == NULL){
+        fprintf(stderr, "[ERROR] main: Failed to create the table.\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < BENCH_HOT_KEYS; i++){
+        int written = snprintf(hot_keys[i], BENCH_KEY_ROOM, "hot:%06zu", i);
+        hot_lengths[i] = (size_t)written;
+        if (table_set(table, (const unsigned char*)hot_keys[i], hot_lengths[i], hot_value, NULL) != 0){
+            fprintf(stderr, "[ERROR] main: Failed to insert the hot keys.\n");
+            return 1;
+        }
+    }
+
+    printf("bench_read_scaling: %d hot keys, %ld online CPUs, %.1f s per point\n", BENCH_HOT_KEYS, cpus,
+           (double)BENCH_DURATION_NS / 1e9);
+
+    bench_case(table, BENCH_GET, "GET (table_get, optimistic path)", max_threads);
+    bench_case(table, BENCH_EXIST, "EXIST (table_exist)", max_threads);
+    bench_case(table, BENCH_GET_WITH_WRITER, "GET with one writer on the hot keys", max_threads);
+
+    table_destroy(table, NULL);
+    return 0;
+}
@@ -22,3 +22,11 @@ size_t next_power_of_2(size_t n) {
 
     return n;
 }
+
+uint64_t reverse_bits(uint64_t n) {
+    n = ((n >> 1) & 0x5555555555555555ull) | ((n & 0x5555555555555555ull) << 1);
+    n = ((n >> 2) & 0x3333333333333333ull) | ((n & 0x3333333333333333ull) << 2);
+    n = ((n >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((n & 0x0F0F0F0F0F0F0F0Full) << 4);
+
+    return __builtin_bswap64(n);
+}
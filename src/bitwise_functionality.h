@@ -5,6 +5,7 @@
 
 #include <stddef.h> 
 #include <stdbool.h> 
+#include <stdint.h>
 
 // Macro and Defines
   // None for now
@@ -12,6 +13,7 @@
 // Public API
 
 size_t next_power_of_2(size_t n);
+uint64_t reverse_bits(uint64_t n);
 
 
 #endif
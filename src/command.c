@@ -4,6 +4,8 @@
 
 #include "command.h"
 #include "hashtable.h"
+#include "epoch_functionality.h"
+#include "slab_functionality.h"
 #include "string_functionality.h"
 
 #include <limits.h>
@@ -28,10 +30,16 @@ static command_result_t cmd_resize(hashtable_t* context, command_data_t* input);
 static command_result_t cmd_clear(hashtable_t* context, command_data_t* input);
 static command_result_t cmd_load_factor(hashtable_t* context, command_data_t* input);
 static command_result_t cmd_count(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_info(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_expire(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_ttl(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_persist(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_scan(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_range(hashtable_t* context, command_data_t* input);
+static command_result_t cmd_prefix(hashtable_t* context, command_data_t* input);
 
-static int build_command_data(cmd_function_type tag, char* argv[], const size_t args_lengths[], command_data_t* out_data);
-
-static execute_result_t create_error_response(int status, const char* message);
+static int build_command_data(cmd_function_type tag, int argc, char* argv[], const size_t args_lengths[],
+                              data_entry_t* value, command_data_t* out_data);
 
 
 
@@ -41,19 +49,34 @@ void free_execute_result(execute_result_t* result){
     }
 
     free(result->body);
+    destroy_value_wrapper(result->value);
 
     result->body = NULL;
+    result->value = NULL;
     result->body_length = 0; 
 }
 
 size_t std_value_sizer(const void* value){
-    if (value == NULL){
+    if ((value == NULL) || table_value_is_inline(value)){
         return 0;
     }
 
     data_entry_t* entry = (data_entry_t*)value;
 
-    return sizeof(data_entry_t) + entry->size;
+    return slab_usable_size(sizeof(data_entry_t) + entry->size);
+}
+
+    // Value Constructors
+
+data_entry_t* value_create(size_t size){
+    data_entry_t* entry = slab_alloc(sizeof(data_entry_t) + size);
+    if (entry == NULL){
+        return NULL;
+    }
+
+    atomic_init(&entry->refcount, 1);
+    entry->size = size;
+    return entry;
 }
 
     // Value Destroyers
@@ -63,12 +86,32 @@ void std_value_destroy(data_entry_t* value){
         return;
     }
 
-    free(value);
+    slab_free(value, sizeof(data_entry_t) + value->size);
     return;
 }
 
+// Takes a reference for a reader, the table guarantees the entry is alive while it runs.
+void* std_value_acquire(void* value) {
+    if ((value == NULL) || table_value_is_inline(value)) {
+        return value;
+    }
+
+    data_entry_t* entry = (data_entry_t*)value;
+    atomic_fetch_add_explicit(&entry->refcount, 1, memory_order_relaxed);
+
+    return value;
+}
+
+// Drops one reference, the last one frees the entry.
 void destroy_value_wrapper(void* data) {
-    std_value_destroy((data_entry_t*)data);
+    if ((data == NULL) || table_value_is_inline(data)) {
+        return;
+    }
+
+    data_entry_t* entry = (data_entry_t*)data;
+    if (atomic_fetch_sub_explicit(&entry->refcount, 1, memory_order_acq_rel) == 1) {
+        std_value_destroy(entry);
+    }
 }
 
 struct command_registry{
@@ -120,13 +163,14 @@ static command_result_t cmd_get(hashtable_t* context, command_data_t* input){
     }
 
     const unsigned char* key = input->in.get_input.key;
+    size_t key_len = input->in.get_input.key_len;
 
-    if (is_key_valid(key) == false){
+    if (is_key_valid(key, key_len) == false){
         return result;
     }
     
-    fprintf(stderr, "[INFO] cmd_get: Executing GET for key: '%s'.\n", key);
-    void* generic_ptr = table_get(context, key, std_value_sizer);
+    fprintf(stderr, "[INFO] cmd_get: Executing GET for key: '%.*s'.\n", (int)key_len, key);
+    void* generic_ptr = table_get(context, key, key_len, std_value_acquire);
 
     if (generic_ptr == NULL){
         result.type = CMD_TYPE_EMPTY;
@@ -134,11 +178,16 @@ static command_result_t cmd_get(hashtable_t* context, command_data_t* input){
     }
 
     result.type = CMD_TYPE_GET;
-    result.output.get_output.value = (data_entry_t*)generic_ptr;
+    result.output.get_output.value = generic_ptr;
 
     return result;
 }
 
+// Frees room for a write; false when the table is full and nothing can be evicted.
+static bool reserve_memory(hashtable_t* context){
+    return table_evict(context, EVICTION_KEYS_PER_WRITE, destroy_value_wrapper) != -1;
+}
+
 static command_result_t cmd_set(hashtable_t* context, command_data_t* input) {
     command_result_t result = {0};
     result.type = CMD_TYPE_ERROR;
@@ -147,13 +196,19 @@ static command_result_t cmd_set(hashtable_t* context, command_data_t* input) {
     }
 
     const unsigned char* key = input->in.set_input.key;
-    data_entry_t* value = (data_entry_t*)input->in.set_input.value;
+    size_t key_len = input->in.set_input.key_len;
+    void* value = input->in.set_input.value;
+    uint32_t ttl = input->in.set_input.ttl;
 
-    if ((is_key_valid(key) == false) || (value == NULL)){
+    if ((is_key_valid(key, key_len) == false) || (value == NULL)){
         return result;
     }
 
-    int error = table_set(context, key, value, destroy_value_wrapper);
+    int error = reserve_memory(context) ? table_set_ex(context, key, key_len, value, destroy_value_wrapper, ttl)
+                                        : CMD_ERROR_MAXMEMORY;
+    if (error != 0){
+        destroy_value_wrapper(value);
+    }
 
     result.type = CMD_TYPE_SET;
     result.output.set_output.error = error;
@@ -167,14 +222,18 @@ static command_result_t cmd_add(hashtable_t* context, command_data_t* input){
         return result;
     }
 
-    const unsigned char* key = input->in.set_input.key;
-    data_entry_t* value = (data_entry_t*)input->in.set_input.value;
+    const unsigned char* key = input->in.add_input.key;
+    size_t key_len = input->in.add_input.key_len;
+    void* value = input->in.add_input.value;
 
-    if ((is_key_valid(key) == false) || (value == NULL)){
+    if ((is_key_valid(key, key_len) == false) || (value == NULL)){
         return result;
     }
 
-    int error = table_add(context, key, value);
+    int error = reserve_memory(context) ? table_add(context, key, key_len, value) : CMD_ERROR_MAXMEMORY;
+    if (error != 0){
+        destroy_value_wrapper(value);
+    }
 
     result.type = CMD_TYPE_ADD;
     result.output.add_output.error = error;
@@ -184,20 +243,22 @@ static command_result_t cmd_add(hashtable_t* context, command_data_t* input){
 static command_result_t cmd_del(hashtable_t* context, command_data_t* input) {
     command_result_t result = {0};
     result.type = CMD_TYPE_ERROR;
-    if ((context == NULL) || (input == NULL) || (is_key_valid(input->in.del_input.key) == false)) {
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.del_input.key, input->in.del_input.key_len) == false)) {
         return result;
     }
 
     const unsigned char* key_to_delete = input->in.del_input.key;
-    int error = table_delete(context, key_to_delete, destroy_value_wrapper);
+    size_t key_len = input->in.del_input.key_len;
+    int error = table_delete(context, key_to_delete, key_len, destroy_value_wrapper);
 
     result.output.del_output.error = error;
 
     if (error == 0) {
-        fprintf(stderr, "[INFO] cmd_del: Successfully executed DEL for key: '%s'.\n", key_to_delete);
+        fprintf(stderr, "[INFO] cmd_del: Successfully executed DEL for key: '%.*s'.\n", (int)key_len, key_to_delete);
         result.type = CMD_TYPE_DEL;
     } else{
-        fprintf(stderr, "[ERROR] cmd_del: Failed to delete key '%s' (error code: %d).\n", key_to_delete, error);
+        fprintf(stderr, "[ERROR] cmd_del: Failed to delete key '%.*s' (error code: %d).\n", (int)key_len, key_to_delete, error);
     }
 
     return result;
@@ -206,15 +267,17 @@ static command_result_t cmd_del(hashtable_t* context, command_data_t* input) {
 static command_result_t cmd_exist(hashtable_t* context, command_data_t* input) {
     command_result_t result = {0};
     result.type = CMD_TYPE_ERROR;
-    if ((context == NULL) || (input == NULL) || (is_key_valid(input->in.exist_input.key) == false)) {
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.exist_input.key, input->in.exist_input.key_len) == false)) {
         return result;
     }
 
     const unsigned char* actual_key = input->in.exist_input.key;
+    size_t key_len = input->in.exist_input.key_len;
 
-    fprintf(stderr, "[INFO] cmd_exist: Executing EXIST for key: '%s'.\n", actual_key);
+    fprintf(stderr, "[INFO] cmd_exist: Executing EXIST for key: '%.*s'.\n", (int)key_len, actual_key);
 
-    bool existence = table_exist(context, actual_key);
+    bool existence = table_exist(context, actual_key, key_len);
 
     result.output.exist_output.existence = existence;
     result.type = CMD_TYPE_EXIST;
@@ -225,20 +288,31 @@ static command_result_t cmd_exist(hashtable_t* context, command_data_t* input) {
 static command_result_t cmd_replace(hashtable_t* context, command_data_t* input){
     command_result_t result = {0};
     result.type = CMD_TYPE_ERROR;
-    if ((context == NULL) || (input == NULL) || (is_key_valid(input->in.replace_input.key) == false) || 
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.replace_input.key, input->in.replace_input.key_len) == false) || 
         (input->in.replace_input.new_value == NULL)){
         return result;
     }
 
     const unsigned char* key = input->in.replace_input.key;
-    data_entry_t* new_value = (data_entry_t*)input->in.replace_input.new_value;
+    size_t key_len = input->in.replace_input.key_len;
+    void* new_value = input->in.replace_input.new_value;
+
+    fprintf(stderr, "[INFO] cmd_replace: Attempting to REPLACE value for key: '%.*s'.\n", (int)key_len, key);
 
-    fprintf(stderr, "[INFO] cmd_replace: Attempting to REPLACE value for key: '%s'.\n", key);
+    if (!reserve_memory(context)){
+        destroy_value_wrapper(new_value);
+        result.type = CMD_TYPE_REPLACE;
+        result.output.replace_output.error = CMD_ERROR_MAXMEMORY;
+        return result;
+    }
 
-    int error_code = table_replace(context, key, new_value, destroy_value_wrapper);
+    int error_code = table_replace(context, key, key_len, new_value, destroy_value_wrapper);
 
     if (error_code != 0){
-        fprintf(stderr, "[ERROR] cmd_replace: Failed to replace key '%s' (error code: %d). Key might not exist.\n", key, error_code);
+        fprintf(stderr, "[ERROR] cmd_replace: Failed to replace key '%.*s' (error code: %d). Key might not exist.\n",
+                (int)key_len, key, error_code);
+        destroy_value_wrapper(new_value);
         return result;
     }
 
@@ -257,7 +331,7 @@ static command_result_t cmd_resize(hashtable_t* context, command_data_t* input){
 
     size_t new_size = input->in.resize_input.new_size;
 
-    fprintf(stderr, "[INFO] cmd_resize: Attempting to resize table to %zu buckets.\n", new_size);
+    fprintf(stderr, "[INFO] cmd_resize: Starting progressive resize to %zu buckets.\n", new_size);
 
     int error_code = table_resize(context, new_size);
 
@@ -339,6 +413,42 @@ static command_result_t cmd_count(hashtable_t* context, command_data_t* input) {
             break;
         }
 
+        case CMD_COUNT_REHASH_PROGRESS:{
+            double progress = table_rehash_progress(context);
+            result.output.count_output.count_t.counter_d = progress;
+            break;
+        }
+
+        case CMD_COUNT_RETIRED_MEMORY:{
+            size_t retired = epoch_pending_bytes();
+            result.output.count_output.count_t.counter_s = retired;
+            break;
+        }
+
+        case CMD_COUNT_USED_MEMORY:{
+            size_t used = table_used_memory(context);
+            result.output.count_output.count_t.counter_s = used;
+            break;
+        }
+
+        case CMD_COUNT_EVICTED_KEYS:{
+            size_t evicted = table_evicted_keys(context);
+            result.output.count_output.count_t.counter_s = evicted;
+            break;
+        }
+
+        case CMD_COUNT_EVICTED_MEMORY:{
+            size_t evicted = table_evicted_bytes(context);
+            result.output.count_output.count_t.counter_s = evicted;
+            break;
+        }
+
+        case CMD_COUNT_EXPIRED_KEYS:{
+            size_t expired = table_expired_keys(context);
+            result.output.count_output.count_t.counter_s = expired;
+            break;
+        }
+
         default: {
             fprintf(stderr, "[ERROR] cmd_count: Unknown or unsupported COUNT subtype enum value: %d.\n", count_type);
             return result;
@@ -346,6 +456,250 @@ static command_result_t cmd_count(hashtable_t* context, command_data_t* input) {
     }
 
     result.type = CMD_TYPE_COUNT;
+    result.output.count_output.type = count_type;
+    return result;
+}
+
+static command_result_t cmd_expire(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.expire_input.key, input->in.expire_input.key_len) == false)){
+        return result;
+    }
+
+    const unsigned char* key = input->in.expire_input.key;
+    size_t key_len = input->in.expire_input.key_len;
+
+    int error = table_expire(context, key, key_len, input->in.expire_input.ttl);
+    if (error == -3){
+        return result;
+    }
+
+    fprintf(stderr, "[INFO] cmd_expire: EXPIRE %u seconds for key: '%.*s' (%s).\n",
+            input->in.expire_input.ttl, (int)key_len, key, (error == 0) ? "set" : "missing");
+
+    result.type = CMD_TYPE_EXPIRE;
+    result.output.expire_output.applied = (error == 0);
+    return result;
+}
+
+static command_result_t cmd_ttl(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.ttl_input.key, input->in.ttl_input.key_len) == false)){
+        return result;
+    }
+
+    result.type = CMD_TYPE_TTL;
+    result.output.ttl_output.ttl = table_ttl(context, input->in.ttl_input.key, input->in.ttl_input.key_len);
+    return result;
+}
+
+static command_result_t cmd_persist(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL) ||
+        (is_key_valid(input->in.persist_input.key, input->in.persist_input.key_len) == false)){
+        return result;
+    }
+
+    int error = table_persist(context, input->in.persist_input.key, input->in.persist_input.key_len);
+    if (error == -3){
+        return result;
+    }
+
+    result.type = CMD_TYPE_PERSIST;
+    result.output.persist_output.applied = (error == 0);
+    return result;
+}
+
+typedef struct scan_reply_t{
+    const unsigned char* pattern;
+    size_t pattern_len;
+    unsigned char* text;
+    size_t length;
+    size_t capacity;
+    size_t keys;
+    bool failed;
+} scan_reply_t;
+
+// Room for the length line of a bulk string, around its data
+#define BULK_FRAME_OVERHEAD 25
+
+// Runs under a stripe read lock, so it only filters and copies
+static void scan_collect(const unsigned char* key, size_t key_len, void* scan_context){
+    scan_reply_t* reply = scan_context;
+    if (reply->failed || ((reply->pattern != NULL) && !glob_match(reply->pattern, reply->pattern_len, key, key_len))){
+        return;
+    }
+
+    if (reply->length + key_len + BULK_FRAME_OVERHEAD > reply->capacity){
+        size_t capacity = reply->capacity * 2;
+        while (reply->length + key_len + BULK_FRAME_OVERHEAD > capacity){
+            capacity *= 2;
+        }
+
+        unsigned char* text = realloc(reply->text, capacity);
+        if (text == NULL){
+            reply->failed = true;
+            return;
+        }
+        reply->text = text;
+        reply->capacity = capacity;
+    }
+
+    int written = snprintf((char*)reply->text + reply->length, BULK_FRAME_OVERHEAD, "$%zu\r\n", key_len);
+    reply->length += (size_t)written;
+    memcpy(reply->text + reply->length, key, key_len);
+    reply->length += key_len;
+    memcpy(reply->text + reply->length, "\r\n", 2);
+    reply->length += 2;
+    reply->keys++;
+}
+
+static command_result_t cmd_scan(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL)){
+        return result;
+    }
+
+    // The cursor goes first, it is written once the reply is formatted
+    scan_reply_t reply = {
+        .pattern = input->in.scan_input.pattern,
+        .pattern_len = input->in.scan_input.pattern_len,
+        .text = malloc(INFO_LINE_SIZE),
+        .length = SCAN_CURSOR_ROOM,
+        .capacity = INFO_LINE_SIZE,
+        .keys = 0,
+        .failed = false
+    };
+    if (reply.text == NULL){
+        return result;
+    }
+
+    uint64_t cursor = table_scan(context, input->in.scan_input.cursor, input->in.scan_input.count, scan_collect, &reply);
+    if (reply.failed){
+        free(reply.text);
+        return result;
+    }
+
+    result.type = CMD_TYPE_SCAN;
+    result.output.scan_output.text = reply.text;
+    result.output.scan_output.length = reply.length;
+    result.output.scan_output.keys = reply.keys;
+    result.output.scan_output.cursor = cursor;
+    return result;
+}
+
+static command_result_t range_result(command_result_t result, cmd_function_type type, scan_reply_t* reply,
+                                     size_t limit){
+    if (reply->failed){
+        free(reply->text);
+        return result;
+    }
+
+    result.type = type;
+    result.output.range_output.error = 0;
+    result.output.range_output.text = reply->text;
+    result.output.range_output.length = reply->length;
+    result.output.range_output.keys = reply->keys;
+    result.output.range_output.limit = limit;
+    return result;
+}
+
+static command_result_t cmd_range(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL)){
+        return result;
+    }
+
+    if (!table_has_ordered_index(context)){
+        result.type = CMD_TYPE_RANGE;
+        result.output.range_output.error = CMD_ERROR_NO_INDEX;
+        return result;
+    }
+
+    scan_reply_t reply = { .pattern = NULL, .text = malloc(INFO_LINE_SIZE), .capacity = INFO_LINE_SIZE };
+    if (reply.text == NULL){
+        return result;
+    }
+
+    table_range(context, input->in.range_input.start, input->in.range_input.start_len, input->in.range_input.end,
+                input->in.range_input.end_len, input->in.range_input.limit, scan_collect, &reply);
+
+    return range_result(result, CMD_TYPE_RANGE, &reply, input->in.range_input.limit);
+}
+
+static command_result_t cmd_prefix(hashtable_t* context, command_data_t* input){
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL)){
+        return result;
+    }
+
+    if (!table_has_ordered_index(context)){
+        result.type = CMD_TYPE_PREFIX;
+        result.output.range_output.error = CMD_ERROR_NO_INDEX;
+        return result;
+    }
+
+    scan_reply_t reply = { .pattern = NULL, .text = malloc(INFO_LINE_SIZE), .capacity = INFO_LINE_SIZE };
+    if (reply.text == NULL){
+        return result;
+    }
+
+    table_prefix(context, input->in.prefix_input.prefix, input->in.prefix_input.prefix_len,
+                 input->in.prefix_input.limit, scan_collect, &reply);
+
+    return range_result(result, CMD_TYPE_PREFIX, &reply, input->in.prefix_input.limit);
+}
+
+// One line per slab class, then one for the values too large for any class
+static command_result_t cmd_info(hashtable_t* context, command_data_t* input) {
+    command_result_t result = {0};
+    result.type = CMD_TYPE_ERROR;
+    if ((context == NULL) || (input == NULL) || (input->in.info_input.type != CMD_INFO_SLAB)) {
+        return result;
+    }
+
+    size_t capacity = (SLAB_CLASS_COUNT + 1) * INFO_LINE_SIZE;
+    unsigned char* text = malloc(capacity);
+    if (text == NULL) {
+        return result;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i <= SLAB_CLASS_COUNT; i++) {
+        slab_class_stats_t stats;
+        if (slab_class_stats(i, &stats) != 0) {
+            continue;
+        }
+
+        int written;
+        if (i < SLAB_CLASS_COUNT) {
+            written = snprintf((char*)text + length, capacity - length,
+                               "%s%zu used=%zu free=%zu pages=%zu requested=%zu fragmentation=%.2f",
+                               (length != 0) ? "\n" : "", stats.object_size, stats.used, stats.free,
+                               stats.pages, stats.requested_bytes, stats.fragmentation);
+        } else {
+            written = snprintf((char*)text + length, capacity - length, "%slarge used=%zu requested=%zu",
+                               (length != 0) ? "\n" : "", stats.used, stats.requested_bytes);
+        }
+
+        if ((written < 0) || ((size_t)written >= capacity - length)) {
+            free(text);
+            return result;
+        }
+        length += (size_t)written;
+    }
+
+    result.type = CMD_TYPE_INFO;
+    result.output.info_output.text = text;
+    result.output.info_output.length = length;
     return result;
 }
 
@@ -354,18 +708,25 @@ static command_result_t cmd_count(hashtable_t* context, command_data_t* input) {
 static command command_table[] = { // Name needs to be in lexicographic order
     // name         tag                     proc               arity   flags
     //----------------------------------------------------------------------
-    { "ADD",        CMD_TYPE_ADD,           cmd_add,           2,      "w"  },
-    { "CLEAR",      CMD_TYPE_CLEAR,         cmd_clear,         0,      "w"  },
-    { "COUNT",      CMD_TYPE_COUNT,         cmd_count,         1,      "r"  },
-    { "DEL",        CMD_TYPE_DEL,           cmd_del,           1,      "w"  },
-    { "EXIST",      CMD_TYPE_EXIST,         cmd_exist,         1,      "r"  },
-    { "GET",        CMD_TYPE_GET,           cmd_get,           1,      "ra" },
-    { "LOADFACTOR", CMD_TYPE_LOADFACTOR,    cmd_load_factor,   0,      "r"  },
-    { "REPLACE",    CMD_TYPE_REPLACE,       cmd_replace,       2,      "w"  },
-    { "RESIZE",     CMD_TYPE_RESIZE,        cmd_resize,        1,      "w"  },
-    { "SET",        CMD_TYPE_SET,           cmd_set,           2,      "w"  },
-
-    { NULL,         255,                    NULL,              0,      NULL}
+    { "ADD",        CMD_TYPE_ADD,           cmd_add,           2,      "wkv" },
+    { "CLEAR",      CMD_TYPE_CLEAR,         cmd_clear,         0,      "wb"  },
+    { "COUNT",      CMD_TYPE_COUNT,         cmd_count,         1,      "rb"  },
+    { "DEL",        CMD_TYPE_DEL,           cmd_del,           1,      "wk"  },
+    { "EXIST",      CMD_TYPE_EXIST,         cmd_exist,         1,      "rk"  },
+    { "EXPIRE",     CMD_TYPE_EXPIRE,        cmd_expire,        2,      "wk"  },
+    { "GET",        CMD_TYPE_GET,           cmd_get,           1,      "rak" },
+    { "INFO",       CMD_TYPE_INFO,          cmd_info,          1,      "r"   },
+    { "LOADFACTOR", CMD_TYPE_LOADFACTOR,    cmd_load_factor,   0,      "rb"  },
+    { "PERSIST",    CMD_TYPE_PERSIST,       cmd_persist,       1,      "wk"  },
+    { "PREFIX",     CMD_TYPE_PREFIX,        cmd_prefix,        -1,     "rb"  },
+    { "RANGE",      CMD_TYPE_RANGE,         cmd_range,         -2,     "rb"  },
+    { "REPLACE",    CMD_TYPE_REPLACE,       cmd_replace,       2,      "wkv" },
+    { "RESIZE",     CMD_TYPE_RESIZE,        cmd_resize,        1,      "wb"  },
+    { "SCAN",       CMD_TYPE_SCAN,          cmd_scan,          -1,     "r"   },
+    { "SET",        CMD_TYPE_SET,           cmd_set,           -2,     "wkv" },
+    { "TTL",        CMD_TYPE_TTL,           cmd_ttl,           1,      "rk"  },
+
+    { NULL,         255,                    NULL,              0,      NULL  }
 };
 
 // Execute Helper function
@@ -383,6 +744,21 @@ bool stocmdcount(const char* subtype_str, cmd_count_t* out_type) {
             }
             break;
 
+        case 'E':
+            if (strcmp(subtype_str, "EXPIRED_KEYS") == 0) {
+                *out_type = CMD_COUNT_EXPIRED_KEYS;
+                return true;
+            }
+            if (strcmp(subtype_str, "EVICTED_KEYS") == 0) {
+                *out_type = CMD_COUNT_EVICTED_KEYS;
+                return true;
+            }
+            if (strcmp(subtype_str, "EVICTED_MEMORY") == 0) {
+                *out_type = CMD_COUNT_EVICTED_MEMORY;
+                return true;
+            }
+            break;
+
         case 'M':
             if (strcmp(subtype_str, "MEMORY_USAGE") == 0) {
                 *out_type = CMD_COUNT_MEMORY_USAGE;
@@ -397,12 +773,43 @@ bool stocmdcount(const char* subtype_str, cmd_count_t* out_type) {
             }
             break;
 
+        case 'U':
+            if (strcmp(subtype_str, "USED_MEMORY") == 0) {
+                *out_type = CMD_COUNT_USED_MEMORY;
+                return true;
+            }
+            break;
+
         case 'O':
             if (strcmp(subtype_str, "OCCUPIED_BUCKET") == 0) {
                 *out_type = CMD_COUNT_OCCUPIED_BUCKET;
                 return true;
             }
             break;
+
+        case 'R':
+            if (strcmp(subtype_str, "REHASH_PROGRESS") == 0) {
+                *out_type = CMD_COUNT_REHASH_PROGRESS;
+                return true;
+            }
+            if (strcmp(subtype_str, "RETIRED_MEMORY") == 0) {
+                *out_type = CMD_COUNT_RETIRED_MEMORY;
+                return true;
+            }
+            break;
+    }
+
+    return false;
+}
+
+bool stocmdinfo(const char* subtype_str, cmd_info_t* out_type) {
+    if (subtype_str == NULL || out_type == NULL) {
+        return false;
+    }
+
+    if (strcmp(subtype_str, "SLAB") == 0) {
+        *out_type = CMD_INFO_SLAB;
+        return true;
     }
 
     return false;
@@ -425,7 +832,40 @@ command_registry* registry_create(){
     return reg;
 }
 
-static int build_command_data(cmd_function_type tag, char* argv[], const size_t args_lengths[], command_data_t* out_data){
+// Optional trailing LIMIT n, from argv[first] on
+static bool parse_limit(int argc, char* argv[], int first, size_t* out){
+    *out = RANGE_LIMIT_MAX;
+    if (argc == first){
+        return true;
+    }
+
+    if ((argc != first + 2) || (strcasecmp(argv[first], "LIMIT") != 0)){
+        return false;
+    }
+
+    size_t limit = stosizet(argv[first + 1]);
+    if (limit == 0){
+        return false;
+    }
+
+    *out = (limit < RANGE_LIMIT_MAX) ? limit : RANGE_LIMIT_MAX;
+    return true;
+}
+
+// Whole seconds, at least 1 and at most TTL_MAX_SECONDS
+static bool parse_ttl(const char* text, uint32_t* out){
+    char* endptr;
+    unsigned long ttl = strtoul(text, &endptr, 10);
+    if ((endptr == text) || (*endptr != '\0') || (text[0] == '-') || (ttl == 0) || (ttl > TTL_MAX_SECONDS)){
+        return false;
+    }
+
+    *out = (uint32_t)ttl;
+    return true;
+}
+
+static int build_command_data(cmd_function_type tag, int argc, char* argv[], const size_t args_lengths[],
+                              data_entry_t* value, command_data_t* out_data){
     out_data->tag = tag;
 
     switch (tag){
@@ -433,35 +873,73 @@ static int build_command_data(cmd_function_type tag, char* argv[], const size_t
         case CMD_TYPE_SET:
         case CMD_TYPE_ADD:{
             const unsigned char* key = (const unsigned char*)argv[0];
-            if (is_key_valid(key) == false) {
+            if (is_key_valid(key, args_lengths[0]) == false) {
                 fprintf(stderr, "[ERROR] build_command_data: Provided key is not valid.\n");
+                destroy_value_wrapper(value);
                 return -1;
             }
-            
-            data_entry_t* value = malloc(sizeof(data_entry_t) + args_lengths[1]);
-            if (value == NULL) {
-                fprintf(stderr, "[ERROR] build_command_data: Memory allocation for value failed.\n");
-                return -1;
+
+            // Only SET takes options: SET key value [EX seconds]
+            uint32_t ttl = 0;
+            if (argc != 2) {
+                if ((tag != CMD_TYPE_SET) || (argc != 4) || (strcasecmp(argv[2], "EX") != 0) || !parse_ttl(argv[3], &ttl)) {
+                    fprintf(stderr, "[ERROR] build_command_data: Invalid SET options, expected EX <seconds>.\n");
+                    destroy_value_wrapper(value);
+                    return -1;
+                }
             }
             
-            value->size = args_lengths[1];
-            memcpy(value->data, argv[1], value->size);
+            // A value streamed in by the parser is used as it is; small
+            // values skip the allocation and travel inside the slot
+            void* stored = value;
+            if (stored == NULL) {
+                stored = table_value_inline(argv[1], args_lengths[1]);
+            }
+            if (stored == NULL) {
+                data_entry_t* entry = value_create(args_lengths[1]);
+                if (entry == NULL) {
+                    fprintf(stderr, "[ERROR] build_command_data: Memory allocation for value failed.\n");
+                    return -1;
+                }
+
+                memcpy(entry->data, argv[1], entry->size);
+                stored = entry;
+            }
 
-            
             out_data->in.set_input.key = key;
-            out_data->in.set_input.value = value;
+            out_data->in.set_input.key_len = args_lengths[0];
+            out_data->in.set_input.value = stored;
+            out_data->in.set_input.ttl = ttl;
+            break;
+        }
+
+        case CMD_TYPE_EXPIRE:{
+            const unsigned char* key = (const unsigned char*)argv[0];
+            if (is_key_valid(key, args_lengths[0]) == false){
+                fprintf(stderr, "[ERROR] build_command_data: Provided key is not valid.\n");
+                return -1;
+            }
+            if (parse_ttl(argv[1], &out_data->in.expire_input.ttl) == false){
+                fprintf(stderr, "[ERROR] build_command_data: Provided TTL is not valid: '%s'.\n", argv[1]);
+                return -1;
+            }
+            out_data->in.expire_input.key = key;
+            out_data->in.expire_input.key_len = args_lengths[0];
             break;
         }
 
         case CMD_TYPE_GET:
         case CMD_TYPE_DEL:
-        case CMD_TYPE_EXIST:{
+        case CMD_TYPE_EXIST:
+        case CMD_TYPE_TTL:
+        case CMD_TYPE_PERSIST:{
             const unsigned char* key = (const unsigned char*)argv[0];
-            if (is_key_valid(key) == false){
+            if (is_key_valid(key, args_lengths[0]) == false){
                 fprintf(stderr, "[ERROR] build_command_data: Provided key is not valid.\n");
                 return -1;
             }
             out_data->in.get_input.key = key;
+            out_data->in.get_input.key_len = args_lengths[0];
             break;
         }
 
@@ -493,6 +971,93 @@ static int build_command_data(cmd_function_type tag, char* argv[], const size_t
             break;
         }
 
+        case CMD_TYPE_INFO:{
+            cmd_info_t info_type_enum;
+            if (stocmdinfo(argv[0], &info_type_enum) == false) {
+                fprintf(stderr, "[ERROR] build_command_data: Provided INFO subtype is not valid: '%s'.\n", argv[0]);
+                return -1;
+            }
+            out_data->in.info_input.type = info_type_enum;
+            break;
+        }
+
+        // SCAN cursor [MATCH pattern] [COUNT n], options in any order
+        case CMD_TYPE_SCAN:{
+            char* endptr;
+            if ((argv[0][0] == '-') || (argv[0][0] == '\0')){
+                fprintf(stderr, "[ERROR] build_command_data: Provided cursor is not valid: '%s'.\n", argv[0]);
+                return -1;
+            }
+            unsigned long long cursor = strtoull(argv[0], &endptr, 10);
+            if (*endptr != '\0'){
+                fprintf(stderr, "[ERROR] build_command_data: Provided cursor is not valid: '%s'.\n", argv[0]);
+                return -1;
+            }
+
+            out_data->in.scan_input.cursor = (uint64_t)cursor;
+            out_data->in.scan_input.pattern = NULL;
+            out_data->in.scan_input.pattern_len = 0;
+            out_data->in.scan_input.count = SCAN_COUNT_DEFAULT;
+
+            for (int i = 1; i < argc; i += 2){
+                if (i + 1 >= argc){
+                    fprintf(stderr, "[ERROR] build_command_data: SCAN option '%s' has no value.\n", argv[i]);
+                    return -1;
+                }
+
+                if (strcasecmp(argv[i], "MATCH") == 0){
+                    out_data->in.scan_input.pattern = (const unsigned char*)argv[i + 1];
+                    out_data->in.scan_input.pattern_len = args_lengths[i + 1];
+                } else if (strcasecmp(argv[i], "COUNT") == 0){
+                    size_t count = stosizet(argv[i + 1]);
+                    if (count == 0){
+                        fprintf(stderr, "[ERROR] build_command_data: Provided SCAN count is not valid: '%s'.\n", argv[i + 1]);
+                        return -1;
+                    }
+                    out_data->in.scan_input.count = (count < SCAN_COUNT_MAX) ? count : SCAN_COUNT_MAX;
+                } else{
+                    fprintf(stderr, "[ERROR] build_command_data: Unknown SCAN option: '%s'.\n", argv[i]);
+                    return -1;
+                }
+            }
+            break;
+        }
+
+        // RANGE start end [LIMIT n]
+        case CMD_TYPE_RANGE:{
+            if (!is_key_valid((const unsigned char*)argv[0], args_lengths[0]) ||
+                !is_key_valid((const unsigned char*)argv[1], args_lengths[1])){
+                fprintf(stderr, "[ERROR] build_command_data: Provided RANGE bounds are not valid.\n");
+                return -1;
+            }
+            if (!parse_limit(argc, argv, 2, &out_data->in.range_input.limit)){
+                fprintf(stderr, "[ERROR] build_command_data: Invalid RANGE options, expected LIMIT <n>.\n");
+                return -1;
+            }
+
+            out_data->in.range_input.start = (const unsigned char*)argv[0];
+            out_data->in.range_input.start_len = args_lengths[0];
+            out_data->in.range_input.end = (const unsigned char*)argv[1];
+            out_data->in.range_input.end_len = args_lengths[1];
+            break;
+        }
+
+        // PREFIX prefix [LIMIT n]
+        case CMD_TYPE_PREFIX:{
+            if (!is_key_valid((const unsigned char*)argv[0], args_lengths[0])){
+                fprintf(stderr, "[ERROR] build_command_data: Provided prefix is not valid.\n");
+                return -1;
+            }
+            if (!parse_limit(argc, argv, 1, &out_data->in.prefix_input.limit)){
+                fprintf(stderr, "[ERROR] build_command_data: Invalid PREFIX options, expected LIMIT <n>.\n");
+                return -1;
+            }
+
+            out_data->in.prefix_input.prefix = (const unsigned char*)argv[0];
+            out_data->in.prefix_input.prefix_len = args_lengths[0];
+            break;
+        }
+
         case CMD_TYPE_ERROR:
         case CMD_TYPE_EMPTY:
         default:{
@@ -504,11 +1069,14 @@ static int build_command_data(cmd_function_type tag, char* argv[], const size_t
     return 0;
 }
 
-static execute_result_t create_error_response(int status, const char* message) {
+// PUBLIC API
+
+execute_result_t create_error_response(int status, const char* message) {
     unsigned char* body = ustrdup(message);
     if (body == NULL) {
         return (execute_result_t){ 
             .status_code = 500, 
+            .type = REPLY_ERROR,
             .body = NULL, 
             .body_length = 0,
         };
@@ -516,49 +1084,288 @@ static execute_result_t create_error_response(int status, const char* message) {
 
     return (execute_result_t){
         .status_code = status,
+        .type = REPLY_ERROR,
         .body = body, 
         .body_length = ustrlen(body),
     };
 }
 
-// PUBLIC API
-
-execute_result_t execute_command(server_context_t* server_ctx,
-                                 const char* command_name, int argc, char* argv[],
-                                 const size_t args_lengths[])
-{
-    command_registry* reg = server_ctx->reg;
-    hashtable_t* context = server_ctx->db;
-
+const command* command_lookup(command_registry* reg, const char* command_name, int argc, execute_result_t* error){
     if ((reg == NULL) || (command_name == NULL)){
-        return create_error_response(400, "Invalid arguments to dispatcher");
+        *error = create_error_response(400, "Invalid arguments to dispatcher");
+        return NULL;
     }
 
     ssize_t command_index = find_command_index(reg, command_name);
     if (command_index == -1){
-        return create_error_response(404, "Command not found");
+        *error = create_error_response(404, "Command not found");
+        return NULL;
     }
 
     const command* cmd = &(reg->commands[command_index]);
-    if (cmd->arity != argc) {
-        return create_error_response(400, "Incorrect number of arguments");
+    if ((cmd->arity >= 0) ? (argc != cmd->arity) : (argc < -cmd->arity)) {
+        *error = create_error_response(400, "Incorrect number of arguments");
+        return NULL;
     }
 
+    return cmd;
+}
+
+command_result_t command_run(const command* cmd, hashtable_t* db, int argc, char* argv[], const size_t arg_lengths[],
+                             data_entry_t* value){
     command_data_t command_inputs = {0};
-    if (build_command_data(cmd->tag, argv, args_lengths, &command_inputs) != 0){
-        return create_error_response(400, "Invalid argument format");
+    if (build_command_data(cmd->tag, argc, argv, arg_lengths, value, &command_inputs) != 0){
+        return (command_result_t){ .type = CMD_TYPE_INVALID };
+    }
+
+    return cmd->proc(db, &command_inputs);
+}
+
+void command_result_free(command_result_t* result){
+    if (result == NULL){
+        return;
+    }
+
+    switch (result->type){
+        case CMD_TYPE_GET:
+            destroy_value_wrapper(result->output.get_output.value);
+            break;
+        case CMD_TYPE_INFO:
+            free(result->output.info_output.text);
+            break;
+        case CMD_TYPE_SCAN:
+            free(result->output.scan_output.text);
+            break;
+        case CMD_TYPE_RANGE:
+        case CMD_TYPE_PREFIX:
+            free(result->output.range_output.text);
+            break;
+        default:
+            break;
+    }
+
+    result->type = CMD_TYPE_EMPTY;
+}
+
+static void merge_count(command_result_t* merged, command_result_t* results, size_t count){
+    switch (merged->output.count_output.type){
+        // Ratios of each table, weighed alike
+        case CMD_COUNT_OCCUPIED_BUCKET:
+        case CMD_COUNT_REHASH_PROGRESS:{
+            double sum = 0.0;
+            for (size_t i = 0; i < count; i++){
+                sum += results[i].output.count_output.count_t.counter_d;
+            }
+            merged->output.count_output.count_t.counter_d = sum / (double)count;
+            break;
+        }
+
+        // Shared by every table, each one already reports all of it
+        case CMD_COUNT_RETIRED_MEMORY:
+            break;
+
+        default:{
+            size_t sum = 0;
+            for (size_t i = 0; i < count; i++){
+                sum += results[i].output.count_output.count_t.counter_s;
+            }
+            merged->output.count_output.count_t.counter_s = sum;
+            break;
+        }
+    }
+}
+
+// Reads the bulk string at frame, as written by scan_collect, and returns
+// the size of the whole frame.
+static size_t bulk_frame_read(const unsigned char* frame, const unsigned char** data, size_t* data_len){
+    size_t length = 0;
+    size_t i = 1;
+    while (frame[i] != '\r'){
+        length = (length * 10) + (size_t)(frame[i] - '0');
+        i++;
+    }
+
+    *data = frame + i + 2;
+    *data_len = length;
+    return i + 2 + length + 2;
+}
+
+// Each text holds sorted keys and no key is in two of them, so taking the
+// smallest head key each time keeps the order; stops at the limit. Every
+// shard returns the first limit keys of its part of the range, or all of
+// them, so no key past the limit can belong before one taken.
+static command_result_t merge_ranges(command_result_t* results, size_t count){
+    command_result_t merged = results[0];
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++){
+        total += results[i].output.range_output.length;
+    }
+
+    unsigned char* text = malloc(total + 1);
+    size_t* offsets = calloc(count, sizeof(size_t));
+    if ((text == NULL) || (offsets == NULL)){
+        free(text);
+        free(offsets);
+        for (size_t i = 0; i < count; i++){
+            command_result_free(&results[i]);
+        }
+        return (command_result_t){ .type = CMD_TYPE_ERROR };
+    }
+
+    size_t length = 0;
+    size_t keys = 0;
+    while (keys < merged.output.range_output.limit){
+        const unsigned char* best = NULL;
+        size_t best_len = 0;
+        size_t best_frame = 0;
+        size_t best_index = 0;
+
+        for (size_t i = 0; i < count; i++){
+            const struct range_output* out = &results[i].output.range_output;
+            if (offsets[i] >= out->length){
+                continue;
+            }
+
+            const unsigned char* key;
+            size_t key_len;
+            size_t frame_len = bulk_frame_read(out->text + offsets[i], &key, &key_len);
+
+            size_t common = (key_len < best_len) ? key_len : best_len;
+            int order = (best == NULL) ? -1 : memcmp(key, best, common);
+            if ((order < 0) || ((order == 0) && (key_len < best_len))){
+                best = key;
+                best_len = key_len;
+                best_frame = frame_len;
+                best_index = i;
+            }
+        }
+
+        if (best == NULL){
+            break;
+        }
+
+        memcpy(text + length, results[best_index].output.range_output.text + offsets[best_index], best_frame);
+        length += best_frame;
+        offsets[best_index] += best_frame;
+        keys++;
+    }
+
+    free(offsets);
+    for (size_t i = 0; i < count; i++){
+        command_result_free(&results[i]);
+    }
+
+    merged.output.range_output.text = text;
+    merged.output.range_output.length = length;
+    merged.output.range_output.keys = keys;
+    return merged;
+}
+
+command_result_t command_merge(command_result_t* results, size_t count){
+    if ((results == NULL) || (count == 0)){
+        return (command_result_t){ .type = CMD_TYPE_ERROR };
+    }
+
+    // A failure anywhere is the answer, with the first one reported
+    for (size_t i = 0; i < count; i++){
+        bool failed = (results[i].type != results[0].type) || (results[i].type == CMD_TYPE_ERROR) ||
+                      (results[i].type == CMD_TYPE_INVALID) ||
+                      (((results[i].type == CMD_TYPE_RANGE) || (results[i].type == CMD_TYPE_PREFIX)) &&
+                       (results[i].output.range_output.error != 0));
+        if (!failed){
+            continue;
+        }
+
+        command_result_t merged = results[i];
+        if ((merged.type != results[0].type) && (merged.type != CMD_TYPE_INVALID)){
+            merged.type = CMD_TYPE_ERROR;
+        }
+        for (size_t j = 0; j < count; j++){
+            if (j != i){
+                command_result_free(&results[j]);
+            }
+        }
+        return merged;
     }
 
-    command_result_t cmd_result = cmd->proc(context, &command_inputs);
+    command_result_t merged = results[0];
+    switch (merged.type){
+        case CMD_TYPE_COUNT:
+            merge_count(&merged, results, count);
+            break;
 
-    execute_result_t final_result = { .status_code = 200 };
-    switch (cmd_result.type){
+        case CMD_TYPE_LOADFACTOR:{
+            double sum = 0.0;
+            for (size_t i = 0; i < count; i++){
+                sum += results[i].output.load_factor_output.load_factor;
+            }
+            merged.output.load_factor_output.load_factor = sum / (double)count;
+            break;
+        }
+
+        case CMD_TYPE_SET:
+        case CMD_TYPE_ADD:
+        case CMD_TYPE_DEL:
+        case CMD_TYPE_REPLACE:
+        case CMD_TYPE_RESIZE:
+        case CMD_TYPE_CLEAR:{
+            for (size_t i = 0; (i < count) && (merged.output.set_output.error == 0); i++){
+                merged.output.set_output.error = results[i].output.set_output.error;
+            }
+            break;
+        }
+
+        case CMD_TYPE_RANGE:
+        case CMD_TYPE_PREFIX:
+            return merge_ranges(results, count);
+
+        default:{
+            for (size_t i = 1; i < count; i++){
+                command_result_free(&results[i]);
+            }
+            break;
+        }
+    }
+
+    return merged;
+}
+
+// A number written out, sent as a double in RESP3
+static execute_result_t double_reply(int precision, double value){
+    char buffer[64];
+    int len = snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+    if (len < 0 || len >= (int)sizeof(buffer)) {
+        return create_error_response(500, "Failed to format a number");
+    }
+
+    unsigned char* body = (unsigned char*)ustrdup(buffer);
+    if (body == NULL) {
+        return create_error_response(500, TCP_MEMORY_ERROR);
+    }
+
+    return (execute_result_t){ .status_code = 200, .type = REPLY_DOUBLE, .body = body, .body_length = (size_t)len };
+}
+
+execute_result_t command_format(command_result_t result){
+    execute_result_t final_result = { .status_code = 200, .type = REPLY_BULK };
+    switch (result.type){
         case CMD_TYPE_GET:{
-            final_result.body = memdup(cmd_result.output.get_output.value->data, cmd_result.output.get_output.value->size);
-            if (final_result.body == NULL){
-                return create_error_response(500, TCP_MEMORY_ERROR);
+            void* value = result.output.get_output.value;
+
+            if (table_value_is_inline(value)){
+                final_result.body = malloc(VALUE_INLINE_MAX + 1);
+                if (final_result.body == NULL){
+                    return create_error_response(500, TCP_MEMORY_ERROR);
+                }
+                final_result.body_length = table_value_inline_read(value, final_result.body);
+                break;
             }
-            final_result.body_length = cmd_result.output.get_output.value->size;
+
+            // The reference moves to the reply, the data itself is never copied
+            data_entry_t* entry = value;
+            final_result.value = entry;
+            final_result.body_length = entry->size;
             break;
         }
 
@@ -568,80 +1375,118 @@ execute_result_t execute_command(server_context_t* server_ctx,
         case CMD_TYPE_REPLACE:
         case CMD_TYPE_RESIZE:
         case CMD_TYPE_CLEAR:{
-            if (cmd_result.output.set_output.error != 0){
+            if (result.output.set_output.error == CMD_ERROR_MAXMEMORY){
+                return create_error_response(507, TCP_MAXMEMORY_ERROR);
+            }
+            if (result.output.set_output.error != 0){
                 return create_error_response(409, TCP_OPERATION_FAILED);
             } else{
+                final_result.type = REPLY_STATUS;
                 final_result.body = (unsigned char*)ustrdup(TCP_SUCCESS); 
+                if (final_result.body == NULL){
+                    return create_error_response(500, TCP_MEMORY_ERROR);
+                }
                 final_result.body_length = sizeof(TCP_SUCCESS) - 1;
             }
             break;
         }
 
-        case CMD_TYPE_EXIST:{
-            final_result.body = (unsigned char*)ustrdup(cmd_result.output.exist_output.existence ? TCP_TRUE : TCP_FALSE);
-            if (final_result.body == NULL){
-                return create_error_response(500, TCP_MEMORY_ERROR);
-            }
-            final_result.body_length = ustrlen(final_result.body); 
+        case CMD_TYPE_EXIST:
+        case CMD_TYPE_EXPIRE:
+        case CMD_TYPE_PERSIST:{
+            bool applied = (result.type == CMD_TYPE_EXIST) ? result.output.exist_output.existence :
+                           (result.type == CMD_TYPE_EXPIRE) ? result.output.expire_output.applied :
+                                                                  result.output.persist_output.applied;
+
+            final_result.type = REPLY_INTEGER;
+            final_result.integer = applied ? 1 : 0;
             break;
         }
 
-        case CMD_TYPE_COUNT: {
-            char temp_buffer[64];
-            int required_len = 0; 
+        case CMD_TYPE_TTL:{
+            final_result.type = REPLY_INTEGER;
+            final_result.integer = result.output.ttl_output.ttl;
+            break;
+        }
 
-            switch (cmd_result.output.count_output.type) {
-                case CMD_COUNT_OCCUPIED_BUCKET: {
-                    double value = cmd_result.output.count_output.count_t.counter_d;
+        case CMD_TYPE_COUNT: {
+            switch (result.output.count_output.type) {
+                case CMD_COUNT_OCCUPIED_BUCKET:
+                case CMD_COUNT_REHASH_PROGRESS:
+                    return double_reply(2, result.output.count_output.count_t.counter_d);
 
-                    required_len = snprintf(temp_buffer, sizeof(temp_buffer), "%.2f", value);
-                    break;
-                }
                 case CMD_COUNT_CAPACITY:
                 case CMD_COUNT_MEMORY_USAGE:
-                case CMD_COUNT_TOTAL_ELEM: {
-                    size_t value = cmd_result.output.count_output.count_t.counter_s;
-
-                    required_len = snprintf(temp_buffer, sizeof(temp_buffer), "%zu", value);
+                case CMD_COUNT_TOTAL_ELEM:
+                case CMD_COUNT_RETIRED_MEMORY:
+                case CMD_COUNT_USED_MEMORY:
+                case CMD_COUNT_EVICTED_KEYS:
+                case CMD_COUNT_EVICTED_MEMORY:
+                case CMD_COUNT_EXPIRED_KEYS: {
+                    final_result.type = REPLY_INTEGER;
+                    final_result.integer = (int64_t)result.output.count_output.count_t.counter_s;
                     break;
                 }
                 default:
                     return create_error_response(500, "Unknown COUNT result type");
             }
+            break;
+        }
 
-            if (required_len < 0 || required_len >= (int)sizeof(temp_buffer)) {
-                return create_error_response(500, "Failed to format COUNT result");
-            }
+        case CMD_TYPE_INFO: {
+            final_result.body = result.output.info_output.text;
+            final_result.body_length = result.output.info_output.length;
+            break;
+        }
 
-            final_result.body = malloc((size_t)required_len + 1);
-            if (final_result.body == NULL) {
-                return create_error_response(500, TCP_MEMORY_ERROR);
+        case CMD_TYPE_SCAN: {
+            unsigned char* text = result.output.scan_output.text;
+            char cursor_text[24];
+            char head[SCAN_CURSOR_ROOM];
+
+            // The cursor as a bulk string, then the header of the key array
+            int cursor_len = snprintf(cursor_text, sizeof(cursor_text), "%llu",
+                                      (unsigned long long)result.output.scan_output.cursor);
+            int written = snprintf(head, sizeof(head), "$%d\r\n%s\r\n*%zu\r\n", cursor_len, cursor_text,
+                                   result.output.scan_output.keys);
+            if ((cursor_len < 0) || (written < 0) || ((size_t)written >= sizeof(head))) {
+                free(text);
+                return create_error_response(500, "Failed to format SCAN result");
             }
 
-            memcpy(final_result.body, temp_buffer, (size_t)required_len);
-            final_result.body_length = (size_t)required_len;
+            // The head ends where the keys begin, the room before it is dropped
+            size_t offset = SCAN_CURSOR_ROOM - (size_t)written;
+            memcpy(text + offset, head, (size_t)written);
+            memmove(text, text + offset, result.output.scan_output.length - offset);
+
+            final_result.type = REPLY_ARRAY;
+            final_result.count = 2;
+            final_result.body = text;
+            final_result.body_length = result.output.scan_output.length - offset;
             break;
         }
 
-        case CMD_TYPE_LOADFACTOR: {
-            char buffer[64];
-            int len = snprintf(buffer, sizeof(buffer), "%.4f", cmd_result.output.load_factor_output.load_factor);
-
-            if (len < 0 || len >= (int)sizeof(buffer)) {
-                 return create_error_response(500, "Failed to format LOADFACTOR result");
-            }
-
-            final_result.body = (unsigned char*)ustrdup(buffer);
-            if (final_result.body == NULL) {
-                return create_error_response(500, TCP_MEMORY_ERROR);
+        case CMD_TYPE_RANGE:
+        case CMD_TYPE_PREFIX: {
+            if (result.output.range_output.error == CMD_ERROR_NO_INDEX) {
+                return create_error_response(409, TCP_NO_INDEX_ERROR);
             }
-
-            final_result.body_length = (size_t)len;
+            final_result.type = REPLY_ARRAY;
+            final_result.count = result.output.range_output.keys;
+            final_result.body = result.output.range_output.text;
+            final_result.body_length = result.output.range_output.length;
             break;
         }
 
+        case CMD_TYPE_LOADFACTOR:
+            return double_reply(4, result.output.load_factor_output.load_factor);
+
         case CMD_TYPE_EMPTY:
-            return create_error_response(404, TCP_KEY_NOT_FOUND);
+            final_result.type = REPLY_NULL;
+            break;
+
+        case CMD_TYPE_INVALID:
+            return create_error_response(400, TCP_INVALID_ARGUMENT);
 
         case CMD_TYPE_ERROR:
             return create_error_response(500, TCP_INTERNAL_ERROR);
@@ -652,3 +1497,23 @@ execute_result_t execute_command(server_context_t* server_ctx,
 
   return final_result;
 }
+
+execute_result_t execute_command(server_context_t* server_ctx,
+                                 const char* command_name, int argc, char* argv[],
+                                 const size_t args_lengths[], data_entry_t* value)
+{
+    execute_result_t error;
+    const command* cmd = command_lookup(server_ctx->reg, command_name, argc, &error);
+    if (cmd == NULL){
+        destroy_value_wrapper(value);
+        return error;
+    }
+
+    return command_format(command_run(cmd, server_ctx->db, argc, argv, args_lengths, value));
+}
+
+bool command_streams_value(command_registry* reg, const char* command_name){
+    ssize_t command_index = find_command_index(reg, command_name);
+
+    return (command_index != -1) && (strchr(reg->commands[command_index].flags, 'v') != NULL);
+}
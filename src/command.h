@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <strings.h>
 #include <stdio.h>
+#include <stdatomic.h>
 #include "hashtable.h"
 
 // MACRO
@@ -17,19 +18,41 @@
 #define MAX_VALUE_SIZE      2097152
 #define MAX_TOKENS          10
 #define MAX_COUNT_TYPE_SIZE 32      // Consider to update this if you increase the count Instruction Set
+#define INFO_LINE_SIZE      128     // Room for one row of an INFO reply
+
+    // SCAN returns about COUNT keys per call, capped so that no call holds
+    // the loop for long whatever the client asks for.
+
+    #define SCAN_COUNT_DEFAULT    10
+    #define SCAN_COUNT_MAX        1000
+    #define SCAN_CURSOR_ROOM      64      // Reserved in front of the keys for the cursor and the key count
+
+    // RANGE and PREFIX return at most RANGE_LIMIT_MAX keys, LIMIT lowers it;
+    // a longer walk continues with a RANGE from the last key returned.
+
+    #define RANGE_LIMIT_MAX       1000
+    #define CMD_ERROR_NO_INDEX    (-5)
+
+    // Writes evict at most this many keys before running, so none of them
+    // stalls the loop; the server cron takes care of what is left. A write
+    // fails with CMD_ERROR_MAXMEMORY only when nothing can be evicted.
+
+    #define EVICTION_KEYS_PER_WRITE   8
+    #define CMD_ERROR_MAXMEMORY       (-4)
 
 
     // TCP POSSIBILE RESPONSE
 
     #define TCP_SUCCESS           "OK"
     #define TCP_OPERATION_FAILED  "Operation failed"
-    #define TCP_KEY_NOT_FOUND     "Key not found"
     #define TCP_INTERNAL_ERROR    "Internal server error"
     #define TCP_NON_DEFAULT_T     "Internal error: unhandled result type"
     #define TCP_COUNT_ERROR       "Internal error: Unknown COUNT result type"
     #define TCP_MEMORY_ERROR      "Out of memory"
-    #define TCP_TRUE              "1"
-    #define TCP_FALSE             "0"
+    #define TCP_MAXMEMORY_ERROR   "Out of memory: maxmemory reached"
+    #define TCP_NO_INDEX_ERROR    "Ordered index disabled: start with --ordered-index on"
+    #define TCP_INVALID_ARGUMENT  "Invalid argument format"
+    #define TCP_BUSY_ERROR        "Server busy"
 
 
 
@@ -46,6 +69,14 @@ typedef enum : uint8_t{
     CMD_TYPE_CLEAR,
     CMD_TYPE_LOADFACTOR,
     CMD_TYPE_COUNT,
+    CMD_TYPE_INFO,
+    CMD_TYPE_EXPIRE,
+    CMD_TYPE_TTL,
+    CMD_TYPE_PERSIST,
+    CMD_TYPE_SCAN,
+    CMD_TYPE_RANGE,
+    CMD_TYPE_PREFIX,
+    CMD_TYPE_INVALID,
     CMD_TYPE_ERROR,
     CMD_TYPE_EMPTY
 } cmd_function_type;
@@ -54,10 +85,21 @@ typedef enum : uint8_t{
     CMD_COUNT_CAPACITY,
     CMD_COUNT_MEMORY_USAGE,
     CMD_COUNT_TOTAL_ELEM,
-    CMD_COUNT_OCCUPIED_BUCKET
+    CMD_COUNT_OCCUPIED_BUCKET,
+    CMD_COUNT_REHASH_PROGRESS,
+    CMD_COUNT_RETIRED_MEMORY,
+    CMD_COUNT_USED_MEMORY,
+    CMD_COUNT_EVICTED_KEYS,
+    CMD_COUNT_EVICTED_MEMORY,
+    CMD_COUNT_EXPIRED_KEYS
 } cmd_count_t;
 
+typedef enum : uint8_t{
+    CMD_INFO_SLAB
+} cmd_info_t;
+
 typedef struct data_entry_t{   // DB stored structure
+    _Atomic(uint32_t) refcount;    // The table and every reply still sending it
     size_t size;
     unsigned char data[];
 } data_entry_t;
@@ -68,29 +110,36 @@ typedef struct command_data_t{ // Command necessary input
     union in{
         struct get_input{
             const unsigned char* key;
+            size_t key_len;
         }get_input;
 
         struct set_input{
             const unsigned char* key;
-            data_entry_t* value;
+            size_t key_len;
+            void* value;            // data_entry_t* or an inline value
+            uint32_t ttl;           // SET ... EX seconds, 0 for none
         }set_input;        
 
         struct add_input{
             const unsigned char* key;
-            data_entry_t* value;
+            size_t key_len;
+            void* value;            // data_entry_t* or an inline value
         }add_input;       
 
         struct del_input{
             const unsigned char* key;
+            size_t key_len;
         }del_input;    
 
         struct exist_input{
             const unsigned char* key;
+            size_t key_len;
         }exist_input;
 
         struct replace_input{
             const unsigned char* key;
-            data_entry_t* new_value;
+            size_t key_len;
+            void* new_value;        // data_entry_t* or an inline value
         }replace_input;
 
         struct resize_input{
@@ -108,6 +157,47 @@ typedef struct command_data_t{ // Command necessary input
         struct count_input{
             cmd_count_t type;
         }count_input;
+
+        struct info_input{
+            cmd_info_t type;
+        }info_input;
+
+        struct expire_input{
+            const unsigned char* key;
+            size_t key_len;
+            uint32_t ttl;
+        }expire_input;
+
+        struct ttl_input{
+            const unsigned char* key;
+            size_t key_len;
+        }ttl_input;
+
+        struct persist_input{
+            const unsigned char* key;
+            size_t key_len;
+        }persist_input;
+
+        struct scan_input{
+            uint64_t cursor;
+            const unsigned char* pattern;   // NULL to return every key
+            size_t pattern_len;
+            size_t count;
+        }scan_input;
+
+        struct range_input{
+            const unsigned char* start;
+            size_t start_len;
+            const unsigned char* end;
+            size_t end_len;
+            size_t limit;
+        }range_input;
+
+        struct prefix_input{
+            const unsigned char* prefix;
+            size_t prefix_len;
+            size_t limit;
+        }prefix_input;
     }in;
 }command_data_t;
 
@@ -116,7 +206,7 @@ typedef struct command_result_t{
     cmd_function_type type;
     union out{
         struct get_output{
-            data_entry_t* value; 
+            void* value;            // Referenced data_entry_t, or an inline value
         }get_output;
 
         struct set_output{
@@ -158,6 +248,38 @@ typedef struct command_result_t{
                 size_t counter_s;
             }count_t;
         }count_output;
+
+        struct info_output{
+            unsigned char* text;    // Owned, one line per row
+            size_t length;
+        }info_output;
+
+        struct expire_output{
+            bool applied;           // false when the key does not exist
+        }expire_output;
+
+        struct ttl_output{
+            int64_t ttl;            // Seconds left, -1 without expiry, -2 for a missing key
+        }ttl_output;
+
+        struct persist_output{
+            bool applied;           // false when the key is missing or has no TTL
+        }persist_output;
+
+        struct scan_output{
+            unsigned char* text;    // Owned, SCAN_CURSOR_ROOM bytes then a bulk string per key
+            size_t length;
+            size_t keys;
+            uint64_t cursor;        // Written in the room when the reply is formatted
+        }scan_output;
+
+        struct range_output{
+            int error;
+            unsigned char* text;    // Owned, a bulk string per key in order
+            size_t length;
+            size_t keys;
+            size_t limit;           // Most keys the reply may hold
+        }range_output;
     }output;
 } command_result_t;
 
@@ -167,14 +289,38 @@ typedef struct command{
     const char* name;
     cmd_function_type tag;
     command_proc proc;
-    int arity;
-    const char* flags;
+    int arity;                      // Negative for at least -arity arguments
+    const char* flags;              // r reads, w writes, a replies with a value reference,
+                                    // k takes its key first, b runs on every shard,
+                                    // v takes a value after the key, which may come built
+
 } command;
 
+    // Replies are typed and encoded as RESP frames only when sent, in the
+    // protocol version of their connection. Arrays and maps come with their
+    // elements encoded already, these are the same in RESP2 and RESP3.
+
+typedef enum : uint8_t{
+    REPLY_STATUS,                   // Simple string in body
+    REPLY_ERROR,                    // Message in body, status_code picks the error code
+    REPLY_INTEGER,
+    REPLY_DOUBLE,                   // Number written in body, a bulk string in RESP2
+    REPLY_BULK,                     // body, or the data of value
+    REPLY_NULL,
+    REPLY_ARRAY,                    // body holds count encoded elements
+    REPLY_MAP                       // body holds count encoded pairs, an array in RESP2
+} reply_type_t;
+
 typedef struct execute_result_t{
     int status_code;
+    reply_type_t type;
+    int64_t integer;
+    size_t count;
 
+    // The reply is body, or the data of value when it is set; value is a
+    // reference sent without copying and dropped once the write completes.
     unsigned char* body;
+    data_entry_t* value;
     size_t body_length;
 } execute_result_t;
 
@@ -182,17 +328,38 @@ typedef struct command_registry command_registry;
 
 // DATABASE CONTEXT
 
+struct shard_pool_t;
+
 typedef struct server_context_t{
     command_registry* reg;
-    hashtable_t* db;
+    hashtable_t* db;                // NULL in sharded mode
+    struct shard_pool_t* shards;    // NULL unless sharded
 } server_context_t;
 
 // PUBLIC API
 
     // EXECUTOR
+    // value, when set, is the value argument built already by the parser
+    // and is taken whatever the outcome; argv still points at its data.
     execute_result_t execute_command(server_context_t* server_ctx,
                                      const char* command_name, int argc, char* argv[],
-                                     const size_t arg_lengths[]);
+                                     const size_t arg_lengths[], data_entry_t* value);
+    bool command_streams_value(command_registry* reg, const char* command_name);
+
+    // The executor in steps, for callers that run a command away from
+    // where it was parsed. command_lookup checks the name and the argument
+    // count, filling error when it returns NULL. command_run executes
+    // against one table; command_merge folds the results of a command run
+    // on several tables into one, releasing the others; command_format
+    // builds the reply and takes what the result owns, which
+    // command_result_free releases instead when no reply is sent.
+    const command* command_lookup(command_registry* reg, const char* command_name, int argc, execute_result_t* error);
+    command_result_t command_run(const command* cmd, hashtable_t* db, int argc, char* argv[], const size_t arg_lengths[],
+                                 data_entry_t* value);
+    command_result_t command_merge(command_result_t* results, size_t count);
+    execute_result_t command_format(command_result_t result);
+    void command_result_free(command_result_t* result);
+    execute_result_t create_error_response(int status, const char* message);
 
 
 
@@ -200,8 +367,9 @@ typedef struct server_context_t{
     int registry_destroy(command_registry** reg);
     void free_execute_result(execute_result_t* result);
     size_t std_value_sizer(const void* value);
+    void* std_value_acquire(void* value);
+    data_entry_t* value_create(size_t size);
     void destroy_value_wrapper(void* data);
-    size_t std_value_sizer(const void* value);
 
 
 #endif
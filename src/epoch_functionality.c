@@ -0,0 +1,261 @@
+// Header
+#include "epoch_functionality.h"
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+// Data
+
+// One per thread that ever entered an epoch. state is (epoch << 1) | 1 while
+// the owner is inside a critical section and 0 otherwise; records are never
+// freed, a thread that exits hands its record to the next one.
+typedef struct __attribute__((aligned(64))) epoch_record_t{
+    _Atomic(uint64_t) state;
+    _Atomic(bool) in_use;
+    struct epoch_record_t* next;
+} epoch_record_t;
+
+typedef struct epoch_retired_t{
+    void* ptr;
+    epoch_destroyer_t destroyer;
+    size_t bytes;
+    uint64_t epoch;
+    struct epoch_retired_t* next;
+} epoch_retired_t;
+
+static _Atomic(uint64_t) global_epoch = 2;
+static _Atomic(epoch_record_t*) records = NULL;
+
+// Newest first, so retire epochs never increase along the list
+static pthread_mutex_t retired_mutex = PTHREAD_MUTEX_INITIALIZER;
+static epoch_retired_t* retired_head = NULL;
+static size_t retired_since_collect = 0;
+
+static _Atomic(size_t) pending_bytes = 0;
+static _Atomic(size_t) pending_count = 0;
+
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static bool record_key_ready = false;
+
+static _Thread_local epoch_record_t* thread_record = NULL;
+static _Thread_local unsigned int thread_nesting = 0;
+
+// Private API
+
+static void epoch_record_release(void* arg){
+    epoch_record_t* record = arg;
+
+    atomic_store_explicit(&record->state, 0, memory_order_release);
+    atomic_store_explicit(&record->in_use, false, memory_order_release);
+}
+
+static void epoch_key_create(void){
+    record_key_ready = (pthread_key_create(&record_key, epoch_record_release) == 0);
+}
+
+static epoch_record_t* epoch_record_acquire(void){
+    for (epoch_record_t* record = atomic_load_explicit(&records, memory_order_acquire); record != NULL; record = record->next){
+        bool expected = false;
+        if (!atomic_load_explicit(&record->in_use, memory_order_relaxed) &&
+            atomic_compare_exchange_strong(&record->in_use, &expected, true)){
+            return record;
+        }
+    }
+
+    epoch_record_t* record = aligned_alloc(alignof(epoch_record_t), sizeof(epoch_record_t));
+    if (record == NULL){
+        return NULL;
+    }
+
+    atomic_init(&record->state, 0);
+    atomic_init(&record->in_use, true);
+
+    epoch_record_t* head = atomic_load_explicit(&records, memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&records, &head, record, memory_order_release, memory_order_relaxed));
+
+    return record;
+}
+
+// The epoch only moves forward once every active reader has observed the current one.
+static uint64_t epoch_try_advance(void){
+    uint64_t epoch = atomic_load_explicit(&global_epoch, memory_order_acquire);
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    for (epoch_record_t* record = atomic_load_explicit(&records, memory_order_acquire); record != NULL; record = record->next){
+        uint64_t state = atomic_load_explicit(&record->state, memory_order_acquire);
+        if (((state & 1u) != 0) && ((state >> 1) != epoch)){
+            return epoch;
+        }
+    }
+
+    if (atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1)){
+        return epoch + 1;
+    }
+
+    return epoch;
+}
+
+static size_t epoch_free_list(epoch_retired_t* node){
+    size_t freed = 0;
+
+    while (node != NULL){
+        epoch_retired_t* next = node->next;
+
+        if (node->destroyer != NULL){
+            node->destroyer(node->ptr);
+        } else{
+            free(node->ptr);
+        }
+
+        atomic_fetch_sub_explicit(&pending_bytes, node->bytes, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&pending_count, 1, memory_order_relaxed);
+
+        free(node);
+        node = next;
+        freed++;
+    }
+
+    return freed;
+}
+
+// Public API
+
+int epoch_enter(void){
+    if (thread_record == NULL){
+        pthread_once(&record_key_once, epoch_key_create);
+
+        epoch_record_t* record = epoch_record_acquire();
+        if (record == NULL){
+            fprintf(stderr, "[ERROR] epoch_enter: Failed to allocate the thread record.\n");
+            return -1;
+        }
+
+        if (record_key_ready){
+            pthread_setspecific(record_key, record);
+        }
+        thread_record = record;
+    }
+
+    if (thread_nesting++ > 0){
+        return 0;
+    }
+
+    // Publish, then make sure the epoch did not move before the publication was visible
+    uint64_t epoch = atomic_load_explicit(&global_epoch, memory_order_relaxed);
+    while (true){
+        atomic_store_explicit(&thread_record->state, (epoch << 1) | 1u, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        uint64_t current = atomic_load_explicit(&global_epoch, memory_order_relaxed);
+        if (current == epoch){
+            return 0;
+        }
+        epoch = current;
+    }
+}
+
+void epoch_exit(void){
+    if ((thread_record == NULL) || (thread_nesting == 0)){
+        return;
+    }
+
+    if (--thread_nesting == 0){
+        atomic_store_explicit(&thread_record->state, 0, memory_order_release);
+    }
+}
+
+void epoch_retire(void* ptr, epoch_destroyer_t destroyer, size_t bytes){
+    if (ptr == NULL){
+        return;
+    }
+
+    epoch_retired_t* node = malloc(sizeof(epoch_retired_t));
+    if (node == NULL){
+        // Nothing to queue it on, wait for the readers instead
+        epoch_synchronize();
+        if (destroyer != NULL){
+            destroyer(ptr);
+        } else{
+            free(ptr);
+        }
+        return;
+    }
+
+    node->ptr = ptr;
+    node->destroyer = destroyer;
+    node->bytes = bytes;
+
+    atomic_fetch_add_explicit(&pending_bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pending_count, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&retired_mutex);
+
+    node->epoch = atomic_load_explicit(&global_epoch, memory_order_acquire);
+    node->next = retired_head;
+    retired_head = node;
+
+    bool collect = (++retired_since_collect >= EPOCH_COLLECT_THRESHOLD);
+
+    pthread_mutex_unlock(&retired_mutex);
+
+    if (collect){
+        epoch_collect();
+    }
+}
+
+size_t epoch_collect(void){
+    uint64_t safe_epoch = epoch_try_advance() - 2;
+
+    pthread_mutex_lock(&retired_mutex);
+
+    retired_since_collect = 0;
+
+    epoch_retired_t** link = &retired_head;
+    while ((*link != NULL) && ((*link)->epoch > safe_epoch)){
+        link = &(*link)->next;
+    }
+
+    epoch_retired_t* expired = *link;
+    *link = NULL;
+
+    pthread_mutex_unlock(&retired_mutex);
+
+    return epoch_free_list(expired);
+}
+
+void epoch_synchronize(void){
+    uint64_t target = atomic_load_explicit(&global_epoch, memory_order_acquire) + 2;
+
+    while (epoch_try_advance() < target){
+        sched_yield();
+    }
+}
+
+void epoch_drain(void){
+    pthread_mutex_lock(&retired_mutex);
+
+    epoch_retired_t* all = retired_head;
+    retired_head = NULL;
+    retired_since_collect = 0;
+
+    pthread_mutex_unlock(&retired_mutex);
+
+    epoch_free_list(all);
+}
+
+  // Monitoring
+
+size_t epoch_pending_bytes(void){
+    return atomic_load_explicit(&pending_bytes, memory_order_relaxed);
+}
+
+size_t epoch_pending_count(void){
+    return atomic_load_explicit(&pending_count, memory_order_relaxed);
+}
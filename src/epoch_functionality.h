@@ -0,0 +1,50 @@
+#ifndef EPOCH_FUNCTIONALITY_H
+#define EPOCH_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Macro and Defines
+
+    // Epoch based reclamation: readers announce the global epoch while they
+    // hold pointers into shared structures, writers unlink memory and retire
+    // it instead of freeing it. Memory retired in epoch E is freed once the
+    // global epoch reaches E + 2, when no reader can still be inside E.
+
+    #define EPOCH_COLLECT_THRESHOLD  64     // Retirements between automatic collections
+
+// Data
+
+typedef void (*epoch_destroyer_t)(void*);
+
+// Public API
+
+    // Reader side, nestable. Pointers read in between stay valid until the
+    // matching epoch_exit. Returns -1, and must not be paired with an exit,
+    // when the thread record cannot be allocated.
+    int epoch_enter(void);
+    void epoch_exit(void);
+
+    // Writer side. The memory must already be unreachable for new readers.
+    void epoch_retire(void* ptr, epoch_destroyer_t destroyer, size_t bytes);
+
+    // Tries to advance the epoch and frees what no reader can see anymore.
+    // Returns the number of objects freed.
+    size_t epoch_collect(void);
+
+    // Waits for every reader active now to leave; must not be called from
+    // inside an epoch.
+    void epoch_synchronize(void);
+
+    // Frees everything still pending. Only valid once no reader can exist.
+    void epoch_drain(void);
+
+    // Monitoring
+    size_t epoch_pending_bytes(void);
+    size_t epoch_pending_count(void);
+
+
+#endif
@@ -1,16 +1,122 @@
 // Header
 #include "hashing_functionality.h"
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
 
-// Hashing functionality
+// Data
 
-unsigned long hash(const unsigned char *str) {
-    unsigned long hash = 5381;
-    unsigned long c;
-    
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c; 
+static const uint64_t hash_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static uint64_t hash_seed = 0;
+static pthread_once_t hash_seed_once = PTHREAD_ONCE_INIT;
+
+// Private API
+
+// 64x64 -> 128 bit multiply, low half in a and high half in b
+static inline void hash_mum(uint64_t* a, uint64_t* b){
+    __uint128_t product = (__uint128_t)*a * *b;
+    *a = (uint64_t)product;
+    *b = (uint64_t)(product >> 64);
+}
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b){
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t hash_read64(const uint8_t* p){
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hash_read32(const uint8_t* p){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// First, middle and last byte, enough to tell apart every key of 1 to 3 bytes
+static inline uint64_t hash_read_small(const uint8_t* p, size_t len){
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+static void hash_seed_create(void){
+    uint64_t seed = 0;
+
+    if (getrandom(&seed, sizeof(seed), 0) != (ssize_t)sizeof(seed)){
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        seed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ (uint64_t)(uintptr_t)&now;
+
+        fprintf(stderr, "[ERROR] hash_init: getrandom failed, seeding from the clock.\n");
     }
 
-    return hash;
+    hash_seed = seed ^ hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+}
+
+// Public API
+
+void hash_init(void){
+    pthread_once(&hash_seed_once, hash_seed_create);
 }
 
+uint64_t hash(const void* data, size_t len){
+    const uint8_t* p = data;
+    uint64_t seed = hash_seed;
+    uint64_t a;
+    uint64_t b;
+
+    if (len <= 16){
+        if (len >= 4){
+            size_t shift = (len >> 3) << 2;
+            a = (hash_read32(p) << 32) | hash_read32(p + shift);
+            b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - shift);
+        } else if (len > 0){
+            a = hash_read_small(p, len);
+            b = 0;
+        } else{
+            a = 0;
+            b = 0;
+        }
+    } else{
+        size_t remaining = len;
+
+        // Three independent lanes keep the multipliers busy on long keys
+        if (remaining > 48){
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+
+            do {
+                seed = hash_mix(hash_read64(p) ^ hash_secret[1], hash_read64(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read64(p + 16) ^ hash_secret[2], hash_read64(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read64(p + 32) ^ hash_secret[3], hash_read64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (remaining > 16){
+            seed = hash_mix(hash_read64(p) ^ hash_secret[1], hash_read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        // The last 16 bytes, overlapping what was already mixed when shorter
+        a = hash_read64(p + remaining - 16);
+        b = hash_read64(p + remaining - 8);
+    }
+
+    a ^= hash_secret[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+
+    return hash_mix(a ^ hash_secret[0] ^ (uint64_t)len, b ^ hash_secret[1]);
+}
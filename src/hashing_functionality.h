@@ -3,9 +3,19 @@
 #ifndef HASHING_FUNCTIONALITY_H
 #define HASHING_FUNCTIONALITY_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 // Public API (function prototypes)
 
-    unsigned long hash(const unsigned char* str);
+    // Seeds hash() from the kernel's random source once per process; later
+    // calls do nothing. Must run before the first key is hashed.
+    void hash_init(void);
+
+    // wyhash-style 64-bit hash of len bytes, 16 bytes per multiply on long
+    // keys, mixed with the per-process seed so bucket positions cannot be
+    // predicted from outside.
+    uint64_t hash(const void* data, size_t len);
 
 
 #endif
@@ -4,19 +4,737 @@
 #include "hashing_functionality.h"
 #include "string_functionality.h"
 #include "bitwise_functionality.h"
+#include "lock_functionality.h"
+#include "epoch_functionality.h"
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdatomic.h>
+#include <stdalign.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Private API
+
+static hashtable_bucket_t* bucket_overflow_create(void){
+    hashtable_bucket_t* bucket = aligned_alloc(alignof(hashtable_bucket_t), sizeof(hashtable_bucket_t));
+    if (bucket == NULL){
+        return NULL;
+    }
+
+    memset(bucket, 0, sizeof(hashtable_bucket_t));
+    return bucket;
+}
+
+static inline size_t bucket_array_bytes(size_t count){
+    return sizeof(bucket_array_t) + (count * sizeof(hashtable_bucket_t));
+}
+
+static bucket_array_t* bucket_array_create(size_t count){
+    if (count > ((SIZE_MAX - sizeof(bucket_array_t)) / sizeof(hashtable_bucket_t))){
+        return NULL;
+    }
+
+    bucket_array_t* array = aligned_alloc(alignof(bucket_array_t), bucket_array_bytes(count));
+    if (array == NULL){
+        return NULL;
+    }
+
+    memset(array, 0, bucket_array_bytes(count));
+    array->count = count;
+    return array;
+}
+
+// Holders of a stripe see both arrays stable; optimistic readers pair these
+// acquires with the release stores that published them.
+static inline bucket_array_t* table_array(const hashtable_t* table){
+    return atomic_load_explicit(&table->array, memory_order_acquire);
+}
+
+static inline bucket_array_t* table_rehash_array(const hashtable_t* table){
+    return atomic_load_explicit(&table->rehash_array, memory_order_acquire);
+}
+
+// Hands memory unlinked from the table to the epoch, or frees it at once
+// when a single owner rules out readers that could still reach it.
+static void table_retire(const hashtable_t* table, void* ptr, epoch_destroyer_t destroyer, size_t bytes){
+    if (!table->single_owner){
+        epoch_retire(ptr, destroyer, bytes);
+    } else if (destroyer != NULL){
+        destroyer(ptr);
+    } else{
+        free(ptr);
+    }
+}
+
+// Unlinks the overflow chain of home. When readers may still be walking it the
+// buckets are retired rather than freed.
+static size_t bucket_chain_destroy(const hashtable_t* table, hashtable_bucket_t* home, bool deferred){
+    size_t freed = 0;
+
+    hashtable_bucket_t* current = home->next;
+    home->next = NULL;
+
+    while (current != NULL){
+        hashtable_bucket_t* next = current->next;
+        if (deferred){
+            table_retire(table, current, NULL, sizeof(hashtable_bucket_t));
+        } else{
+            free(current);
+        }
+        current = next;
+        freed++;
+    }
+
+    return freed;
+}
+
+static inline uint8_t hash_tag(uint64_t hash){
+    return (uint8_t)(CTRL_FULL | (hash >> 57));
+}
+
+// Returns a bitmask with bit i set for every slot whose control byte equals ctrl_byte.
+static inline uint32_t bucket_match(const hashtable_bucket_t* bucket, uint8_t ctrl_byte){
+    #if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)bucket->ctrl);
+    __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)ctrl_byte));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+    #else
+    uint32_t mask = 0;
+    for (int i = 0; i < BUCKET_CAPACITY; i++){
+        mask |= (uint32_t)(bucket->ctrl[i] == ctrl_byte) << i;
+    }
+    #endif
+
+    return mask & ((1u << BUCKET_CAPACITY) - 1u);
+}
+
+static inline const unsigned char* key_data(const hashtable_key_t* key){
+    return (key->length > KEY_INLINE_LEN) ? key->heap_data : key->inline_data;
+}
+
+static int key_store(hashtable_key_t* out, const unsigned char* key, size_t key_len){
+    out->length = (uint8_t)key_len;
+    out->expire_at = 0;
+
+    if (key_len <= KEY_INLINE_LEN){
+        memcpy(out->inline_data, key, key_len);
+        return 0;
+    }
+
+    out->heap_data = memdup(key, key_len);
+    return (out->heap_data != NULL) ? 0 : -1;
+}
+
+static void key_release(hashtable_key_t* key){
+    if (key->length > KEY_INLINE_LEN){
+        free(key->heap_data);
+    }
+
+    key->length = 0;
+}
+
+static void key_retire(const hashtable_t* table, hashtable_key_t* key){
+    if (key->length > KEY_INLINE_LEN){
+        table_retire(table, key->heap_data, NULL, key->length);
+    }
+
+    key->length = 0;
+}
+
+// Called once the value can no longer be reached from its slot. Without a
+// destroyer the caller still owns the value and nothing is retired.
+static void table_retire_value(hashtable_t* table, void* value, void (*value_destroyer)(void*)){
+    if ((value == NULL) || (value_destroyer == NULL) || table_value_is_inline(value)){
+        return;
+    }
+
+    size_t bytes = (table->value_sizer != NULL) ? table->value_sizer(value) : 0;
+    table_retire(table, value, value_destroyer, bytes);
+}
+
+// Bytes a slot accounts for besides the bucket itself
+static inline size_t table_value_bytes(const hashtable_t* table, const void* value){
+    if ((value == NULL) || (table->value_sizer == NULL) || table_value_is_inline(value)){
+        return 0;
+    }
+
+    return table->value_sizer(value);
+}
+
+static inline size_t table_key_bytes(size_t key_len){
+    return (key_len > KEY_INLINE_LEN) ? key_len : 0;
+}
+
+// splitmix64 over a per-thread state, seeded through the keyed hash so
+// threads and processes never share a sequence.
+static uint64_t table_random(void){
+    static _Thread_local uint64_t state = 0;
+    static _Thread_local bool seeded = false;
+
+    if (!seeded){
+        uintptr_t address = (uintptr_t)&state;
+        state = hash(&address, sizeof(address));
+        seeded = true;
+    }
+
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint32_t lfu_minutes(uint64_t now_ms){
+    return (uint32_t)((now_ms / 60000u) & 0xFFFFFFu);
+}
+
+// The counter loses one per LFU_DECAY_MINUTES since the word was last written
+static uint32_t lfu_decayed_counter(uint32_t word, uint64_t now_ms){
+    uint32_t elapsed = (lfu_minutes(now_ms) - (word >> 8)) & 0xFFFFFFu;
+    uint32_t decay = elapsed / LFU_DECAY_MINUTES;
+    uint32_t counter = word & 0xFFu;
+
+    return (decay >= counter) ? 0 : counter - decay;
+}
+
+static uint32_t access_word_new(hashtable_t* table){
+    uint64_t now = atomic_load_explicit(&table->clock, memory_order_relaxed);
+
+    if (table->eviction.mode == EVICTION_LFU){
+        return (lfu_minutes(now) << 8) | LFU_INIT_COUNTER;
+    }
+
+    return (uint32_t)now;
+}
+
+// Records an access to a slot. Skips the store when the word would not
+// change, so hot keys read from many threads do not bounce their line.
+static void slot_touch(hashtable_t* table, hashtable_bucket_t* bucket, int i){
+    eviction_mode_t mode = table->eviction.mode;
+    if ((mode != EVICTION_LRU) && (mode != EVICTION_LFU)){
+        return;
+    }
+
+    uint64_t now = atomic_load_explicit(&table->clock, memory_order_relaxed);
+    uint32_t word = atomic_load_explicit(&bucket->access[i], memory_order_relaxed);
+    uint32_t updated = (uint32_t)now;
+
+    if (mode == EVICTION_LFU){
+        uint32_t counter = lfu_decayed_counter(word, now);
+
+        if (counter < 255){
+            uint32_t base = (counter > LFU_INIT_COUNTER) ? counter - LFU_INIT_COUNTER : 0;
+            double chance = 1.0 / ((double)base * LFU_LOG_FACTOR + 1.0);
+            if ((double)(table_random() >> 11) * 0x1.0p-53 < chance){
+                counter++;
+            }
+        }
+
+        updated = (lfu_minutes(now) << 8) | counter;
+    }
+
+    if (updated != word){
+        atomic_store_explicit(&bucket->access[i], updated, memory_order_relaxed);
+    }
+}
+
+static inline void slot_fill(hashtable_bucket_t* bucket, int i, uint64_t hash, const hashtable_key_t* key, void* value,
+                             uint32_t access){
+    bucket->ctrl[i] = hash_tag(hash);
+    bucket->hashes[i] = hash;
+    bucket->values[i] = value;
+    bucket->keys[i] = *key;
+    atomic_store_explicit(&bucket->access[i], access, memory_order_relaxed);
+}
+
+// Empties a slot under its write lock and returns the bytes it accounted for.
+static size_t slot_remove(hashtable_t* table, hashtable_bucket_t* bucket, int i, void (*value_destroyer)(void*)){
+    void* old_value = bucket->values[i];
+    size_t bytes = table_value_bytes(table, old_value) + table_key_bytes(bucket->keys[i].length);
+
+    if (table->ordered_index != NULL){
+        skiplist_remove(table->ordered_index, key_data(&bucket->keys[i]), bucket->keys[i].length);
+    }
+
+    bucket->ctrl[i] = CTRL_EMPTY;
+    key_retire(table, &bucket->keys[i]);
+    bucket->values[i] = NULL;
+
+    table_retire_value(table, old_value, value_destroyer);
+    bucket->hashes[i] = 0;
+
+    atomic_fetch_sub_explicit(&table->elem_count, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&table->data_bytes, bytes, memory_order_relaxed);
+
+    return bytes;
+}
+
+static inline uint32_t table_now_seconds(hashtable_t* table){
+    return (uint32_t)(atomic_load_explicit(&table->clock, memory_order_relaxed) / 1000u);
+}
+
+static inline bool slot_expired(const hashtable_bucket_t* bucket, int i, uint32_t now){
+    uint32_t expire_at = bucket->keys[i].expire_at;
+    return (expire_at != 0) && (expire_at <= now);
+}
+
+// Under the slot's write lock, which also keeps its index node alive
+static void slot_set_expiry(hashtable_t* table, hashtable_bucket_t* bucket, int i, uint32_t expire_at){
+    if ((table->ordered_index != NULL) && (bucket->keys[i].expire_at != expire_at)){
+        skiplist_set_expiry(table->ordered_index, key_data(&bucket->keys[i]), bucket->keys[i].length, expire_at);
+    }
+
+    bucket->keys[i].expire_at = expire_at;
+}
+
+// Writers that find an expired key drop it before going on as if it was missing
+static void slot_expire(hashtable_t* table, hashtable_bucket_t* bucket, int i){
+    slot_remove(table, bucket, i, table->value_destroyer);
+    atomic_fetch_add_explicit(&table->expired_keys, 1, memory_order_relaxed);
+}
+
+// A failed wheel insert only leaves the key to be removed when accessed
+static void table_schedule_expiry(hashtable_t* table, uint64_t hash, uint32_t expire_at, uint32_t now){
+    if (wheel_add(&table->expiry_wheel, hash, expire_at, now) != 0){
+        fprintf(stderr, "[ERROR] table_schedule_expiry: Failed to allocate a wheel chunk.\n");
+    }
+}
+
+static int bucket_chain_find(hashtable_bucket_t* home, uint64_t hash, const unsigned char* key, size_t key_len,
+                             hashtable_bucket_t** out_bucket){
+    uint8_t tag = hash_tag(hash);
+
+    for (hashtable_bucket_t* bucket = home; bucket != NULL; bucket = bucket->next){
+        uint32_t candidates = bucket_match(bucket, tag);
+
+        while (candidates != 0){
+            int i = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+
+            if (bucket->hashes[i] == hash &&
+                bucket->keys[i].length == key_len &&
+                memcmp(key_data(&bucket->keys[i]), key, key_len) == 0){
+
+                *out_bucket = bucket;
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// Places a key known to be absent in the first empty slot of the chain, growing it if needed.
+// The key handle is moved into the slot, so its out-of-line storage changes owner.
+static int bucket_chain_insert(hashtable_bucket_t* home, uint64_t hash, const hashtable_key_t* key, void* value,
+                               uint32_t access, _Atomic(size_t)* overflow_count){
+    hashtable_bucket_t* last = home;
+    for (hashtable_bucket_t* bucket = home; bucket != NULL; bucket = bucket->next){
+        uint32_t empty = bucket_match(bucket, CTRL_EMPTY);
+        if (empty != 0){
+            slot_fill(bucket, __builtin_ctz(empty), hash, key, value, access);
+            return 0;
+        }
+        last = bucket;
+    }
+
+    hashtable_bucket_t* overflow = bucket_overflow_create();
+    if (overflow == NULL){
+        return -1;
+    }
+
+    slot_fill(overflow, 0, hash, key, value, access);
+
+    last->next = overflow;
+    atomic_fetch_add_explicit(overflow_count, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+
+static inline size_t bucket_index_for(uint64_t hash, size_t buckets_count){
+    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
+    return hash & (buckets_count - 1);
+    #else
+    return hash % buckets_count;
+    #endif
+}
+
+static inline hashtable_bucket_t* bucket_array_home(bucket_array_t* array, uint64_t hash){
+    return &array->buckets[bucket_index_for(hash, array->count)];
+}
+
+// Every key that can share a bucket in either array must map to the same lock,
+// so the stripe mask never has more bits than the smallest live bucket array.
+static size_t stripe_mask_for(const hashtable_t* table){
+    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
+    size_t stripes = table->lock_count;
+    bucket_array_t* array = table_array(table);
+    bucket_array_t* rehash_array = table_rehash_array(table);
+    if (array->count < stripes){
+        stripes = array->count;
+    }
+    if ((rehash_array != NULL) && (rehash_array->count < stripes)){
+        stripes = rehash_array->count;
+    }
+
+    return stripes - 1;
+    #else
+    (void)table;
+    return 0;
+    #endif
+}
+
+// A writer makes the sequence odd once it owns the stripe and even again just
+// before releasing it; the fence keeps its bucket stores after the first bump.
+static inline void stripe_write_begin(table_lock_t* stripe_lock){
+    uint32_t sequence = atomic_load_explicit(&stripe_lock->sequence, memory_order_relaxed);
+    atomic_store_explicit(&stripe_lock->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void stripe_write_end(table_lock_t* stripe_lock){
+    uint32_t sequence = atomic_load_explicit(&stripe_lock->sequence, memory_order_relaxed);
+    atomic_store_explicit(&stripe_lock->sequence, sequence + 1, memory_order_release);
+}
+
+// Locks the stripe owning hash and returns its index. The mask only changes
+// while every stripe is write-locked, so once a stripe is held the bucket
+// arrays are stable too. A single owner skips the locks altogether.
+static size_t stripe_lock(hashtable_t* table, uint64_t hash, bool write){
+    if (table->single_owner){
+        return hash & atomic_load_explicit(&table->lock_mask, memory_order_relaxed);
+    }
+
+    while (true){
+        size_t mask = atomic_load_explicit(&table->lock_mask, memory_order_acquire);
+        size_t stripe = hash & mask;
+
+        if (write){
+            rwspin_write_lock(&table->locks[stripe].lock);
+        } else{
+            rwspin_read_lock(&table->locks[stripe].lock);
+        }
+
+        if (atomic_load_explicit(&table->lock_mask, memory_order_relaxed) == mask){
+            if (write){
+                stripe_write_begin(&table->locks[stripe]);
+            }
+            return stripe;
+        }
+
+        if (write){
+            rwspin_write_unlock(&table->locks[stripe].lock);
+        } else{
+            rwspin_read_unlock(&table->locks[stripe].lock);
+        }
+    }
+}
+
+static inline void stripe_unlock(hashtable_t* table, size_t stripe, bool write){
+    if (table->single_owner){
+        return;
+    }
+
+    if (write){
+        stripe_write_end(&table->locks[stripe]);
+        rwspin_write_unlock(&table->locks[stripe].lock);
+    } else{
+        rwspin_read_unlock(&table->locks[stripe].lock);
+    }
+}
+
+static void stripe_lock_all(hashtable_t* table, bool write){
+    if (table->single_owner){
+        return;
+    }
+
+    for (size_t i = 0; i < table->lock_count; i++){
+        if (write){
+            rwspin_write_lock(&table->locks[i].lock);
+            stripe_write_begin(&table->locks[i]);
+        } else{
+            rwspin_read_lock(&table->locks[i].lock);
+        }
+    }
+}
+
+// Optimistic readers never write shared memory: they sample the sequence of
+// the stripe owning hash, probe, and keep the result only if
+// stripe_read_validate sees the same even value afterwards. Rechecking the
+// mask catches a reader that picked its stripe before a resize swapped it.
+static bool stripe_read_begin(hashtable_t* table, uint64_t hash, size_t* out_stripe, uint32_t* out_sequence){
+    size_t mask = atomic_load_explicit(&table->lock_mask, memory_order_acquire);
+    size_t stripe = hash & mask;
+
+    uint32_t sequence = atomic_load_explicit(&table->locks[stripe].sequence, memory_order_acquire);
+    if ((sequence & 1u) != 0){
+        return false;
+    }
+
+    if (atomic_load_explicit(&table->lock_mask, memory_order_relaxed) != mask){
+        return false;
+    }
+
+    *out_stripe = stripe;
+    *out_sequence = sequence;
+    return true;
+}
+
+static inline bool stripe_read_validate(hashtable_t* table, size_t stripe, uint32_t sequence){
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&table->locks[stripe].sequence, memory_order_relaxed) == sequence;
+}
+
+static void stripe_unlock_all(hashtable_t* table, bool write){
+    if (table->single_owner){
+        return;
+    }
+
+    for (size_t i = 0; i < table->lock_count; i++){
+        stripe_unlock(table, i, write);
+    }
+}
+
+// Looks the key up in the array being drained first, then in the live one.
+static int table_find_slot(hashtable_t* table, uint64_t hash, const unsigned char* key, size_t key_len,
+                           hashtable_bucket_t** out_bucket){
+    bucket_array_t* rehash_array = table_rehash_array(table);
+    if (rehash_array != NULL){
+        int i = bucket_chain_find(bucket_array_home(rehash_array, hash), hash, key, key_len, out_bucket);
+        if (i != -1){
+            return i;
+        }
+    }
+
+    return bucket_chain_find(bucket_array_home(table_array(table), hash), hash, key, key_len, out_bucket);
+}
+
+// Same walk for optimistic readers, which may see a slot halfway through a
+// rewrite: a long key's pointer is only followed once the sequence shows
+// nothing was written since the probe began. Returns -2 when it was.
+static int bucket_chain_find_optimistic(hashtable_t* table, hashtable_bucket_t* home, uint64_t hash,
+                                        const unsigned char* key, size_t key_len, size_t stripe, uint32_t sequence,
+                                        hashtable_bucket_t** out_bucket){
+    uint8_t tag = hash_tag(hash);
+
+    for (hashtable_bucket_t* bucket = home; bucket != NULL; bucket = bucket->next){
+        uint32_t candidates = bucket_match(bucket, tag);
+
+        while (candidates != 0){
+            int i = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+
+            if ((bucket->hashes[i] != hash) || (bucket->keys[i].length != key_len)){
+                continue;
+            }
+
+            const unsigned char* data = bucket->keys[i].inline_data;
+            if (key_len > KEY_INLINE_LEN){
+                data = bucket->keys[i].heap_data;
+                if (!stripe_read_validate(table, stripe, sequence)){
+                    return -2;
+                }
+            }
+
+            if (memcmp(data, key, key_len) == 0){
+                *out_bucket = bucket;
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// Each array is loaded once, so its index is always taken against its own count.
+static int table_find_slot_optimistic(hashtable_t* table, uint64_t hash, const unsigned char* key, size_t key_len,
+                                      size_t stripe, uint32_t sequence, hashtable_bucket_t** out_bucket){
+    bucket_array_t* rehash_array = table_rehash_array(table);
+    if (rehash_array != NULL){
+        int i = bucket_chain_find_optimistic(table, bucket_array_home(rehash_array, hash), hash, key, key_len, stripe,
+                                             sequence, out_bucket);
+        if (i != -1){
+            return i;
+        }
+    }
+
+    return bucket_chain_find_optimistic(table, bucket_array_home(table_array(table), hash), hash, key, key_len, stripe,
+                                        sequence, out_bucket);
+}
+
+static inline hashtable_bucket_t* table_home_bucket(hashtable_t* table, uint64_t hash){
+    return bucket_array_home(table_array(table), hash);
+}
+
+// Stores a key known to be absent under its write lock. Everything is
+// allocated before the key becomes visible, so a failure leaves nothing behind.
+static int table_insert_absent(hashtable_t* table, uint64_t hash, const unsigned char* key, size_t key_len, void* value,
+                               uint32_t expire_at){
+    skiplist_node_t* node = NULL;
+    if (table->ordered_index != NULL){
+        node = skiplist_node_create(key, key_len);
+        if (node == NULL){
+            return -2;
+        }
+        atomic_store_explicit(&node->expire_at, expire_at, memory_order_relaxed);
+    }
+
+    hashtable_key_t stored_key;
+    if (key_store(&stored_key, key, key_len) != 0){
+        skiplist_node_free(node);
+        return -2;
+    }
+    stored_key.expire_at = expire_at;
+
+    if (bucket_chain_insert(table_home_bucket(table, hash), hash, &stored_key, value, access_word_new(table),
+                            &table->overflow_count) != 0){
+        key_release(&stored_key);
+        skiplist_node_free(node);
+        return -2;
+    }
+
+    if (node != NULL){
+        skiplist_insert(table->ordered_index, node);
+    }
+
+    atomic_fetch_add_explicit(&table->elem_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&table->data_bytes, table_value_bytes(table, value) + table_key_bytes(key_len),
+                              memory_order_relaxed);
+
+    return 0;
+}
+
+static size_t bucket_chain_expire(hashtable_t* table, hashtable_bucket_t* home, uint64_t hash, uint32_t now){
+    size_t removed = 0;
+
+    for (hashtable_bucket_t* bucket = home; bucket != NULL; bucket = bucket->next){
+        uint32_t candidates = bucket_match(bucket, hash_tag(hash));
+
+        while (candidates != 0){
+            int i = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+
+            if ((bucket->hashes[i] == hash) && slot_expired(bucket, i, now)){
+                slot_expire(table, bucket, i);
+                removed++;
+            }
+        }
+    }
+
+    return removed;
+}
+
+// Removes every expired key with this hash. Works from the hash alone, so the
+// wheel never has to store keys, and a key that got a new TTL stays put.
+static size_t table_remove_expired(hashtable_t* table, uint64_t hash, uint32_t now){
+    size_t stripe = stripe_lock(table, hash, true);
+
+    size_t removed = bucket_chain_expire(table, table_home_bucket(table, hash), hash, now);
+    bucket_array_t* rehash_array = table_rehash_array(table);
+    if (rehash_array != NULL){
+        removed += bucket_chain_expire(table, bucket_array_home(rehash_array, hash), hash, now);
+    }
+
+    stripe_unlock(table, stripe, true);
+    return removed;
+}
+
+// deferred retires everything instead of freeing it, for tables that may still have readers.
+static void table_destroy_entries(hashtable_t* table, hashtable_bucket_t* buckets, size_t buckets_count,
+                                  void (*value_destroyer)(void*), bool deferred){
+    for (size_t i = 0; i < buckets_count; i++) {
+        for (hashtable_bucket_t* bucket = &buckets[i]; bucket != NULL; bucket = bucket->next) {
+            for (size_t j = 0; j < BUCKET_CAPACITY; j++) {
+                if (bucket->ctrl[j] != CTRL_EMPTY) {
+                    if (deferred) {
+                        table_retire_value(table, bucket->values[j], value_destroyer);
+                        key_retire(table, &bucket->keys[j]);
+                    } else {
+                        if ((value_destroyer != NULL) && !table_value_is_inline(bucket->values[j])) {
+                            value_destroyer(bucket->values[j]);
+                        }
+                        key_release(&bucket->keys[j]);
+                    }
+
+                    bucket->ctrl[j] = CTRL_EMPTY;
+                    bucket->hashes[j] = 0; 
+
+                    bucket->values[j] = NULL; 
+                }
+            }
+        }
+
+        bucket_chain_destroy(table, &buckets[i], deferred);
+    }
+}
+
+// Moves every entry of one drained bucket into the live array. Entries are
+// cleared one by one, so a failed allocation leaves the rest where lookups
+// still find them and the bucket is simply retried later.
+static int bucket_migrate(hashtable_t* table, hashtable_bucket_t* old_home){
+    for (hashtable_bucket_t* bucket = old_home; bucket != NULL; bucket = bucket->next){
+        for (int j = 0; j < BUCKET_CAPACITY; j++){
+            if (bucket->ctrl[j] == CTRL_EMPTY){
+                continue;
+            }
+
+            uint64_t hash = bucket->hashes[j];
+            uint32_t access = atomic_load_explicit(&bucket->access[j], memory_order_relaxed);
+            if (bucket_chain_insert(table_home_bucket(table, hash), hash, &bucket->keys[j], bucket->values[j],
+                                    access, &table->overflow_count) != 0){
+                return -1;
+            }
+
+            bucket->ctrl[j] = CTRL_EMPTY;
+            bucket->hashes[j] = 0;
+            bucket->values[j] = NULL;
+        }
+    }
+
+    size_t freed = bucket_chain_destroy(table, old_home, true);
+    atomic_fetch_sub_explicit(&table->overflow_count, freed, memory_order_relaxed);
+
+    return 0;
+}
+
+static void table_rehash_finish(hashtable_t* table){
+    stripe_lock_all(table, true);
+
+    bucket_array_t* drained = table_rehash_array(table);
+    if ((drained != NULL) && (atomic_load_explicit(&table->rehash_index, memory_order_relaxed) == drained->count)){
+        atomic_store_explicit(&table->rehash_array, NULL, memory_order_release);
+        table_retire(table, drained, NULL, bucket_array_bytes(drained->count));
+        atomic_fetch_sub_explicit(&table->bucket_bytes, bucket_array_bytes(drained->count), memory_order_relaxed);
+
+        atomic_store_explicit(&table->rehashing, false, memory_order_relaxed);
+        atomic_store_explicit(&table->lock_mask, stripe_mask_for(table), memory_order_release);
+
+        fprintf(stderr, "[INFO] table_rehash: Rehash to %zu buckets completed.\n", table_array(table)->count);
+    }
+
+    stripe_unlock_all(table, true);
+}
 
 // Lifecycle
-hashtable_t* table_create(size_t initial_capacity){
+hashtable_t* table_create(size_t initial_capacity, size_t lock_stripes){
     if (initial_capacity == 0){
         return NULL;
     }
 
+    if (lock_stripes == 0){
+        lock_stripes = LOCK_STRIPES_DEFAULT;
+    }
+
+    if ((lock_stripes & (lock_stripes - 1)) != 0){
+        lock_stripes = next_power_of_2(lock_stripes);
+    }
+
+    hash_init();
+
     hashtable_t* new_hashtable = (hashtable_t*)malloc(sizeof(hashtable_t));
     if (new_hashtable == NULL){
         return NULL;
@@ -24,480 +742,1092 @@ hashtable_t* table_create(size_t initial_capacity){
 
     #if ENABLE_ONLY_POWER_2_SIZE
     if ((initial_capacity & (initial_capacity - 1)) != 0){
+        size_t requested_capacity = initial_capacity;
         initial_capacity = next_power_of_2(initial_capacity);
         fprintf(stderr, "[INFO] Requested capacity %zu is not a power of two. Adjusting to %zu for performance mode.\n",
-                        atomic_load_explicit(&new_hashtable->elem_count, memory_order_relaxed), initial_capacity);
+                        requested_capacity, initial_capacity);
     }
     #endif
   
     new_hashtable->elem_count = 0;
-    new_hashtable->buckets_count = initial_capacity;
-    new_hashtable->lock_count = initial_capacity;
-
-    new_hashtable->buckets = calloc(new_hashtable->buckets_count, sizeof(hashtable_bucket_t));
-    if (!new_hashtable->buckets) {
+    new_hashtable->overflow_count = 0;
+    new_hashtable->bucket_bytes = bucket_array_bytes(initial_capacity);
+    new_hashtable->lock_count = lock_stripes;
+
+    atomic_init(&new_hashtable->rehash_array, NULL);
+    new_hashtable->rehash_index = 0;
+    new_hashtable->rehashing = false;
+    new_hashtable->value_sizer = NULL;
+
+    new_hashtable->eviction = (hashtable_eviction_policy_t){
+        .mode = EVICTION_NONE,
+        .max_memory = 0,
+        .samples = EVICTION_SAMPLES_DEFAULT,
+    };
+    new_hashtable->clock = 0;
+    new_hashtable->data_bytes = 0;
+    new_hashtable->evicted_keys = 0;
+    new_hashtable->evicted_bytes = 0;
+    new_hashtable->expired_keys = 0;
+    new_hashtable->value_destroyer = NULL;
+    new_hashtable->ordered_index = NULL;
+    new_hashtable->single_owner = false;
+
+    bucket_array_t* array = bucket_array_create(initial_capacity);
+    if (!array) {
         free(new_hashtable);
         return NULL;
     }
+    atomic_init(&new_hashtable->array, array);
     
-    new_hashtable->locks = malloc(new_hashtable->lock_count * sizeof(pthread_rwlock_t));
+    new_hashtable->locks = aligned_alloc(alignof(table_lock_t), new_hashtable->lock_count * sizeof(table_lock_t));
     if (!new_hashtable->locks) {
-        free(new_hashtable->buckets);
+        free(array);
+        free(new_hashtable);
+        return NULL;
+    }
+
+    if (wheel_init(&new_hashtable->expiry_wheel) != 0) {
+        free(new_hashtable->locks);
+        free(array);
         free(new_hashtable);
         return NULL;
     }
 
-    for (size_t i = 0; i < new_hashtable->lock_count; ++i) {
-        if (pthread_rwlock_init(&new_hashtable->locks[i], NULL) != 0) {
-            for (size_t j = 0; j < i; ++j) {
-                pthread_rwlock_destroy(&new_hashtable->locks[j]);
-            }
+    for (size_t i = 0; i < new_hashtable->lock_count; ++i) {
+        rwspin_init(&new_hashtable->locks[i].lock);
+        atomic_init(&new_hashtable->locks[i].sequence, 0);
+    }
+
+    new_hashtable->lock_mask = stripe_mask_for(new_hashtable);
+
+    new_hashtable->policy = (hashtable_resize_policy_t){
+        .enabled = true,
+        .grow_load_factor = AUTORESIZE_GROW_LOAD,
+        .shrink_load_factor = AUTORESIZE_SHRINK_LOAD,
+        .grow_overflow_ratio = AUTORESIZE_GROW_OVERFLOW,
+        .min_buckets = initial_capacity,
+    };
+
+    return new_hashtable;
+}
+
+int table_destroy(hashtable_t* table, void (*value_destroyer)(void*)) {
+    if (table == NULL) {
+        return 0;
+    }
+
+    bucket_array_t* array = table_array(table);
+    bucket_array_t* rehash_array = table_rehash_array(table);
+
+    table_destroy_entries(table, array->buckets, array->count, value_destroyer, false);
+    if (rehash_array != NULL) {
+        table_destroy_entries(table, rehash_array->buckets, rehash_array->count, value_destroyer, false);
+    }
+
+    wheel_destroy(&table->expiry_wheel);
+    skiplist_destroy(table->ordered_index);
+    free(table->locks);
+    free(rehash_array);
+    free(array);
+    free(table);
+
+    return 0;
+}
+
+int table_clear(hashtable_t* table, void (*value_destroyer)(void*)) {
+    if (table == NULL) {
+        return -1; 
+    }
+
+    stripe_lock_all(table, true);
+
+    bucket_array_t* array = table_array(table);
+    table_destroy_entries(table, array->buckets, array->count, value_destroyer, true);
+
+    // Nothing is left to migrate, so a pending rehash ends here
+    bucket_array_t* drained = table_rehash_array(table);
+    if (drained != NULL) {
+        table_destroy_entries(table, drained->buckets, drained->count, value_destroyer, true);
+
+        atomic_store_explicit(&table->rehash_array, NULL, memory_order_release);
+        table_retire(table, drained, NULL, bucket_array_bytes(drained->count));
+        atomic_fetch_sub_explicit(&table->bucket_bytes, bucket_array_bytes(drained->count), memory_order_relaxed);
+        table->rehash_index = 0;
+        table->rehashing = false;
+        atomic_store_explicit(&table->lock_mask, stripe_mask_for(table), memory_order_release);
+    }
+
+    table->elem_count = 0;
+    table->overflow_count = 0;
+    table->data_bytes = 0;
+
+    skiplist_clear(table->ordered_index);
+
+    stripe_unlock_all(table, true);
+
+    // Every pair left would only find an empty table
+    wheel_clear(&table->expiry_wheel);
+
+    return 0; 
+}
+
+// Only allocates the new array and swaps it in; entries are moved afterwards by
+// table_rehash_step, called from every operation and from the server loop.
+// A nonzero expected_count makes it a no-op unless the live array still has
+// that many buckets, for callers that sized the new array from a snapshot.
+static int table_resize_from(hashtable_t* table, size_t expected_count, size_t new_capacity) {
+    if ((table == NULL) || (new_capacity == 0)) {
+        return -1;
+    }
+
+    size_t original_capacity = new_capacity;
+
+    #if ENABLE_ONLY_POWER_2_SIZE
+
+    if ((new_capacity & (new_capacity - 1)) != 0) {
+        new_capacity = next_power_of_2(new_capacity);
+
+        fprintf(stderr, "[INFO] Requested capacity %zu is not a power of two. Adjusting to %zu for performance mode.\n",
+                original_capacity,
+                new_capacity);
+    }
+    #endif
+
+    if (atomic_load_explicit(&table->rehashing, memory_order_relaxed)) {
+        fprintf(stderr, "[ERROR] table_resize: A rehash is already in progress.\n");
+        return -2;
+    }
+
+    bucket_array_t* new_array = bucket_array_create(new_capacity);
+    if (new_array == NULL) {
+        fprintf(stderr, "[ERROR] table_resize: Failed to allocate new buckets.\n");
+        return -1;
+    }
+
+    stripe_lock_all(table, true);
+
+    bucket_array_t* old_array = table_array(table);
+    bool busy = (table_rehash_array(table) != NULL);
+    bool stale = (expected_count != 0) && (old_array->count != expected_count);
+    if (busy || stale || (new_capacity == old_array->count)) {
+        stripe_unlock_all(table, true);
+        free(new_array);
+        return busy ? -2 : 0;
+    }
+
+    size_t old_capacity = old_array->count;
+
+    atomic_store_explicit(&table->rehash_array, old_array, memory_order_release);
+    table->rehash_index = 0;
+
+    atomic_store_explicit(&table->array, new_array, memory_order_release);
+    atomic_fetch_add_explicit(&table->bucket_bytes, bucket_array_bytes(new_capacity), memory_order_relaxed);
+
+    atomic_store_explicit(&table->rehashing, true, memory_order_relaxed);
+    atomic_store_explicit(&table->lock_mask, stripe_mask_for(table), memory_order_release);
+
+    stripe_unlock_all(table, true);
+
+    fprintf(stderr, "[INFO] table_resize: Started rehash from %zu to %zu buckets.\n", old_capacity, new_capacity);
+
+    return 0;
+}
+
+int table_resize(hashtable_t* table, size_t new_capacity) {
+    return table_resize_from(table, 0, new_capacity);
+}
+
+size_t table_rehash_step(hashtable_t* table, size_t steps) {
+    if ((table == NULL) || !atomic_load_explicit(&table->rehashing, memory_order_relaxed)) {
+        return 0;
+    }
+
+    size_t empty_visits = steps * REHASH_EMPTY_VISITS;
+    size_t remaining = 0;
+
+    while (steps > 0) {
+        size_t index = atomic_load_explicit(&table->rehash_index, memory_order_relaxed);
+
+        size_t stripe = stripe_lock(table, index, true);
+
+        bucket_array_t* drained = table_rehash_array(table);
+        if (drained == NULL) {
+            stripe_unlock(table, stripe, true);
+            return 0;
+        }
+
+        // Another caller moved this bucket while we were waiting for its stripe
+        if (atomic_load_explicit(&table->rehash_index, memory_order_relaxed) != index) {
+            stripe_unlock(table, stripe, true);
+            continue;
+        }
+
+        if (index == drained->count) {
+            stripe_unlock(table, stripe, true);
+            break;
+        }
+
+        hashtable_bucket_t* old_home = &drained->buckets[index];
+        bool was_empty = (old_home->next == NULL) && (bucket_match(old_home, CTRL_EMPTY) == ((1u << BUCKET_CAPACITY) - 1u));
+
+        if (bucket_migrate(table, old_home) != 0) {
+            stripe_unlock(table, stripe, true);
+            fprintf(stderr, "[ERROR] table_rehash_step: Failed to allocate an overflow bucket, retrying later.\n");
+            return drained->count - index;
+        }
+
+        atomic_store_explicit(&table->rehash_index, index + 1, memory_order_relaxed);
+        remaining = drained->count - (index + 1);
+
+        stripe_unlock(table, stripe, true);
+
+        if (remaining == 0) {
+            break;
+        }
+
+        if (was_empty) {
+            if (empty_visits == 0) {
+                break;
+            }
+            empty_visits--;
+        } else {
+            steps--;
+        }
+    }
+
+    if (remaining == 0) {
+        table_rehash_finish(table);
+    }
+
+    return remaining;
+}
+
+int table_set_resize_policy(hashtable_t* table, const hashtable_resize_policy_t* policy) {
+    if ((table == NULL) || (policy == NULL)) {
+        return -1;
+    }
+
+    if ((policy->shrink_load_factor < 0.0) || (policy->grow_load_factor <= 0.0) ||
+        (policy->grow_overflow_ratio <= 0.0) || (policy->min_buckets == 0)) {
+        return -1;
+    }
+
+    if (policy->shrink_load_factor * 2.0 >= policy->grow_load_factor) {
+        fprintf(stderr, "[ERROR] table_set_resize_policy: Shrink watermark %.2f must be less than half of grow watermark %.2f.\n",
+                policy->shrink_load_factor, policy->grow_load_factor);
+        return -1;
+    }
+
+    table->policy = *policy;
+    return 0;
+}
+
+void table_set_value_sizer(hashtable_t* table, size_t (*value_sizer)(const void* value)) {
+    if (table != NULL) {
+        table->value_sizer = value_sizer;
+    }
+}
+
+void table_set_value_destroyer(hashtable_t* table, void (*value_destroyer)(void* value)) {
+    if (table != NULL) {
+        table->value_destroyer = value_destroyer;
+    }
+}
+
+void table_set_single_owner(hashtable_t* table) {
+    if (table != NULL) {
+        table->single_owner = true;
+    }
+}
+
+// Checks the watermarks and starts a progressive resize when one is crossed.
+// Returns 1 when a resize was started, 0 when none was needed and -1 on error.
+// Every figure comes from one snapshot of the bucket count, and the resize is
+// dropped if another thread (a RESIZE command) changed it in the meantime.
+int table_autoresize(hashtable_t* table) {
+    if ((table == NULL) || !table->policy.enabled || table_is_rehashing(table)) {
+        return 0;
+    }
+
+    size_t buckets_count = table_array(table)->count;
+    double load_factor = (double)atomic_load_explicit(&table->elem_count, memory_order_relaxed) /
+                         (double)(buckets_count * BUCKET_CAPACITY);
+    double overflow_ratio = (double)atomic_load_explicit(&table->overflow_count, memory_order_relaxed) /
+                            (double)buckets_count;
+
+    size_t new_capacity = buckets_count;
+
+    // Overflow alone only grows a table that is not nearly empty, so colliding keys cannot inflate it forever
+    if ((load_factor > table->policy.grow_load_factor) ||
+        ((overflow_ratio > table->policy.grow_overflow_ratio) && (load_factor > table->policy.shrink_load_factor * 2.0))) {
+        new_capacity = buckets_count * 2;
+    } else if ((load_factor < table->policy.shrink_load_factor) && (buckets_count / 2 >= table->policy.min_buckets)) {
+        new_capacity = buckets_count / 2;
+    }
+
+    if (new_capacity == buckets_count) {
+        return 0;
+    }
+
+    fprintf(stderr, "[INFO] table_autoresize: Load factor %.2f, overflow ratio %.2f, resizing %zu -> %zu buckets.\n",
+            load_factor, overflow_ratio, buckets_count, new_capacity);
+
+    int status = table_resize_from(table, buckets_count, new_capacity);
+    if (status != 0) {
+        return -1;
+    }
+
+    return (table_array(table)->count == new_capacity) ? 1 : 0;
+}
+
+int table_set_eviction_policy(hashtable_t* table, const hashtable_eviction_policy_t* policy) {
+    if ((table == NULL) || (policy == NULL) || (policy->samples == 0) || (policy->mode > EVICTION_RANDOM)) {
+        return -1;
+    }
+
+    if ((policy->max_memory != 0) && (table->value_sizer == NULL)) {
+        fprintf(stderr, "[ERROR] table_set_eviction_policy: A memory limit needs a value sizer to account values.\n");
+        return -1;
+    }
+
+    table->eviction = *policy;
+    return 0;
+}
+
+void table_update_clock(hashtable_t* table, uint64_t now_ms) {
+    if (table != NULL) {
+        atomic_store_explicit(&table->clock, now_ms, memory_order_relaxed);
+    }
+}
+
+typedef struct eviction_candidate_t{
+    uint64_t hash;
+    uint32_t score;                // Higher goes first
+    size_t key_len;
+    unsigned char key[KEY_MAX_LEN];
+} eviction_candidate_t;
+
+static uint32_t eviction_score(hashtable_t* table, uint32_t access, uint64_t now) {
+    switch (table->eviction.mode) {
+        case EVICTION_LRU:
+            return (uint32_t)now - access;
+        case EVICTION_LFU:
+            return 255u - lfu_decayed_counter(access, now);
+        default:
+            return (uint32_t)table_random();
+    }
+}
+
+// Scores every key of one random bucket chain under its read lock, so keys
+// in overflow buckets get picked as often as those in the home bucket, and
+// keeps the best candidate in best. Returns how many keys it looked at.
+// The random number picks the stripe before the arrays are read, then the
+// bucket, so the stripe held always owns that bucket.
+static size_t eviction_sample_bucket(hashtable_t* table, uint64_t now, eviction_candidate_t* best, bool* found) {
+    uint64_t random = table_random();
+    size_t stripe = stripe_lock(table, random, false);
+
+    bucket_array_t* array = table_array(table);
+    bucket_array_t* rehash_array = table_rehash_array(table);
+    if ((rehash_array != NULL) && ((random >> 63) != 0)) {
+        array = rehash_array;
+    }
+
+    size_t seen = 0;
+    for (hashtable_bucket_t* bucket = bucket_array_home(array, random); bucket != NULL; bucket = bucket->next) {
+        for (int j = 0; j < BUCKET_CAPACITY; j++) {
+            if (bucket->ctrl[j] == CTRL_EMPTY) {
+                continue;
+            }
+            seen++;
+
+            // Keys already expired go before any live one
+            uint32_t score = slot_expired(bucket, j, (uint32_t)(now / 1000u)) ? UINT32_MAX :
+                             eviction_score(table, atomic_load_explicit(&bucket->access[j], memory_order_relaxed), now);
+            if (!*found || (score > best->score)) {
+                best->hash = bucket->hashes[j];
+                best->score = score;
+                best->key_len = bucket->keys[j].length;
+                memcpy(best->key, key_data(&bucket->keys[j]), best->key_len);
+                *found = true;
+            }
+        }
+    }
+
+    stripe_unlock(table, stripe, false);
+    return seen;
+}
+
+// Samples, then removes the chosen key under its write lock if nobody did
+// meanwhile. Returns false when no key could be removed this time.
+static bool table_evict_one(hashtable_t* table, void (*value_destroyer)(void*)) {
+    size_t samples = (table->eviction.mode == EVICTION_RANDOM) ? 1 : table->eviction.samples;
+    size_t empty_visits = samples * EVICTION_EMPTY_VISITS;
+    uint64_t now = atomic_load_explicit(&table->clock, memory_order_relaxed);
+
+    eviction_candidate_t best;
+    bool found = false;
+
+    size_t seen = 0;
+    while ((seen < samples) && (empty_visits > 0)) {
+        size_t looked = eviction_sample_bucket(table, now, &best, &found);
+        if (looked == 0) {
+            empty_visits--;
+        }
+        seen += looked;
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    size_t stripe = stripe_lock(table, best.hash, true);
+
+    hashtable_bucket_t* bucket = NULL;
+    int i = table_find_slot(table, best.hash, best.key, best.key_len, &bucket);
+    if (i == -1) {
+        stripe_unlock(table, stripe, true);
+        return false;
+    }
+
+    size_t bytes = slot_remove(table, bucket, i, value_destroyer);
+
+    stripe_unlock(table, stripe, true);
+
+    atomic_fetch_add_explicit(&table->evicted_keys, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&table->evicted_bytes, bytes, memory_order_relaxed);
+
+    return true;
+}
+
+int table_evict(hashtable_t* table, size_t max_keys, void (*value_destroyer)(void*)) {
+    if ((table == NULL) || (table->eviction.max_memory == 0)) {
+        return 0;
+    }
+
+    size_t evicted = 0;
+    while (table_used_memory(table) > table->eviction.max_memory) {
+        if ((table->eviction.mode == EVICTION_NONE) || (table_total_elem(table) == 0)) {
+            return -1;
+        }
+
+        if ((evicted == max_keys) || !table_evict_one(table, value_destroyer)) {
+            return 1;
+        }
+        evicted++;
+    }
+
+    return 0;
+}
+
+// Core Ops (Valid void* value are dinamically allocated)
+
+int table_set(hashtable_t* table, const unsigned char* key, size_t key_len, void* value, void (*value_destroyer)(void*)){
+    return table_set_ex(table, key, key_len, value, value_destroyer, 0);
+}
+
+int table_set_ex(hashtable_t* table, const unsigned char* key, size_t key_len, void* value,
+                 void (*value_destroyer)(void*), uint32_t ttl_seconds){
+    if ((table == NULL) || (key == NULL) || (key_len == 0) || (ttl_seconds > TTL_MAX_SECONDS)) {
+        return -1; 
+    }
+
+    if (key_len >= KEY_MAX_LEN) {
+        return -3; 
+    }
+
+    uint64_t hash_full = hash(key, key_len);
+    uint32_t now = table_now_seconds(table);
+    uint32_t expire_at = (ttl_seconds != 0) ? now + ttl_seconds : 0;
+
+    table_rehash_step(table, REHASH_STEPS_PER_OP);
+
+    size_t stripe = stripe_lock(table, hash_full, true);
+
+    hashtable_bucket_t* bucket = NULL;
+
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if (i != -1){
+        void* old_value = bucket->values[i];
+        bucket->values[i] = value; 
+        slot_set_expiry(table, bucket, i, expire_at);
+        slot_touch(table, bucket, i);
+
+        atomic_fetch_add_explicit(&table->data_bytes, table_value_bytes(table, value), memory_order_relaxed);
+        atomic_fetch_sub_explicit(&table->data_bytes, table_value_bytes(table, old_value), memory_order_relaxed);
+        table_retire_value(table, old_value, value_destroyer);
+
+        stripe_unlock(table, stripe, true);
+
+        if (expire_at != 0){
+            table_schedule_expiry(table, hash_full, expire_at, now);
+        }
+        return 0; 
+    }
+
+    if (table_insert_absent(table, hash_full, key, key_len, value, expire_at) != 0){
+        stripe_unlock(table, stripe, true);
+        return -2; 
+    }
+
+    stripe_unlock(table, stripe, true);
+
+    if (expire_at != 0){
+        table_schedule_expiry(table, hash_full, expire_at, now);
+    }
+    return 0; 
+}
+
+// Optimistic lookups run inside an epoch, so whatever they reach stays
+// allocated until they leave even if a writer retires it meanwhile. They
+// return false when every attempt raced a writer, and report an expired
+// key as missing, setting out_expired so the caller can remove it.
+static bool table_get_optimistic(hashtable_t* table, uint64_t hash, const unsigned char* key, size_t key_len,
+                                 uint32_t now, void* (*value_copier)(void*), void** out_value, bool* out_expired){
+    for (int attempt = 0; attempt < SEQLOCK_READ_RETRIES; attempt++) {
+        size_t stripe;
+        uint32_t sequence;
+
+        if (!stripe_read_begin(table, hash, &stripe, &sequence)) {
+            continue;
+        }
+
+        hashtable_bucket_t* bucket = NULL;
+        void* internal_value = NULL;
+        bool expired = false;
+
+        int i = table_find_slot_optimistic(table, hash, key, key_len, stripe, sequence, &bucket);
+        if (i == -2) {
+            continue;
+        }
+        if (i != -1) {
+            expired = slot_expired(bucket, i, now);
+            internal_value = expired ? NULL : bucket->values[i];
+        }
+
+        if (!stripe_read_validate(table, stripe, sequence)) {
+            continue;
+        }
 
-            free(new_hashtable->locks);
-            free(new_hashtable->buckets);
-            free(new_hashtable);
-            return NULL;
+        *out_expired = expired;
+        if (internal_value != NULL) {
+            slot_touch(table, bucket, i);
         }
+
+        // Values are never modified once published, only replaced, and the
+        // epoch keeps this one alive while the copier runs
+        *out_value = internal_value;
+        if ((internal_value != NULL) && !table_value_is_inline(internal_value)) {
+            *out_value = value_copier(internal_value);
+        }
+
+        return true;
     }
 
-    return new_hashtable;
+    return false;
 }
 
-int table_destroy(hashtable_t* table, void (*value_destroyer)(void*)) {
-    if (table == NULL) {
-        return 0;
-    }
+static bool table_exist_optimistic(hashtable_t* table, uint64_t hash, const unsigned char* key, size_t key_len,
+                                   uint32_t now, bool* out_found, bool* out_expired){
+    for (int attempt = 0; attempt < SEQLOCK_READ_RETRIES; attempt++) {
+        size_t stripe;
+        uint32_t sequence;
 
-    if (value_destroyer != NULL) {
-        for (size_t i = 0; i < table->buckets_count; i++) {
-            for (size_t j = 0; j < BUCKET_CAPACITY; j++) {
-                if (table->buckets[i].in_use[j]) {
-                    value_destroyer(table->buckets[i].values[j]);
-                }
-            }
+        if (!stripe_read_begin(table, hash, &stripe, &sequence)) {
+            continue;
         }
-    }
 
-    for (size_t i = 0; i < table->lock_count; i++) {
-        if (pthread_rwlock_destroy(&table->locks[i]) != 0) {
-            return -1;
+        hashtable_bucket_t* bucket = NULL;
+        int i = table_find_slot_optimistic(table, hash, key, key_len, stripe, sequence, &bucket);
+        if (i == -2) {
+            continue;
         }
-    }
+        bool expired = (i != -1) && slot_expired(bucket, i, now);
 
-    free(table->locks);
-    free(table->buckets);
-    free(table);
+        if (stripe_read_validate(table, stripe, sequence)) {
+            *out_found = (i != -1) && !expired;
+            *out_expired = expired;
+            return true;
+        }
+    }
 
-    return 0;
+    return false;
 }
 
-int table_clear(hashtable_t* table, void (*value_destroyer)(void*)) {
-    if (table == NULL) {
-        return -1; 
+void* table_get(hashtable_t* table, const unsigned char* key, size_t key_len, void* (*value_copier)(void*)) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0) || (value_copier == NULL)) {
+        return NULL;
     }
 
-    for (size_t i = 0; i < table->lock_count; i++) {
-        if (pthread_rwlock_wrlock(&table->locks[i]) != 0) {
-            for (size_t j = 0; j < i; j++) {
-                pthread_rwlock_unlock(&table->locks[j]);
-            }
+    uint64_t hash_full = hash(key, key_len);
+    uint32_t now = table_now_seconds(table);
+    bool expired = false;
 
-            return -1; 
+    if (!table->single_owner && (epoch_enter() == 0)) {
+        void* value_copy = NULL;
+        bool done = table_get_optimistic(table, hash_full, key, key_len, now, value_copier, &value_copy, &expired);
+        epoch_exit();
+
+        if (done) {
+            if (expired) {
+                table_remove_expired(table, hash_full, now);
+            }
+            return value_copy;
         }
     }
 
-    for (size_t i = 0; i < table->buckets_count; i++) {
-        for (size_t j = 0; j < BUCKET_CAPACITY; j++) {
-            if (table->buckets[i].in_use[j]) {
-                if (value_destroyer != NULL) {
-                    value_destroyer(table->buckets[i].values[j]);
-                }
+    size_t stripe = stripe_lock(table, hash_full, false);
 
-                table->buckets[i].in_use[j] = 0;
-                table->buckets[i].hashes[j] = 0; 
+    hashtable_bucket_t* bucket = NULL;
+    void* value_copy = NULL;
 
-                table->buckets[i].values[j] = NULL; 
-            }
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && slot_expired(bucket, i, now)) {
+        expired = true;
+    } else if (i != -1) {
+        value_copy = bucket->values[i];
+        slot_touch(table, bucket, i);
+
+        if ((value_copy != NULL) && !table_value_is_inline(value_copy)) {
+            value_copy = value_copier(value_copy);
         }
     }
 
-    table->elem_count = 0;
+    stripe_unlock(table, stripe, false);
 
-    for (size_t i = 0; i < table->lock_count; i++) {
-        pthread_rwlock_unlock(&table->locks[i]);
+    if (expired) {
+        table_remove_expired(table, hash_full, now);
     }
-
-    return 0; 
+    return value_copy;
 }
 
-int table_resize(hashtable_t* table, size_t new_capacity) {
-    if ((table == NULL) || (new_capacity == 0)) {
-        return -1;
+int table_delete(hashtable_t* table, const unsigned char* key, size_t key_len, void (*value_destroyer)(void*)) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0)) {
+        return -3; 
     }
 
-    size_t original_capacity = new_capacity;
+    uint64_t hash_full = hash(key, key_len);
 
-    #if ENABLE_ONLY_POWER_2_SIZE
+    table_rehash_step(table, REHASH_STEPS_PER_OP);
 
-    if ((new_capacity & (new_capacity - 1)) != 0) {
-        new_capacity = next_power_of_2(new_capacity);
+    size_t stripe = stripe_lock(table, hash_full, true);
 
-        fprintf(stderr, "[INFO] Requested capacity %zu is not a power of two. Adjusting to %zu for performance mode.\n",
-                original_capacity,
-                new_capacity);
-    }
-    #endif
+    hashtable_bucket_t* bucket = NULL;
 
-    if (new_capacity == table->buckets_count) {
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && slot_expired(bucket, i, table_now_seconds(table))) {
+        slot_expire(table, bucket, i);
+    } else if (i != -1) {
+        slot_remove(table, bucket, i, value_destroyer);
+
+        stripe_unlock(table, stripe, true);
         return 0; 
     }
 
-    for (size_t i = 0; i < table->lock_count; ++i) {
-        if (pthread_rwlock_wrlock(&table->locks[i]) != 0) {
-            fprintf(stderr, "[ERROR] table_resize: Failed to acquire lock %zu.\n", i);
+    stripe_unlock(table, stripe, true);
+    return -1; 
+}
 
-            for (size_t j = 0; j < i; ++j) {
-                pthread_rwlock_unlock(&table->locks[j]);
-            }
-            return -1;
-        }
+bool table_exist(hashtable_t* table, const unsigned char* key, size_t key_len){
+    if ((table == NULL) || (key == NULL) || (key_len == 0)){
+        return false;
     }
 
-    if (new_capacity < table->elem_count) {
-        fprintf(stderr, "[ERROR] table_resize: New capacity %zu is less than element count %zu.\n",
-                new_capacity, table->elem_count);
-
-        for (size_t i = 0; i < table->lock_count; ++i) pthread_rwlock_unlock(&table->locks[i]);
-        return -1;
-    }
+    uint64_t hash_full = hash(key, key_len);
+    uint32_t now = table_now_seconds(table);
+    bool found = false;
+    bool expired = false;
 
-    hashtable_bucket_t* new_buckets = calloc(new_capacity, sizeof(hashtable_bucket_t));
-    if (new_buckets == NULL) {
-        fprintf(stderr, "[ERROR] table_resize: Failed to allocate new buckets.\n");
-        for (size_t i = 0; i < table->lock_count; ++i) pthread_rwlock_unlock(&table->locks[i]);
-        return -1;
+    bool done = false;
+    if (!table->single_owner && (epoch_enter() == 0)){
+        done = table_exist_optimistic(table, hash_full, key, key_len, now, &found, &expired);
+        epoch_exit();
     }
 
-    for (size_t i = 0; i < table->buckets_count; ++i) {
-        for (size_t j = 0; j < BUCKET_CAPACITY; ++j) {
-            if (table->buckets[i].in_use[j]) {
-                uint64_t hash = table->buckets[i].hashes[j];
-                size_t new_bucket_index = hash % new_capacity; 
-
-                int inserted = 0;
-                for (size_t k = 0; k < BUCKET_CAPACITY; ++k) {
-                    if (new_buckets[new_bucket_index].in_use[k] == 0) {
-                        new_buckets[new_bucket_index].in_use[k] = 1;
-                        new_buckets[new_bucket_index].hashes[k] = hash;
-                        new_buckets[new_bucket_index].values[k] = table->buckets[i].values[j];
-                        memcpy(new_buckets[new_bucket_index].keys[k], table->buckets[i].keys[j], KEY_MAX_LEN);
-                        inserted = 1;
-                        break;
-                    }
-                }
+    if (!done){
+        size_t stripe = stripe_lock(table, hash_full, false);
 
-                if (inserted == 0) {
-                    fprintf(stderr, "[FATAL] table_resize: Rehashing failed, a destination bucket is full.\n");
+        hashtable_bucket_t* bucket = NULL;
+        int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+        expired = (i != -1) && slot_expired(bucket, i, now);
+        found = (i != -1) && !expired;
 
-                    free(new_buckets);
-                    for (size_t k = 0; k < table->lock_count; ++k) pthread_rwlock_unlock(&table->locks[k]);
-                    return -1;
-                }
-            }
-        }
+        stripe_unlock(table, stripe, false);
     }
 
-    hashtable_bucket_t* old_buckets = table->buckets;
-
-    table->buckets = new_buckets;
-    table->buckets_count = new_capacity;
-
-    free(old_buckets);
-
-    for (size_t i = 0; i < table->lock_count; ++i) {
-        pthread_rwlock_unlock(&table->locks[i]);
+    if (expired){
+        table_remove_expired(table, hash_full, now);
     }
 
-    return 0;
+    return found;
 }
 
-// Core Ops (Valid void* value are dinamically allocated)
-
-int table_set(hashtable_t* table, const unsigned char* key, void* value, void (*value_destroyer)(void*)){
-    if ((table == NULL) || (key == NULL)) {
+int table_add(hashtable_t* table, const unsigned char* key, size_t key_len, void* value){
+    if ((table == NULL) || (key == NULL) || (key_len == 0)) {
         return -1; 
     }
 
-    if (ustrlen(key) >= KEY_MAX_LEN) {
-        return -3; 
+    if (key_len >= KEY_MAX_LEN) {
+        return -1; 
     }
 
-    unsigned long hash_full = hash(key);
+    uint64_t hash_full = hash(key, key_len);
 
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
-    #else
-    size_t bucket_index = hash_full % table->buckets_count;
-    #endif
+    table_rehash_step(table, REHASH_STEPS_PER_OP);
 
-    if (pthread_rwlock_wrlock(&table->locks[bucket_index]) != 0){
-        return -1; 
-    }
+    size_t stripe = stripe_lock(table, hash_full, true);
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
-    int first_empty_slot = -1;
+    hashtable_bucket_t* found_bucket = NULL;
 
-    for (int i = 0; i < BUCKET_CAPACITY; i++){
-        if (bucket->in_use[i] && 
-           (bucket->hashes[i] == hash_full) && 
-           (ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0)){
+    int i = table_find_slot(table, hash_full, key, key_len, &found_bucket);
+    if ((i != -1) && slot_expired(found_bucket, i, table_now_seconds(table))){
+        slot_expire(table, found_bucket, i);
+    } else if (i != -1){
+        stripe_unlock(table, stripe, true);
+        return -3; 
+    }
 
-            if ((value_destroyer != NULL) && (bucket->values[i] != NULL)){
-                value_destroyer(bucket->values[i]); 
-            }
-            bucket->values[i] = value; 
+    if (table_insert_absent(table, hash_full, key, key_len, value, 0) != 0){
+        stripe_unlock(table, stripe, true);
+        return -2; 
+    }
 
-            pthread_rwlock_unlock(&table->locks[bucket_index]);
-            return 0; 
-        } else if (!bucket->in_use[i]) { 
+    stripe_unlock(table, stripe, true);
+    return 0; 
+}
 
-            if (first_empty_slot == -1) {
-                first_empty_slot = i;
-            }
-        }
+int table_replace(hashtable_t* table, const unsigned char* key, size_t key_len, void* new_value, void (*value_destroyer)(void*)) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0)) {
+        return -1; 
     }
 
-    if (first_empty_slot != -1) {
-        int i = first_empty_slot;
+    uint64_t hash_full = hash(key, key_len);
 
-        bucket->in_use[i] = true;
-        bucket->hashes[i] = hash_full;
-        bucket->values[i] = value; 
+    table_rehash_step(table, REHASH_STEPS_PER_OP);
+
+    size_t stripe = stripe_lock(table, hash_full, true);
 
-        ustrncpy(bucket->keys[i], key, KEY_MAX_LEN); 
+    hashtable_bucket_t* bucket = NULL;
 
-        atomic_fetch_add_explicit(&table->elem_count, 1, memory_order_relaxed);
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && slot_expired(bucket, i, table_now_seconds(table))) {
+        slot_expire(table, bucket, i);
+    } else if (i != -1) {
+        void* old_value = bucket->values[i];
+        bucket->values[i] = new_value;
+        slot_touch(table, bucket, i);
 
-        pthread_rwlock_unlock(&table->locks[bucket_index]);
+        atomic_fetch_add_explicit(&table->data_bytes, table_value_bytes(table, new_value), memory_order_relaxed);
+        atomic_fetch_sub_explicit(&table->data_bytes, table_value_bytes(table, old_value), memory_order_relaxed);
+        table_retire_value(table, old_value, value_destroyer);
+
+        stripe_unlock(table, stripe, true);
         return 0; 
     }
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
+    stripe_unlock(table, stripe, true);
     return -2; 
 }
 
-void* table_get(hashtable_t* table, const unsigned char* key, size_t (*value_sizer)(const void*)) {
-    if ((table == NULL) || (key == NULL) || (value_sizer == NULL)) {
-        return NULL;
+// Expiry
+
+int table_expire(hashtable_t* table, const unsigned char* key, size_t key_len, uint32_t ttl_seconds) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0) || (ttl_seconds == 0) || (ttl_seconds > TTL_MAX_SECONDS)) {
+        return -3;
     }
 
-    uint64_t hash_full = hash(key);
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
-    #else
-    size_t bucket_index = hash_full % table->buckets_count;
-    #endif
+    uint64_t hash_full = hash(key, key_len);
+    uint32_t now = table_now_seconds(table);
+    uint32_t expire_at = now + ttl_seconds;
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
+    size_t stripe = stripe_lock(table, hash_full, true);
 
-    if (pthread_rwlock_rdlock(&table->locks[bucket_index]) != 0) {
-        return NULL;
-    }
+    hashtable_bucket_t* bucket = NULL;
 
-    void* internal_value = NULL;
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && slot_expired(bucket, i, now)) {
+        slot_expire(table, bucket, i);
+    } else if (i != -1) {
+        slot_set_expiry(table, bucket, i, expire_at);
 
-    for (int i = 0; i < BUCKET_CAPACITY; i++) {
-        if (bucket->in_use[i] &&
-            bucket->hashes[i] == hash_full &&
-            ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0) {
+        stripe_unlock(table, stripe, true);
 
-            internal_value = bucket->values[i];
-            break;
-        }
+        table_schedule_expiry(table, hash_full, expire_at, now);
+        return 0;
     }
 
-    if (internal_value == NULL) {
-        pthread_rwlock_unlock(&table->locks[bucket_index]);
-        return NULL;
+    stripe_unlock(table, stripe, true);
+    return -1;
+}
+
+// Returns 0 when a TTL was removed, -1 for a missing key and -2 for a key without one.
+int table_persist(hashtable_t* table, const unsigned char* key, size_t key_len) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0)) {
+        return -3;
     }
 
-    size_t total_size = value_sizer(internal_value);
+    uint64_t hash_full = hash(key, key_len);
 
-    if (total_size == 0) {
-        pthread_rwlock_unlock(&table->locks[bucket_index]);
-        return NULL; 
-    }
+    size_t stripe = stripe_lock(table, hash_full, true);
 
-    void* value_copy = memdup(internal_value, total_size);
+    hashtable_bucket_t* bucket = NULL;
+    int status = -1;
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
-    return value_copy;
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && slot_expired(bucket, i, table_now_seconds(table))) {
+        slot_expire(table, bucket, i);
+    } else if (i != -1) {
+        status = (bucket->keys[i].expire_at != 0) ? 0 : -2;
+        slot_set_expiry(table, bucket, i, 0);
+    }
+
+    stripe_unlock(table, stripe, true);
+    return status;
 }
 
-int table_delete(hashtable_t* table, const unsigned char* key, void (*value_destroyer)(void*)) {
-    if ((table == NULL) || (key == NULL)) {
-        return -3; 
+int64_t table_ttl(hashtable_t* table, const unsigned char* key, size_t key_len) {
+    if ((table == NULL) || (key == NULL) || (key_len == 0)) {
+        return -2;
     }
 
-    uint64_t hash_full = hash(key);
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
-    #else
-    size_t bucket_index = hash_full % table->buckets_count;
-    #endif
+    uint64_t hash_full = hash(key, key_len);
+    uint32_t now = table_now_seconds(table);
 
-    if (pthread_rwlock_wrlock(&table->locks[bucket_index]) != 0) {
-        return -2; 
+    size_t stripe = stripe_lock(table, hash_full, false);
+
+    hashtable_bucket_t* bucket = NULL;
+    int64_t ttl = -2;
+
+    int i = table_find_slot(table, hash_full, key, key_len, &bucket);
+    if ((i != -1) && !slot_expired(bucket, i, now)) {
+        uint32_t expire_at = bucket->keys[i].expire_at;
+        ttl = (expire_at != 0) ? (int64_t)(expire_at - now) : -1;
+    }
+
+    stripe_unlock(table, stripe, false);
+    return ttl;
+}
+
+// Wheel entries are taken a batch at a time and the wheel lock is released
+// before the stripes are locked, so writers scheduling new expiries never
+// wait behind a long sweep.
+size_t table_expire_step(hashtable_t* table, size_t max_work) {
+    if (table == NULL) {
+        return 0;
     }
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
+    uint32_t now = table_now_seconds(table);
+    size_t work = 0;
 
-    for (int i = 0; i < BUCKET_CAPACITY; i++) {
-        if ((bucket->in_use[i]) &&
-            (bucket->hashes[i] == hash_full) &&
-            (ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0)) {
+    while (work < max_work) {
+        wheel_entry_t due[EXPIRE_BATCH];
+        size_t count = 0;
 
-            bucket->in_use[i] = 0; 
+        size_t budget = max_work - work;
+        size_t done = wheel_advance(&table->expiry_wheel, now, due, (budget < EXPIRE_BATCH) ? budget : EXPIRE_BATCH, &count);
+        if (done == 0) {
+            break;
+        }
 
-            if ((value_destroyer != NULL) && (bucket->values[i] != NULL)) {
-                value_destroyer(bucket->values[i]);
-            }
+        for (size_t i = 0; i < count; i++) {
+            table_remove_expired(table, due[i].id, now);
+        }
+        work += done;
+    }
+
+    return work;
+}
 
-            bucket->values[i] = NULL;
-            bucket->hashes[i] = 0; 
+static size_t bucket_chain_scan(hashtable_bucket_t* home, uint32_t now, table_scan_fn callback, void* scan_context) {
+    size_t seen = 0;
 
-            atomic_fetch_sub_explicit(&table->elem_count, 1, memory_order_relaxed);
+    for (hashtable_bucket_t* bucket = home; bucket != NULL; bucket = bucket->next) {
+        for (int j = 0; j < BUCKET_CAPACITY; j++) {
+            if ((bucket->ctrl[j] == CTRL_EMPTY) || slot_expired(bucket, j, now)) {
+                continue;
+            }
 
-            pthread_rwlock_unlock(&table->locks[bucket_index]);
-            return 0; 
+            callback(key_data(&bucket->keys[j]), bucket->keys[j].length, scan_context);
+            seen++;
         }
     }
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
-    return -1; 
+    return seen;
 }
 
-bool table_exist(hashtable_t* table, const unsigned char* key){
-    if ((table == NULL) || (key == NULL)){
-        return false;
+#if ENABLE_ONLY_POWER_2_SIZE
+// Increments the bits under mask starting from the highest one.
+static inline uint64_t scan_cursor_next(uint64_t cursor, uint64_t mask) {
+    cursor |= ~mask;
+    cursor = reverse_bits(cursor);
+    cursor++;
+    return reverse_bits(cursor);
+}
+#endif
+
+// Visits the buckets of one cursor position and returns the next cursor. The
+// stripe is picked from the cursor before the arrays are read, and every
+// bucket visited shares the cursor's low bits, so that stripe owns them all.
+static uint64_t table_scan_position(hashtable_t* table, uint64_t cursor, uint32_t now, size_t* seen,
+                                    table_scan_fn callback, void* scan_context) {
+    size_t stripe = stripe_lock(table, cursor, false);
+
+    bucket_array_t* small_array = table_array(table);
+    bucket_array_t* large_array = table_rehash_array(table);
+
+    if ((large_array != NULL) && (large_array->count < small_array->count)) {
+        bucket_array_t* swap = small_array;
+        small_array = large_array;
+        large_array = swap;
     }
 
-    uint64_t hash_full = hash(key);
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
+    hashtable_bucket_t* small = small_array->buckets;
+    size_t small_count = small_array->count;
+    hashtable_bucket_t* large = (large_array != NULL) ? large_array->buckets : NULL;
+    size_t large_count = (large_array != NULL) ? large_array->count : 0;
+
+    #if ENABLE_ONLY_POWER_2_SIZE
+    uint64_t small_mask = small_count - 1;
+    *seen += bucket_chain_scan(&small[cursor & small_mask], now, callback, scan_context);
+
+    if (large == NULL) {
+        cursor = scan_cursor_next(cursor, small_mask);
+    } else {
+        uint64_t large_mask = large_count - 1;
+        do {
+            *seen += bucket_chain_scan(&large[cursor & large_mask], now, callback, scan_context);
+            cursor = scan_cursor_next(cursor, large_mask);
+        } while ((cursor & (small_mask ^ large_mask)) != 0);
+    }
     #else
-    size_t bucket_index = hash_full % table->buckets_count;
+    // Plain indexes over the larger array: complete only without resizes
+    if (cursor < small_count) {
+        *seen += bucket_chain_scan(&small[cursor], now, callback, scan_context);
+    }
+    if ((large != NULL) && (cursor < large_count)) {
+        *seen += bucket_chain_scan(&large[cursor], now, callback, scan_context);
+    }
+    cursor = (cursor + 1 < ((large != NULL) ? large_count : small_count)) ? cursor + 1 : 0;
     #endif
 
-    if (pthread_rwlock_rdlock(&table->locks[bucket_index]) != 0){
-        return false; 
+    stripe_unlock(table, stripe, false);
+    return cursor;
+}
+
+uint64_t table_scan(hashtable_t* table, uint64_t cursor, size_t count, table_scan_fn callback, void* scan_context) {
+    if ((table == NULL) || (callback == NULL)) {
+        return 0;
     }
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
-    bool found = false; 
+    if (count == 0) {
+        count = 1;
+    }
 
-    for (int i = 0; i < BUCKET_CAPACITY; i++){
-        if (bucket->in_use[i] &&
-            bucket->hashes[i] == hash_full &&
-            ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0){
+    uint32_t now = table_now_seconds(table);
+    size_t empty_visits = count * SCAN_EMPTY_VISITS;
+    size_t seen = 0;
 
-            found = true;
-            break; 
-        }
-    }
+    do {
+        size_t before = seen;
+        cursor = table_scan_position(table, cursor, now, &seen, callback, scan_context);
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
+        if (seen == before) {
+            if (empty_visits == 0) {
+                break;
+            }
+            empty_visits--;
+        }
+    } while ((cursor != 0) && (seen < count));
 
-    return found;
+    return cursor;
 }
 
-int table_add(hashtable_t* table, const unsigned char* key, void* value){
-    if ((table == NULL) || (key == NULL)) {
-        return -1; 
-    }
-
-    uint64_t hash_full = hash(key);
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
-    #else
-    size_t bucket_index = hash_full % table->buckets_count;
-    #endif
+// Ordered index
 
-    if (pthread_rwlock_wrlock(&table->locks[bucket_index]) != 0) {
-        return -1; 
+int table_enable_ordered_index(hashtable_t* table) {
+    if ((table == NULL) || (table->ordered_index != NULL) || (table_total_elem(table) != 0)) {
+        return -1;
     }
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
-    int first_empty_slot = -1;
-
-    for (int i = 0; i < BUCKET_CAPACITY; i++){
-        if (bucket->in_use[i] &&
-            bucket->hashes[i] == hash_full &&
-            ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0){
+    table->ordered_index = skiplist_create();
+    return (table->ordered_index != NULL) ? 0 : -2;
+}
 
-            pthread_rwlock_unlock(&table->locks[bucket_index]);
-            return -3; 
-        }
+bool table_has_ordered_index(hashtable_t* table) {
+    return (table != NULL) && (table->ordered_index != NULL);
+}
 
-        if (!bucket->in_use[i] && first_empty_slot == -1) {
-            first_empty_slot = i;
-        }
+size_t table_range(hashtable_t* table, const unsigned char* start, size_t start_len, const unsigned char* end,
+                   size_t end_len, size_t limit, table_scan_fn callback, void* scan_context) {
+    if ((table == NULL) || (table->ordered_index == NULL) || (start == NULL) || (callback == NULL)) {
+        return 0;
     }
 
-    if (first_empty_slot != -1) {
-        int i = first_empty_slot;
+    uint32_t now = table_now_seconds(table);
+    skiplist_resume_t resume = { .more = false };
+    size_t found = 0;
 
-        bucket->in_use[i] = 1;
-        bucket->hashes[i] = hash_full;
-        ustrncpy(bucket->keys[i], key, KEY_MAX_LEN); 
-        bucket->values[i] = value;
+    // Each walk holds the index lock for a bounded number of nodes, so a run
+    // of expired keys is crossed in several, and only the real end of the
+    // range returns fewer than limit keys
+    do {
+        found += skiplist_range(table->ordered_index, start, start_len, end, end_len, now, limit - found, callback,
+                                scan_context, &resume);
+    } while (resume.more && (found < limit));
 
-        atomic_fetch_add_explicit(&table->elem_count, 1, memory_order_relaxed);
+    return found;
+}
 
-        pthread_rwlock_unlock(&table->locks[bucket_index]);
-        return 0; 
+size_t table_prefix(hashtable_t* table, const unsigned char* prefix, size_t prefix_len, size_t limit,
+                    table_scan_fn callback, void* scan_context) {
+    if ((table == NULL) || (table->ordered_index == NULL) || (prefix == NULL) || (callback == NULL)) {
+        return 0;
     }
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
-    return -2; 
+    uint32_t now = table_now_seconds(table);
+    skiplist_resume_t resume = { .more = false };
+    size_t found = 0;
+
+    do {
+        found += skiplist_prefix(table->ordered_index, prefix, prefix_len, now, limit - found, callback, scan_context,
+                                 &resume);
+    } while (resume.more && (found < limit));
+
+    return found;
 }
 
-int table_replace(hashtable_t* table, const unsigned char* key, void* new_value, void (*value_destroyer)(void*)) {
-    if ((table == NULL) || (key == NULL)) {
-        return -1; 
+// Inline values
+
+void* table_value_inline(const void* data, size_t len) {
+    if ((len > VALUE_INLINE_MAX) || ((data == NULL) && (len != 0))) {
+        return NULL;
     }
 
-    uint64_t hash_full = hash(key);
-    #if defined(ENABLE_ONLY_POWER_2_SIZE) && (ENABLE_ONLY_POWER_2_SIZE == 1)
-    size_t bucket_index = hash_full & (table->buckets_count - 1);
-    #else
-    size_t bucket_index = hash_full % table->buckets_count;
-    #endif
+    const unsigned char* bytes = data;
+    uintptr_t word = VALUE_INLINE_TAG | ((uintptr_t)len << 1);
 
-    if (pthread_rwlock_wrlock(&table->locks[bucket_index]) != 0) {
-        return -1; 
+    for (size_t i = 0; i < len; i++) {
+        word |= (uintptr_t)bytes[i] << (8 * (i + 1));
     }
 
-    hashtable_bucket_t* bucket = &table->buckets[bucket_index];
-
-    for (int i = 0; i < BUCKET_CAPACITY; i++) {
-        if (bucket->in_use[i] &&
-            bucket->hashes[i] == hash_full &&
-            ustrncmp(bucket->keys[i], key, KEY_MAX_LEN) == 0) {
+    return (void*)word;
+}
 
-            if (value_destroyer != NULL && bucket->values[i] != NULL) {
-                value_destroyer(bucket->values[i]);
-            }
+bool table_value_is_inline(const void* value) {
+    return ((uintptr_t)value & VALUE_INLINE_TAG) != 0;
+}
 
-            bucket->values[i] = new_value;
+size_t table_value_inline_read(const void* value, void* out) {
+    uintptr_t word = (uintptr_t)value;
+    size_t len = (word >> 1) & 0x7u;
+    unsigned char* bytes = out;
 
-            pthread_rwlock_unlock(&table->locks[bucket_index]);
-            return 0; 
-        }
+    for (size_t i = 0; i < len; i++) {
+        bytes[i] = (unsigned char)(word >> (8 * (i + 1)));
     }
 
-    pthread_rwlock_unlock(&table->locks[bucket_index]);
-    return -2; 
+    return len;
 }
 
 // Monitoring
@@ -507,7 +1837,7 @@ double table_load_factor(hashtable_t* table) {
         return 0.0;
     }
 
-    size_t capacity = table->buckets_count * BUCKET_CAPACITY;
+    size_t capacity = table_array(table)->count * BUCKET_CAPACITY;
     if (capacity == 0) {
         return 0.0;
     }
@@ -517,48 +1847,88 @@ double table_load_factor(hashtable_t* table) {
     return (double)count / (double)capacity;
 }
 
-  // Count
+bool table_is_rehashing(hashtable_t* table) {
+    if (table == NULL) {
+        return false;
+    }
 
+    return atomic_load_explicit(&table->rehashing, memory_order_relaxed);
+}
 
-size_t table_memory_usage(hashtable_t* table, size_t (*value_sizer)(const void* value)){
-    if (table == NULL){
-        return 0;
+double table_rehash_progress(hashtable_t* table) {
+    if (table == NULL) {
+        return 0.0;
     }
 
-    size_t total_size = 0;
-    total_size += sizeof(hashtable_t);
-    total_size += table->buckets_count * sizeof(hashtable_bucket_t);
-    total_size += table->lock_count * sizeof(pthread_rwlock_t);
+    size_t stripe = stripe_lock(table, 0, false);
 
-    if (value_sizer == NULL){
-        return total_size; 
+    double progress = 1.0;
+    bucket_array_t* drained = table_rehash_array(table);
+    if (drained != NULL) {
+        size_t moved = atomic_load_explicit(&table->rehash_index, memory_order_relaxed);
+        progress = (double)moved / (double)drained->count;
     }
 
-    for (size_t i = 0; i < table->buckets_count; i++){
-        if (pthread_rwlock_rdlock(&table->locks[i]) != 0){
-            fprintf(stderr, "[ERROR] table_memory_usage: Failed to acquire read lock on bucket %zu.\n", i);
+    stripe_unlock(table, stripe, false);
 
-            for (size_t k = 0; k < i; k++){
-                pthread_rwlock_unlock(&table->locks[k]);
-            }
+    return progress;
+}
 
-            return (size_t)-1; 
-        }
-    }
+  // Count
 
-    for (size_t i = 0; i < table->buckets_count; i++){
-        for (int j = 0; j < BUCKET_CAPACITY; j++) {
-            if (table->buckets[i].in_use[j] && 
-                table->buckets[i].values[j] != NULL) {
-                total_size += value_sizer(table->buckets[i].values[j]);
+static size_t bucket_array_value_usage(hashtable_bucket_t* buckets, size_t buckets_count,
+                                       size_t (*value_sizer)(const void* value)){
+    size_t total_size = 0;
+
+    for (size_t i = 0; i < buckets_count; i++){
+        for (hashtable_bucket_t* bucket = &buckets[i]; bucket != NULL; bucket = bucket->next) {
+            for (int j = 0; j < BUCKET_CAPACITY; j++) {
+                if (bucket->ctrl[j] == CTRL_EMPTY) {
+                    continue;
+                }
+
+                if (bucket->keys[j].length > KEY_INLINE_LEN) {
+                    total_size += bucket->keys[j].length;
+                }
+
+                if ((bucket->values[j] != NULL) && !table_value_is_inline(bucket->values[j])) {
+                    total_size += value_sizer(bucket->values[j]);
+                }
             }
         }
     }
-    
-    for (size_t i = 0; i < table->buckets_count; i++){
-        pthread_rwlock_unlock(&table->locks[i]);
+
+    return total_size;
+}
+
+size_t table_memory_usage(hashtable_t* table, size_t (*value_sizer)(const void* value)){
+    if (table == NULL){
+        return 0;
+    }
+
+    stripe_lock_all(table, false);
+
+    bucket_array_t* array = table_array(table);
+    bucket_array_t* rehash_array = table_rehash_array(table);
+
+    size_t total_size = 0;
+    total_size += sizeof(hashtable_t);
+    total_size += bucket_array_bytes(array->count);
+    total_size += (rehash_array != NULL) ? bucket_array_bytes(rehash_array->count) : 0;
+    total_size += atomic_load_explicit(&table->overflow_count, memory_order_relaxed) * sizeof(hashtable_bucket_t);
+    total_size += table->lock_count * sizeof(table_lock_t);
+    total_size += wheel_memory_usage(&table->expiry_wheel);
+    total_size += skiplist_memory_usage(table->ordered_index);
+
+    if (value_sizer != NULL){
+        total_size += bucket_array_value_usage(array->buckets, array->count, value_sizer);
+        if (rehash_array != NULL){
+            total_size += bucket_array_value_usage(rehash_array->buckets, rehash_array->count, value_sizer);
+        }
     }
 
+    stripe_unlock_all(table, false);
+
     return total_size;
 }
 
@@ -568,30 +1938,64 @@ size_t table_capacity(hashtable_t* table) {
         return 0; 
     }
 
-    return table->buckets_count * BUCKET_CAPACITY;
+    return table_array(table)->count * BUCKET_CAPACITY;
 }
 
 double table_occupied_bucket_counter(hashtable_t* table) {
-    if (table == NULL || table->buckets_count == 0) {
+    if (table == NULL) {
         return 0.0;
     }
 
+    stripe_lock_all(table, false);
+
+    bucket_array_t* array = table_array(table);
     size_t occupied_buckets = 0;
-    for (size_t i = 0; i < table->buckets_count; i++) {
-        if (pthread_rwlock_rdlock(&table->locks[i]) == 0) {
+    for (size_t i = 0; i < array->count; i++) {
+        bool occupied = false;
+        for (hashtable_bucket_t* bucket = &array->buckets[i]; (bucket != NULL) && !occupied; bucket = bucket->next) {
             for (int j = 0; j < BUCKET_CAPACITY; j++) {
-                if (table->buckets[i].in_use[j]) {
-                    occupied_buckets++;
+                if (bucket->ctrl[j] != CTRL_EMPTY) {
+                    occupied = true;
                     break;
                 }
             }
-            pthread_rwlock_unlock(&table->locks[i]);
         }
+        occupied_buckets += occupied ? 1 : 0;
     }
 
-    return (double)occupied_buckets / (double)table->buckets_count;
+    double ratio = (double)occupied_buckets / (double)array->count;
+
+    stripe_unlock_all(table, false);
+
+    return ratio;
 }
 
 size_t table_total_elem(hashtable_t* table){
     return atomic_load_explicit(&table->elem_count, memory_order_relaxed);
 }
+
+// Same parts as table_memory_usage, but kept up to date by the writers
+size_t table_used_memory(hashtable_t* table){
+    if (table == NULL){
+        return 0;
+    }
+
+    size_t overflow_bytes = atomic_load_explicit(&table->overflow_count, memory_order_relaxed) * sizeof(hashtable_bucket_t);
+
+    return sizeof(hashtable_t) + atomic_load_explicit(&table->bucket_bytes, memory_order_relaxed) + overflow_bytes +
+           (table->lock_count * sizeof(table_lock_t)) +
+           wheel_memory_usage(&table->expiry_wheel) + skiplist_memory_usage(table->ordered_index) +
+           atomic_load_explicit(&table->data_bytes, memory_order_relaxed);
+}
+
+size_t table_evicted_keys(hashtable_t* table){
+    return (table != NULL) ? atomic_load_explicit(&table->evicted_keys, memory_order_relaxed) : 0;
+}
+
+size_t table_evicted_bytes(hashtable_t* table){
+    return (table != NULL) ? atomic_load_explicit(&table->evicted_bytes, memory_order_relaxed) : 0;
+}
+
+size_t table_expired_keys(hashtable_t* table){
+    return (table != NULL) ? atomic_load_explicit(&table->expired_keys, memory_order_relaxed) : 0;
+}
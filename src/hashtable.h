@@ -4,9 +4,11 @@
 // INCLUDES
 
 #include <stdint.h>
-#include <pthread.h>
 #include <stdbool.h>
 #include "string_functionality.h"
+#include "lock_functionality.h"
+#include "timer_wheel_functionality.h"
+#include "skiplist_functionality.h"
 
 // MACRO
 
@@ -17,47 +19,285 @@
 
 #define ENABLE_ONLY_POWER_2_SIZE  1
 
+    // Control bytes (one per slot): 0 means empty, otherwise the high bit is set
+    // and the low 7 bits hold the top 7 bits of the key hash. Slots past
+    // BUCKET_CAPACITY stay empty so the whole word can be matched at once.
+    // Lookups always walk the full chain, so a deleted slot simply becomes empty.
+
+    #define BUCKET_CTRL_WIDTH     16
+    #define CTRL_EMPTY            0x00
+    #define CTRL_FULL             0x80
+
+    // Keys up to KEY_INLINE_LEN bytes live inside the slot, longer ones get
+    // an exact-size allocation referenced by the slot.
+
+    #define KEY_INLINE_LEN        16
+
+    // Values up to VALUE_INLINE_MAX bytes can be packed into the slot's
+    // value word itself: the low bit (never set in an allocation) tags it,
+    // bits 1-3 hold the length and the upper bytes the data. The table never
+    // hands such a value to a sizer or destroyer. 0 disables inlining.
+
+    #define VALUE_INLINE_MAX      7
+    #define VALUE_INLINE_TAG      0x1u
+
+    // Progressive rehash: buckets moved by each table operation, and how many
+    // empty buckets a step may skip per bucket of real work.
+
+    #define REHASH_STEPS_PER_OP   1
+    #define REHASH_EMPTY_VISITS   10
+
+    // Automatic resize defaults. Growing doubles and shrinking halves the bucket
+    // count, so the watermarks must stay more than 2x apart to avoid thrashing.
+
+    #define AUTORESIZE_GROW_LOAD      0.80
+    #define AUTORESIZE_SHRINK_LOAD    0.10
+    #define AUTORESIZE_GROW_OVERFLOW  0.15
+
+    // Lock stripes are independent of the bucket count: a key's stripe is
+    // picked from its hash, and each stripe sits on its own cache line.
+
+    #define LOCK_STRIPES_DEFAULT  1024
+
+    // GET and EXIST first try an optimistic read validated against the
+    // stripe's sequence counter, and only take the read lock after this many
+    // conflicting attempts. Writers retire what those readers may still
+    // reach (values, long keys, overflow buckets, drained arrays) through
+    // epoch_functionality instead of freeing it; table_destroy still frees
+    // directly and must not race with readers.
+
+    #define SEQLOCK_READ_RETRIES  8
+
+    // Eviction: once the table holds more than its max_memory, table_evict
+    // drops keys picked by comparing a few sampled from random buckets. Each
+    // slot keeps one access word: the clock in ms for LRU, or for LFU a
+    // logarithmic 8-bit counter under the minute it was last decayed.
+    // Readers update it with relaxed stores and never bump the sequence, so
+    // a lost update only makes the choice a little less accurate.
+
+    #define EVICTION_SAMPLES_DEFAULT  5
+    #define EVICTION_EMPTY_VISITS     10    // Empty buckets a sample may skip
+    #define LFU_INIT_COUNTER          5     // New keys are not the first to go
+    #define LFU_LOG_FACTOR            10    // Higher counts grow more slowly
+    #define LFU_DECAY_MINUTES         1     // Idle minutes per counter decrement
+
+    // Expiry: a key past its deadline, in whole seconds of the table clock,
+    // is never returned. Writers and reads that find one remove it on the
+    // spot, the others are reached by table_expire_step through a timer
+    // wheel holding (hash, deadline) pairs; a pair left behind by a newer
+    // TTL simply finds nothing to remove when it fires.
+
+    #define TTL_MAX_SECONDS           (UINT32_MAX / 2)
+    #define EXPIRE_BATCH              64    // Wheel entries taken per lock of the wheel
+
+    // Scan: a cursor is a bucket index counted in reverse binary order, the
+    // highest index bit incremented first. Doubling or halving the array
+    // only adds or drops high bits, so buckets already visited stay behind
+    // the cursor across resizes and a key present for the whole scan is
+    // returned at least once (possibly more). During a rehash every bucket
+    // of the larger array that expands from the cursor is visited with it,
+    // all under the one stripe owning them.
+
+    #define SCAN_EMPTY_VISITS         10    // Empty buckets a scan may skip per key asked for
+
+    // Ordered index: an optional skiplist over the keys, updated under the
+    // stripe lock of each insert, removal and TTL change, so a key is in the
+    // index exactly while it is in the table and its node knows when it
+    // expires. Lock order is stripe then index; range readers only take
+    // the index lock.
+
+    // Single owner: a table only ever touched by one thread at a time (a
+    // shard) takes no stripe locks, skips the optimistic reads and frees
+    // what it unlinks at once instead of going through the epoch. The
+    // index and the wheel keep their own locks, never contended then.
+
 // DATA
 
+typedef struct hashtable_key_t{
+    union{
+        unsigned char inline_data[KEY_INLINE_LEN];
+        unsigned char* heap_data;
+    };
+    uint8_t length;
+    uint32_t expire_at;            // Table clock second the key expires at, 0 for never; fills the padding
+} hashtable_key_t;
+
+_Static_assert(KEY_MAX_LEN <= UINT8_MAX + 1, "hashtable_key_t stores the key length in one byte");
+
 typedef struct __attribute__((aligned(64))) hashtable_bucket_t {
-    uint8_t in_use[BUCKET_CAPACITY];
-    uint64_t hashes[BUCKET_CAPACITY];
+    uint8_t ctrl[BUCKET_CTRL_WIDTH];
+    struct hashtable_bucket_t* next;   // Overflow chain, allocated only when every slot is in use
 
-    unsigned char keys[BUCKET_CAPACITY][KEY_MAX_LEN];
+    uint64_t hashes[BUCKET_CAPACITY];
     void* values[BUCKET_CAPACITY];
+
+    hashtable_key_t keys[BUCKET_CAPACITY];
+    _Atomic(uint32_t) access[BUCKET_CAPACITY];   // Eviction metadata, fits in the last line's padding
 } hashtable_bucket_t;
 
+// A bucket array and its size share one allocation, published through a
+// single pointer, so a reader that loads it always indexes with its count.
+typedef struct bucket_array_t{
+    size_t count;
+    hashtable_bucket_t buckets[];
+} bucket_array_t;
+
+_Static_assert(BUCKET_CAPACITY <= BUCKET_CTRL_WIDTH, "BUCKET_CAPACITY must fit in the control word");
+_Static_assert(VALUE_INLINE_MAX < sizeof(void*), "Inline values share the pointer word with their tag byte");
+
+
+// sequence is odd while a writer holds the stripe and bumped again on
+// release, so a reader that sees the same even value before and after its
+// probe knows nothing under the stripe changed in between.
+typedef struct __attribute__((aligned(64))) table_lock_t{
+    rwspinlock_t lock;
+    _Atomic(uint32_t) sequence;
+} table_lock_t;
+
+typedef struct hashtable_resize_policy_t{
+    bool enabled;
+    double grow_load_factor;       // Grow when elements per slot rise above this
+    double shrink_load_factor;     // Shrink when elements per slot fall below this
+    double grow_overflow_ratio;    // Grow when overflow buckets per bucket rise above this
+    size_t min_buckets;            // Never shrink below this bucket count
+} hashtable_resize_policy_t;
+
+typedef enum : uint8_t{
+    EVICTION_NONE,                 // Writes are refused once max_memory is reached
+    EVICTION_LRU,
+    EVICTION_LFU,
+    EVICTION_RANDOM
+} eviction_mode_t;
+
+typedef struct hashtable_eviction_policy_t{
+    eviction_mode_t mode;
+    size_t max_memory;             // Bytes, 0 for no limit
+    size_t samples;                // Keys compared for each eviction
+} hashtable_eviction_policy_t;
+
+// Called for each key under a read lock (stripe or index): it must be quick
+// and must not call back into the table.
+typedef void (*table_scan_fn)(const unsigned char* key, size_t key_len, void* scan_context);
 
 typedef struct hashtable_t{
-    hashtable_bucket_t* buckets;
-    size_t buckets_count;
+    _Atomic(bucket_array_t*) array;
     _Atomic(size_t) elem_count;
+    _Atomic(size_t) overflow_count;
+    _Atomic(size_t) bucket_bytes;        // Main and rehash arrays, kept for lock-free readers
 
-    pthread_rwlock_t* locks;
+    // While rehash_array is set the old array is drained into array one
+    // bucket at a time; rehash_index is the next old bucket to move. Both
+    // pointers change only under every stripe, and drained arrays are
+    // retired through the epoch.
+    _Atomic(bucket_array_t*) rehash_array;
+    _Atomic(size_t) rehash_index;
+    _Atomic(bool) rehashing;
+
+    table_lock_t* locks;
     size_t lock_count;
+    _Atomic(size_t) lock_mask;
+
+    hashtable_resize_policy_t policy;
+
+    // Sizes values for the memory accounting, set it before the first insert
+    size_t (*value_sizer)(const void* value);
+    // Frees the values of keys the table expires on its own
+    void (*value_destroyer)(void* value);
+
+    hashtable_eviction_policy_t eviction;
+    _Atomic(uint64_t) clock;             // ms, advanced by table_update_clock
+    _Atomic(size_t) data_bytes;          // Values and out-of-line keys held by the slots
+    _Atomic(size_t) evicted_keys;
+    _Atomic(size_t) evicted_bytes;
+
+    timer_wheel_t expiry_wheel;
+    _Atomic(size_t) expired_keys;
+
+    skiplist_t* ordered_index;           // NULL unless enabled
+    bool single_owner;
 } hashtable_t;
 
 // API
     
     // Lifecycle
-    hashtable_t* table_create(size_t initial_capacity);
+    hashtable_t* table_create(size_t initial_capacity, size_t lock_stripes);
     int table_destroy(hashtable_t* table, void (*value_destroyer)(void*));
     int table_clear(hashtable_t* table, void (*value_destroyer)(void*));
     int table_resize(hashtable_t* table, size_t new_capacity);
+    size_t table_rehash_step(hashtable_t* table, size_t steps);
+    int table_set_resize_policy(hashtable_t* table, const hashtable_resize_policy_t* policy);
+    int table_autoresize(hashtable_t* table);
+    void table_set_value_sizer(hashtable_t* table, size_t (*value_sizer)(const void* value));
+    void table_set_value_destroyer(hashtable_t* table, void (*value_destroyer)(void* value));
+    // Before the table is shared, and for good
+    void table_set_single_owner(hashtable_t* table);
+
+    // Eviction. table_evict drops at most max_keys keys while the table is
+    // over its limit and returns 0 once it is within it, 1 when it is still
+    // over and should be called again, -1 when nothing can be evicted.
+    int table_set_eviction_policy(hashtable_t* table, const hashtable_eviction_policy_t* policy);
+    void table_update_clock(hashtable_t* table, uint64_t now_ms);
+    int table_evict(hashtable_t* table, size_t max_keys, void (*value_destroyer)(void*));
+
+    // Core Ops, keys are (pointer, length) pairs and may contain any byte
+    int table_set(hashtable_t* table, const unsigned char* key, size_t key_len, void* value, void (*value_destroyer)(void*));
+    // table_get hands the stored value to value_copier while it cannot be
+    // freed and returns its result (a copy, or a new reference); inline
+    // values are returned as is.
+    void* table_get(hashtable_t* table, const unsigned char* key, size_t key_len, void* (*value_copier)(void*));
+    int table_delete(hashtable_t* table, const unsigned char* key, size_t key_len, void (*value_destroyer)(void*));
+    bool table_exist(hashtable_t* table, const unsigned char* key, size_t key_len);
+    int table_add(hashtable_t* table, const unsigned char* key, size_t key_len, void* value);
+    int table_replace(hashtable_t* table, const unsigned char* key, size_t key_len, void* new_value, void (*value_destroyer)(void*));
+
+    // Expiry. table_set_ex with a ttl of 0 is table_set, which clears any
+    // previous TTL; table_replace keeps it. table_ttl returns the seconds
+    // left, -1 for a key without expiry and -2 for a missing one.
+    // table_expire_step removes due keys, doing at most max_work units of
+    // wheel work, and returns the work done, 0 once nothing is due.
+    int table_set_ex(hashtable_t* table, const unsigned char* key, size_t key_len, void* value,
+                     void (*value_destroyer)(void*), uint32_t ttl_seconds);
+    int table_expire(hashtable_t* table, const unsigned char* key, size_t key_len, uint32_t ttl_seconds);
+    int table_persist(hashtable_t* table, const unsigned char* key, size_t key_len);
+    int64_t table_ttl(hashtable_t* table, const unsigned char* key, size_t key_len);
+    size_t table_expire_step(hashtable_t* table, size_t max_work);
+
+    // Iteration. Start from cursor 0 and pass back the cursor returned until
+    // it is 0 again. Each call visits whole buckets until about count keys
+    // have been seen, locking one stripe at a time; expired keys are skipped.
+    uint64_t table_scan(hashtable_t* table, uint64_t cursor, size_t count, table_scan_fn callback, void* scan_context);
+
+    // Ordered index, enabled while the table is still empty. table_range
+    // (inclusive bounds, end NULL for none) and table_prefix call back with
+    // at most limit live keys in order and return their number, fewer only
+    // at the end of the range. They take the index read lock for bounded
+    // stretches (see SKIPLIST_SCAN_FACTOR), so keys changed meanwhile may or
+    // may not be seen.
+    int table_enable_ordered_index(hashtable_t* table);
+    bool table_has_ordered_index(hashtable_t* table);
+    size_t table_range(hashtable_t* table, const unsigned char* start, size_t start_len, const unsigned char* end,
+                       size_t end_len, size_t limit, table_scan_fn callback, void* scan_context);
+    size_t table_prefix(hashtable_t* table, const unsigned char* prefix, size_t prefix_len, size_t limit,
+                        table_scan_fn callback, void* scan_context);
 
-    // Core Ops
-    int table_set(hashtable_t* table, const unsigned char* key, void* value, void (*value_destroyer)(void*));
-    void* table_get(hashtable_t* table, const unsigned char* key, size_t (*value_sizer)(const void*));
-    int table_delete(hashtable_t* table, const unsigned char* key, void (*value_destroyer)(void*));
-    bool table_exist(hashtable_t* table, const unsigned char* key);
-    int table_add(hashtable_t* table, const unsigned char* key, void* value);
-    int table_replace(hashtable_t* table, const unsigned char* key, void* new_value, void (*value_destroyer)(void*));
+    // Inline values: table_value_inline returns NULL when len is over
+    // VALUE_INLINE_MAX, table_value_inline_read copies the bytes out and
+    // returns their number.
+    void* table_value_inline(const void* data, size_t len);
+    bool table_value_is_inline(const void* value);
+    size_t table_value_inline_read(const void* value, void* out);
 
     // Monitoring
     size_t table_memory_usage(hashtable_t* table, size_t (*value_sizer)(const void* value));
+    size_t table_used_memory(hashtable_t* table);     // O(1) counterpart checked against max_memory
+    size_t table_evicted_keys(hashtable_t* table);
+    size_t table_evicted_bytes(hashtable_t* table);
+    size_t table_expired_keys(hashtable_t* table);
     size_t table_capacity(hashtable_t* table);
     double table_load_factor(hashtable_t* table);
     double table_occupied_bucket_counter(hashtable_t* table);
     size_t table_total_elem(hashtable_t* table);
+    bool table_is_rehashing(hashtable_t* table);
+    double table_rehash_progress(hashtable_t* table);
 
 #endif
@@ -0,0 +1,66 @@
+// Header
+#include "lock_functionality.h"
+#include <stdatomic.h>
+#include <sched.h>
+
+// Helper functions
+
+static inline void cpu_relax(unsigned int* spins){
+    if (++(*spins) < RWSPIN_SPINS_BEFORE_YIELD){
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #endif
+        return;
+    }
+
+    // The holder was probably preempted, let it run instead of burning its time slice
+    *spins = 0;
+    sched_yield();
+}
+
+// Reader/writer spinlock
+
+void rwspin_init(rwspinlock_t* lock){
+    atomic_init(lock, 0);
+}
+
+void rwspin_read_lock(rwspinlock_t* lock){
+    unsigned int spins = 0;
+
+    while (true){
+        uint32_t state = atomic_load_explicit(lock, memory_order_relaxed);
+
+        if (((state & (RWSPIN_WRITER | RWSPIN_PENDING)) == 0) &&
+            atomic_compare_exchange_weak_explicit(lock, &state, state + 1, memory_order_acquire, memory_order_relaxed)){
+            return;
+        }
+
+        cpu_relax(&spins);
+    }
+}
+
+void rwspin_read_unlock(rwspinlock_t* lock){
+    atomic_fetch_sub_explicit(lock, 1, memory_order_release);
+}
+
+void rwspin_write_lock(rwspinlock_t* lock){
+    unsigned int spins = 0;
+
+    while (true){
+        uint32_t state = atomic_load_explicit(lock, memory_order_relaxed);
+
+        if ((state & ~RWSPIN_PENDING) == 0){
+            if (atomic_compare_exchange_weak_explicit(lock, &state, RWSPIN_WRITER, memory_order_acquire, memory_order_relaxed)){
+                return;
+            }
+        } else if ((state & RWSPIN_PENDING) == 0){
+            atomic_fetch_or_explicit(lock, RWSPIN_PENDING, memory_order_relaxed);
+        }
+
+        cpu_relax(&spins);
+    }
+}
+
+void rwspin_write_unlock(rwspinlock_t* lock){
+    atomic_fetch_and_explicit(lock, ~RWSPIN_WRITER, memory_order_release);
+}
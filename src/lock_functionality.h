@@ -0,0 +1,32 @@
+#ifndef LOCK_FUNCTIONALITY_H
+#define LOCK_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Macro and Defines
+
+    // Reader/writer spinlock packed in 32 bits: the top bit marks the writer,
+    // the next one a writer waiting for readers to drain (new readers back off
+    // while it is set) and the remaining bits count the readers.
+
+    #define RWSPIN_WRITER         0x80000000u
+    #define RWSPIN_PENDING        0x40000000u
+    #define RWSPIN_SPINS_BEFORE_YIELD 128
+
+// Data
+
+typedef _Atomic(uint32_t) rwspinlock_t;
+
+// Public API
+
+    void rwspin_init(rwspinlock_t* lock);
+    void rwspin_read_lock(rwspinlock_t* lock);
+    void rwspin_read_unlock(rwspinlock_t* lock);
+    void rwspin_write_lock(rwspinlock_t* lock);
+    void rwspin_write_unlock(rwspinlock_t* lock);
+
+
+#endif
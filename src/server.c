@@ -1,38 +1,68 @@
+#define _DEFAULT_SOURCE   // SO_REUSEPORT
 #include <uv.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "command.h"
 #include "string_functionality.h"
+#include "epoch_functionality.h"
 #include "server.h"
 
+static void client_output_drop(client_context_t* ctx);
+
 void on_close_after_failure(uv_handle_t* handle) {
     free(handle->data);
     printf("[DEBUG] on_close_after_failure: Freed context after setup failure.\n");
 }
 
-void on_timer_close(uv_handle_t* handle){
-    client_context_t* ctx = (client_context_t*)handle->data;
+static void client_context_free(client_context_t* ctx){
     if (ctx->buffer) {
         free(ctx->buffer);
     }
     free(ctx);
-    printf("[DEBUG] on_timer_close: Timer closed. Client context freed.\n");
 }
 
-void free_parser_resources(client_context_t* ctx) {
-    if (ctx->temp_argv) {
-        for (size_t i = 0; i < ctx->args_parsed; i++) {
-            free(ctx->temp_argv[i]);
-        }
-        free(ctx->temp_argv);
-        ctx->temp_argv = NULL;
+static void client_link(client_context_t* ctx){
+    loop_context_t* loop_ctx = ctx->client_handle.loop->data;
+
+    ctx->clients_prev = NULL;
+    ctx->clients_next = loop_ctx->clients;
+    if (loop_ctx->clients != NULL) {
+        loop_ctx->clients->clients_prev = ctx;
     }
-    if (ctx->temp_arg_lengths) {
-        free(ctx->temp_arg_lengths);
-        ctx->temp_arg_lengths = NULL;
+    loop_ctx->clients = ctx;
+}
+
+static void client_unlink(client_context_t* ctx){
+    loop_context_t* loop_ctx = ctx->client_handle.loop->data;
+
+    if (ctx->clients_prev != NULL) {
+        ctx->clients_prev->clients_next = ctx->clients_next;
+    } else {
+        loop_ctx->clients = ctx->clients_next;
     }
+    if (ctx->clients_next != NULL) {
+        ctx->clients_next->clients_prev = ctx->clients_prev;
+    }
+
+    ctx->clients_prev = NULL;
+    ctx->clients_next = NULL;
+}
+
+void free_parser_resources(client_context_t* ctx) {
+    destroy_value_wrapper(ctx->value);
+    ctx->value = NULL;
+
+    free(ctx->arg_offsets);
+    free(ctx->arg_lengths);
+    free(ctx->argv);
+    ctx->arg_offsets = NULL;
+    ctx->arg_lengths = NULL;
+    ctx->argv = NULL;
+    ctx->args_capacity = 0;
 }
 
 void reset_parser(client_context_t* ctx) {
@@ -40,6 +70,8 @@ void reset_parser(client_context_t* ctx) {
     ctx->args_total = 0;
     ctx->args_parsed = 0;
     ctx->data_to_read = 0;
+    ctx->command_parsed = 0;
+    ctx->value_received = 0;
 }
 
 
@@ -47,94 +79,627 @@ void on_client_close(uv_handle_t* handle){
     client_context_t* ctx = handle->data;
     printf("[DEBUG] on_client_close: Client stream closed.\n");
 
-    if (!uv_is_closing((uv_handle_t*)&ctx->inactivity_timer)){
-        printf("[DEBUG] on_client_close: Closing associated timer.\n");
-        uv_close((uv_handle_t*)&ctx->inactivity_timer, on_timer_close);
-    }
-
+    client_unlink(ctx);
+    client_output_drop(ctx);
     free_parser_resources(ctx);
     reset_parser(ctx);
+    ctx->closed = true;
+
+    // The last reply still owed by a shard frees it instead
+    if (ctx->replies_head != NULL) {
+        return;
+    }
+
+    client_context_free(ctx);
+}
+
+// Closes the clients that have not sent anything for INACTIVITY_TIMEOUT.
+static void on_idle_sweep(uv_timer_t* timer){
+    loop_context_t* loop_ctx = timer->data;
+    uint64_t now = uv_now(timer->loop);
+
+    for (client_context_t* ctx = loop_ctx->clients; ctx != NULL; ctx = ctx->clients_next) {
+        if ((now - ctx->last_activity >= INACTIVITY_TIMEOUT) && !uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+            printf("[INFO] on_idle_sweep: Inactive client. Closing connection.\n");
+            uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+        }
+    }
 }
 
-void on_client_timeout(uv_timer_t* timer){
-    client_context_t* ctx = timer->data;
-    printf("[INFO] on_client_timeout: Inactive client. Closing connection.\n");
-    uv_close((uv_handle_t*)&(ctx->client_handle), on_client_close);
+static void write_req_release(write_req_t* wr){
+    for (size_t i = 0; i < wr->count; i++) {
+        free(wr->replies[i].body);
+        destroy_value_wrapper(wr->replies[i].value);
+    }
+
+    free(wr->replies);
+    free(wr);
 }
 
 void on_write_complete(uv_write_t* req, int status){
     write_req_t* wr = (write_req_t*)req;
-    free(wr->buf.base);
-    free(wr);
+    uv_handle_t* handle = (uv_handle_t*)req->handle;
 
-    if (status < 0) {
+    write_req_release(wr);
+
+    if ((status < 0) && !uv_is_closing(handle)) {
         fprintf(stderr, "[ERROR] on_write_complete: '%s'.\n", uv_strerror(status));
-        uv_close((uv_handle_t*)req->handle, on_client_close);
+        uv_close(handle, on_client_close);
     }
 }
 
-void alloc_buffer(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf){
-    (void)handle;
-    buf->base = (char*)malloc(suggested_size);
-    buf->len = (buf->base != NULL) ? suggested_size : 0;
+static void client_pending_unlink(client_context_t* ctx){
+    loop_context_t* loop_ctx = ctx->client_handle.loop->data;
+
+    if (ctx->pending_prev != NULL) {
+        ctx->pending_prev->pending_next = ctx->pending_next;
+    } else {
+        loop_ctx->pending = ctx->pending_next;
+    }
+    if (ctx->pending_next != NULL) {
+        ctx->pending_next->pending_prev = ctx->pending_prev;
+    }
+
+    ctx->pending_prev = NULL;
+    ctx->pending_next = NULL;
 }
 
+// Releases the replies gathered and not written, for a closing client.
+static void client_output_drop(client_context_t* ctx){
+    if (ctx->output == NULL) {
+        return;
+    }
 
+    client_pending_unlink(ctx);
+    write_req_release(ctx->output);
+    ctx->output = NULL;
+}
 
-void append_to_buffer(client_context_t* ctx, const char* data, size_t len) {
-    if (ctx->buffer_used + len > ctx->buffer_capacity) {
-        size_t new_capacity = (ctx->buffer_capacity == 0) ? 1024 : ctx->buffer_capacity * 2;
-        if (new_capacity < ctx->buffer_used + len) {
-            new_capacity = ctx->buffer_used + len;
+// Makes room for one more reply, starting a batch on the first one.
+static write_req_t* client_output_reserve(client_context_t* ctx){
+    write_req_t* wr = ctx->output;
+    if ((wr != NULL) && (wr->count < wr->capacity)) {
+        return wr;
+    }
+
+    size_t capacity = (wr != NULL) ? wr->capacity * 2 : REPLY_BATCH_INITIAL;
+
+    // Not handed to libuv yet, it can still move
+    write_req_t* grown = realloc(wr, sizeof(write_req_t) + 3 * capacity * sizeof(uv_buf_t));
+    if (grown == NULL) {
+        return NULL;
+    }
+
+    if (wr == NULL) {
+        grown->count = 0;
+        grown->capacity = 0;
+        grown->replies = NULL;
+
+        loop_context_t* loop_ctx = ctx->client_handle.loop->data;
+        ctx->pending_prev = NULL;
+        ctx->pending_next = loop_ctx->pending;
+        if (loop_ctx->pending != NULL) {
+            loop_ctx->pending->pending_prev = ctx;
+        }
+        loop_ctx->pending = ctx;
+    }
+    ctx->output = grown;
+
+    write_reply_t* replies = realloc(grown->replies, capacity * sizeof(write_reply_t));
+    if (replies == NULL) {
+        return NULL;
+    }
+    grown->replies = replies;
+    grown->capacity = capacity;
+
+    return grown;
+}
+
+// Writes the gathered replies with a single request.
+static int client_flush_output(client_context_t* ctx){
+    write_req_t* wr = ctx->output;
+    if (wr == NULL) {
+        return 0;
+    }
+
+    client_pending_unlink(ctx);
+    ctx->output = NULL;
+
+    // The replies no longer move, their frames can be pointed at
+    unsigned int nbufs = 0;
+    for (size_t i = 0; i < wr->count; i++) {
+        write_reply_t* reply = &wr->replies[i];
+
+        wr->bufs[nbufs++] = uv_buf_init(reply->frame, reply->frame_length);
+        if (reply->payload_length > 0) {
+            wr->bufs[nbufs++] = uv_buf_init((char*)reply->payload, (unsigned int)reply->payload_length);
+        }
+        if (reply->trailer) {
+            wr->bufs[nbufs++] = uv_buf_init((char*)REPLY_TRAILER, sizeof(REPLY_TRAILER) - 1);
         }
-        char* new_buffer = realloc(ctx->buffer, new_capacity);
-        if (new_buffer == NULL) {
-            fprintf(stderr, "[ERROR] Failed to realloc client buffer\n");
+    }
+
+    int status = uv_write((uv_write_t*)wr, (uv_stream_t*)&ctx->client_handle, wr->bufs, nbufs, on_write_complete);
+    if (status < 0) {
+        fprintf(stderr, "[ERROR] client_flush_output: '%s'.\n", uv_strerror(status));
+        write_req_release(wr);
+        return -1;
+    }
+
+    return 0;
+}
+
+static const char* reply_error_code(int status_code){
+    switch (status_code) {
+        case 503: return "BUSY";
+        case 505: return "NOPROTO";
+        case 507: return "OOM";
+        default:  return "ERR";
+    }
+}
+
+// Writes the frame of the reply in the given RESP version. A payload that
+// fits is copied in along with its trailer, and released right away.
+static void reply_encode(write_reply_t* reply, execute_result_t* result, uint8_t protocol){
+    bool resp3 = (protocol >= 3);
+    bool has_payload = true;
+    int written;
+
+    switch (result->type) {
+        case REPLY_STATUS:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, "+");
+            break;
+        case REPLY_ERROR:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, "-%s ", reply_error_code(result->status_code));
+            break;
+        case REPLY_INTEGER:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, ":%" PRId64 "\r\n", result->integer);
+            has_payload = false;
+            break;
+        case REPLY_DOUBLE:
+            written = resp3 ? snprintf(reply->frame, REPLY_FRAME_ROOM, ",")
+                            : snprintf(reply->frame, REPLY_FRAME_ROOM, "$%zu\r\n", result->body_length);
+            break;
+        case REPLY_NULL:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, "%s", resp3 ? "_\r\n" : "$-1\r\n");
+            has_payload = false;
+            break;
+        case REPLY_ARRAY:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, "*%zu\r\n", result->count);
+            break;
+        case REPLY_MAP:
+            written = resp3 ? snprintf(reply->frame, REPLY_FRAME_ROOM, "%%%zu\r\n", result->count)
+                            : snprintf(reply->frame, REPLY_FRAME_ROOM, "*%zu\r\n", 2 * result->count);
+            break;
+        case REPLY_BULK:
+        default:
+            written = snprintf(reply->frame, REPLY_FRAME_ROOM, "$%zu\r\n", result->body_length);
+            break;
+    }
+
+    reply->frame_length = (uint8_t)written;
+    reply->payload = !has_payload ? NULL : (result->value != NULL) ? result->value->data : result->body;
+    reply->payload_length = has_payload ? result->body_length : 0;
+
+    // Arrays and maps hold their elements framed already
+    reply->trailer = has_payload && (result->type != REPLY_ARRAY) && (result->type != REPLY_MAP);
+
+    size_t tail = reply->payload_length + (reply->trailer ? sizeof(REPLY_TRAILER) - 1 : 0);
+    if (tail > (size_t)(REPLY_FRAME_ROOM - reply->frame_length)) {
+        reply->body = result->body;
+        reply->value = result->value;
+        return;
+    }
+
+    if (reply->payload_length > 0) {
+        memcpy(reply->frame + reply->frame_length, reply->payload, reply->payload_length);
+    }
+    if (reply->trailer) {
+        memcpy(reply->frame + reply->frame_length + reply->payload_length, REPLY_TRAILER, sizeof(REPLY_TRAILER) - 1);
+    }
+    reply->frame_length = (uint8_t)(reply->frame_length + tail);
+    reply->payload = NULL;
+    reply->payload_length = 0;
+    reply->trailer = false;
+
+    reply->body = NULL;
+    reply->value = NULL;
+    free_execute_result(result);
+}
+
+// Adds the reply, encoded in the given RESP version, to those the client gets
+// once the loop is done with its events. Takes ownership of its body or value
+// reference, also on failure.
+static int client_queue_reply(client_context_t* ctx, execute_result_t* result, uint8_t protocol){
+    bool err;
+
+    sizet_to_uint(result->body_length, &err);
+    if (err) {
+        fprintf(stderr, "[ERROR] client_queue_reply: Response length conversion failed.\n");
+        free_execute_result(result);
+        return -1;
+    }
+
+    write_req_t* wr = client_output_reserve(ctx);
+    if (wr == NULL) {
+        fprintf(stderr, "[ERROR] client_queue_reply: Failed to allocate write request.\n");
+        free_execute_result(result);
+        return -1;
+    }
+
+    reply_encode(&wr->replies[wr->count], result, protocol);
+    wr->count++;
+
+    if (wr->count == REPLY_BATCH_MAX) {
+        return client_flush_output(ctx);
+    }
+
+    return 0;
+}
+
+int send_reply(client_context_t* ctx, execute_result_t* result){
+    return client_queue_reply(ctx, result, ctx->protocol);
+}
+
+static void on_loop_flush(uv_prepare_t* handle){
+    loop_context_t* loop_ctx = handle->data;
+
+    // Each flush takes the client off the list
+    while (loop_ctx->pending != NULL) {
+        client_context_t* ctx = loop_ctx->pending;
+
+        if (uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+            client_output_drop(ctx);
+        } else if (client_flush_output(ctx) != 0) {
             uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
-            return;
         }
-        ctx->buffer = new_buffer;
-        ctx->buffer_capacity = new_capacity;
     }
-    memcpy(ctx->buffer + ctx->buffer_used, data, len);
-    ctx->buffer_used += len;
 }
 
+int loop_context_start(uv_loop_t* loop, loop_context_t* loop_ctx){
+    loop_ctx->pending = NULL;
+    loop_ctx->clients = NULL;
+
+    if (uv_prepare_init(loop, &loop_ctx->flush) != 0) {
+        fprintf(stderr, "[ERROR] loop_context_start: Failed to create the reply flush.\n");
+        return -1;
+    }
+    loop_ctx->flush.data = loop_ctx;
+
+    uv_prepare_start(&loop_ctx->flush, on_loop_flush);
+    uv_unref((uv_handle_t*)&loop_ctx->flush);
+
+    if (uv_timer_init(loop, &loop_ctx->idle_sweep) != 0) {
+        fprintf(stderr, "[ERROR] loop_context_start: Failed to create the idle sweep.\n");
+        uv_close((uv_handle_t*)&loop_ctx->flush, NULL);
+        return -1;
+    }
+    loop_ctx->idle_sweep.data = loop_ctx;
+
+    uv_timer_start(&loop_ctx->idle_sweep, on_idle_sweep, IDLE_SWEEP_INTERVAL, IDLE_SWEEP_INTERVAL);
+    uv_unref((uv_handle_t*)&loop_ctx->idle_sweep);
+
+    loop->data = loop_ctx;
+    return 0;
+}
+
+// Passes on the replies that are ready in request order, stopping at the
+// first one a shard still owes; those of a closing client are dropped.
+static void client_flush_replies(client_context_t* ctx){
+    while ((ctx->replies_head != NULL) && ctx->replies_head->done) {
+        shard_request_t* request = ctx->replies_head;
+        ctx->replies_head = request->next;
+        if (ctx->replies_head == NULL) {
+            ctx->replies_tail = NULL;
+        }
+
+        if (uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+            free_execute_result(&request->reply);
+        } else if (client_queue_reply(ctx, &request->reply, request->protocol) != 0) {
+            uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+        }
+
+        shard_request_free(request);
+    }
+
+    if (ctx->closed && (ctx->replies_head == NULL)) {
+        client_context_free(ctx);
+    }
+}
+
+static void on_shard_reply(shard_request_t* request){
+    client_flush_replies(request->owner);
+}
+
+static void client_enqueue(client_context_t* ctx, shard_request_t* request){
+    if (ctx->replies_tail != NULL) {
+        ctx->replies_tail->next = request;
+    } else {
+        ctx->replies_head = request;
+    }
+    ctx->replies_tail = request;
+
+    // Requests refused on the spot are done already
+    client_flush_replies(ctx);
+}
+
+static int client_dispatch(client_context_t* ctx, const char* command_name, int argc, char* argv[],
+                           const size_t args_lengths[], data_entry_t* value){
+    shard_request_t* request = shard_submit(ctx->server_ctx->shards, ctx, command_name, argc, argv, args_lengths,
+                                            value);
+    if (request == NULL) {
+        fprintf(stderr, "[ERROR] client_dispatch: Failed to allocate a shard request.\n");
+        return -1;
+    }
+
+    request->protocol = ctx->protocol;
+    client_enqueue(ctx, request);
+    return 0;
+}
+
+// The HELLO reply, a map describing the server
+static execute_result_t hello_reply(uint8_t protocol){
+    char text[256];
+    int written = snprintf(text, sizeof(text),
+                           "$6\r\nserver\r\n$%zu\r\n%s\r\n$7\r\nversion\r\n$%zu\r\n%s\r\n$5\r\nproto\r\n:%d\r\n",
+                           sizeof(SERVER_NAME) - 1, SERVER_NAME, sizeof(SERVER_VERSION) - 1, SERVER_VERSION, protocol);
+    if ((written < 0) || ((size_t)written >= sizeof(text))) {
+        return create_error_response(500, "Failed to format HELLO result");
+    }
+
+    unsigned char* body = malloc((size_t)written);
+    if (body == NULL) {
+        return create_error_response(500, TCP_MEMORY_ERROR);
+    }
+    memcpy(body, text, (size_t)written);
+
+    return (execute_result_t){ .status_code = 200, .type = REPLY_MAP, .count = 3, .body = body,
+                               .body_length = (size_t)written };
+}
+
+// HELLO [protover] switches the client to another RESP version, starting
+// with its own reply; the replies still owed keep the version they were
+// asked in.
+static int client_hello(client_context_t* ctx, int argc, char* argv[]){
+    uint8_t protocol = ctx->protocol;
+    execute_result_t reply;
+
+    if (argc > 1) {
+        reply = create_error_response(400, "Syntax error, expected HELLO [protover]");
+    } else {
+        size_t version = (argc == 1) ? stosizet(argv[0]) : protocol;
+        if ((version < RESP_DEFAULT_VERSION) || (version > RESP_MAX_VERSION)) {
+            reply = create_error_response(505, "Unsupported protocol version");
+        } else {
+            protocol = (uint8_t)version;
+            reply = hello_reply(protocol);
+        }
+    }
+
+    if (ctx->server_ctx->shards != NULL) {
+        shard_request_t* request = shard_request_ready(ctx, reply);
+        if (request == NULL) {
+            fprintf(stderr, "[ERROR] client_hello: Failed to allocate a shard request.\n");
+            free_execute_result(&reply);
+            return -1;
+        }
+
+        request->protocol = protocol;
+        client_enqueue(ctx, request);
+    } else if (client_queue_reply(ctx, &reply, protocol) != 0) {
+        return -1;
+    }
+
+    ctx->protocol = protocol;
+    return 0;
+}
+
+// Makes room for at least spare more bytes after the pending ones.
+static int client_buffer_reserve(client_context_t* ctx, size_t spare){
+    if (ctx->buffer_capacity - ctx->buffer_used >= spare) {
+        return 0;
+    }
+
+    size_t new_capacity = ctx->buffer_capacity * 2;
+    if (new_capacity < ctx->buffer_used + spare) {
+        new_capacity = ctx->buffer_used + spare;
+    }
+
+    char* new_buffer = realloc(ctx->buffer, new_capacity);
+    if (new_buffer == NULL) {
+        return -1;
+    }
+    ctx->buffer = new_buffer;
+    ctx->buffer_capacity = new_capacity;
+    return 0;
+}
+
+// Sizes the buffer after its pending bytes: an empty one is released and
+// one far larger than they need is cut back.
+static void client_buffer_fit(client_context_t* ctx){
+    if (ctx->buffer_used == 0) {
+        free(ctx->buffer);
+        ctx->buffer = NULL;
+        ctx->buffer_capacity = 0;
+        return;
+    }
+
+    size_t needed = ctx->buffer_used + CLIENT_READ_MIN;
+    if (ctx->buffer_capacity > CLIENT_BUFFER_SLACK * needed) {
+        char* new_buffer = realloc(ctx->buffer, needed);
+        if (new_buffer != NULL) {
+            ctx->buffer = new_buffer;
+            ctx->buffer_capacity = needed;
+        }
+    }
+}
+
+// Where the next read goes: the missing part of a value being streamed,
+// the room after an incomplete command, or the loop's buffer when the
+// client has nothing pending.
+void alloc_buffer(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf){
+    client_context_t* ctx = handle->data;
+    loop_context_t* loop_ctx = handle->loop->data;
+    (void)suggested_size;
+
+    if ((ctx->state == PARSE_STATE_EXPECT_VALUE) && (ctx->value_received < ctx->value->size)) {
+        *buf = uv_buf_init((char*)ctx->value->data + ctx->value_received,
+                           (unsigned int)(ctx->value->size - ctx->value_received));
+        return;
+    }
+
+    if (ctx->buffer_used == 0) {
+        *buf = uv_buf_init(loop_ctx->read_buffer, sizeof(loop_ctx->read_buffer));
+        return;
+    }
+
+    // Without room the read fails with UV_ENOBUFS and the client is closed
+    if (client_buffer_reserve(ctx, CLIENT_READ_MIN) != 0) {
+        fprintf(stderr, "[ERROR] alloc_buffer: Failed to grow the client buffer.\n");
+        *buf = uv_buf_init(NULL, 0);
+        return;
+    }
+
+    *buf = uv_buf_init(ctx->buffer + ctx->buffer_used, (unsigned int)(ctx->buffer_capacity - ctx->buffer_used));
+}
+
+// Grows the argument views to hold a command of args_total arguments.
+static int parser_reserve_args(client_context_t* ctx, size_t args_total){
+    if (args_total <= ctx->args_capacity) {
+        return 0;
+    }
+
+    size_t* offsets = realloc(ctx->arg_offsets, args_total * sizeof(size_t));
+    if (offsets == NULL) {
+        return -1;
+    }
+    ctx->arg_offsets = offsets;
+
+    size_t* lengths = realloc(ctx->arg_lengths, args_total * sizeof(size_t));
+    if (lengths == NULL) {
+        return -1;
+    }
+    ctx->arg_lengths = lengths;
+
+    char** argv = realloc(ctx->argv, args_total * sizeof(char*));
+    if (argv == NULL) {
+        return -1;
+    }
+    ctx->argv = argv;
+
+    ctx->args_capacity = args_total;
+    return 0;
+}
+
+// Drops the complete commands from the front of the buffer, the one still
+// incomplete keeps its offsets since they count from its own first byte.
+static void parser_compact(client_context_t* ctx){
+    if (ctx->buffer_parsed == 0) {
+        return;
+    }
+
+    ctx->buffer_used -= ctx->buffer_parsed;
+    if (ctx->buffer_used > 0) {
+        memmove(ctx->buffer, ctx->buffer + ctx->buffer_parsed, ctx->buffer_used);
+    }
+    ctx->buffer_parsed = 0;
+}
+
+// Runs the command once its last argument is parsed. Non-zero when the
+// client is closing and the buffer must be left alone.
+static int parser_dispatch(client_context_t* ctx, char* command_start){
+    bool err;
+
+    for (size_t i = 0; i < ctx->args_total; i++) {
+        ctx->argv[i] = command_start + ctx->arg_offsets[i];
+    }
+
+    // The streamed value is handed over, it is not in the buffer
+    data_entry_t* value = ctx->value;
+    if (value != NULL) {
+        ctx->argv[VALUE_ARG_INDEX] = (char*)value->data;
+        ctx->value = NULL;
+    }
+
+    char* command_name = ctx->argv[0];
+    int argc = sizet_to_int(ctx->args_total - 1, &err);
+    if (err) {
+        fprintf(stderr, "[ERROR] parser_dispatch: Argument count conversion failed.\n");
+        destroy_value_wrapper(value);
+        uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+        return -1;
+    }
+
+    char** command_argv = (argc > 0) ? &ctx->argv[1] : NULL;
+    const size_t* args_lengths = (argc > 0) ? &ctx->arg_lengths[1] : NULL;
+
+    int status;
+    if (strcmp(command_name, "HELLO") == 0) {
+        status = client_hello(ctx, argc, command_argv);
+    } else if (ctx->server_ctx->shards != NULL) {
+        status = client_dispatch(ctx, command_name, argc, command_argv, args_lengths, value);
+    } else {
+        execute_result_t result = execute_command(ctx->server_ctx, command_name, argc, command_argv, args_lengths,
+                                                  value);
+        status = send_reply(ctx, &result);
+    }
+
+    if (status != 0) {
+        uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+        return -1;
+    }
+
+    // A reply that failed to go out closed the client already
+    if (uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+        return -1;
+    }
+
+    ctx->buffer_parsed += ctx->command_parsed;
+    reset_parser(ctx);
+    return 0;
+}
+
+// Runs every complete command in the buffer. Nothing is moved or copied
+// while parsing: arguments are handed to the command where they were read.
 void parse_buffer(client_context_t* ctx) {
     bool err;
 
     while (true) {
+        char* command_start = ctx->buffer + ctx->buffer_parsed;
+        char* cursor = command_start + ctx->command_parsed;
+        size_t available = ctx->buffer_used - ctx->buffer_parsed - ctx->command_parsed;
+
         if (ctx->state == PARSE_STATE_EXPECT_TYPE){
             size_t leading_whitespace = 0;
-            while (leading_whitespace < ctx->buffer_used &&
-                   (ctx->buffer[leading_whitespace] == '\r' || ctx->buffer[leading_whitespace] == '\n')){
+            while (leading_whitespace < available &&
+                   (cursor[leading_whitespace] == '\r' || cursor[leading_whitespace] == '\n')){
                 leading_whitespace++;
             }
 
-            if (leading_whitespace > 0){
-                memmove(ctx->buffer, ctx->buffer + leading_whitespace, ctx->buffer_used - leading_whitespace);
-                ctx->buffer_used -= leading_whitespace;
-            }
+            // Nothing of the command is parsed yet, it can start past them
+            ctx->buffer_parsed += leading_whitespace;
+            cursor += leading_whitespace;
+            available -= leading_whitespace;
 
-            if (ctx->buffer_used < 1){
+            if (available < 1){
                 break;
             }
 
-            if (ctx->buffer[0] != '*'){
+            if (cursor[0] != '*'){
                 fprintf(stderr,
                         "[ERROR] parse_buffer: Expected '*' for array type, but got '%c' (ASCII: %d).\n",
-                        ctx->buffer[0],
-                        ctx->buffer[0]);
+                        cursor[0],
+                        cursor[0]);
                 uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
                 return;
             }
 
-            char* crlf = memchr(ctx->buffer, '\r', ctx->buffer_used);
-            if (!crlf || (crlf + 1 >= ctx->buffer + ctx->buffer_used) || *(crlf + 1) != '\n') {
-                break; 
+            char* crlf = memchr(cursor, '\r', available);
+            if (!crlf || (crlf + 1 >= cursor + available) || *(crlf + 1) != '\n') {
+                break;
             }
 
-            long n_args = strtol(ctx->buffer + 1, NULL, 10);
+            long n_args = strtol(cursor + 1, NULL, 10);
             if (n_args <= 0 || n_args > 1024) {
                 fprintf(stderr, "[ERROR] parse_buffer: Invalid number of arguments: %ld\n", n_args);
                 uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
@@ -148,30 +713,37 @@ void parse_buffer(client_context_t* ctx) {
                 return;
             }
 
+            if (parser_reserve_args(ctx, ctx->args_total) != 0) {
+                fprintf(stderr, "[ERROR] parse_buffer: Failed to allocate memory for command arguments.\n");
+                uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+                return;
+            }
+
             ctx->args_parsed = 0;
             ctx->state = PARSE_STATE_EXPECT_LENGTH;
-
-            size_t consumed = (size_t)((crlf + 2) - ctx->buffer);
-            memmove(ctx->buffer, ctx->buffer + consumed, ctx->buffer_used - consumed);
-            ctx->buffer_used -= consumed;
+            ctx->command_parsed += (size_t)((crlf + 2) - cursor);
 
         } else if (ctx->state == PARSE_STATE_EXPECT_LENGTH){
-            if (ctx->buffer_used > 0 && ctx->buffer[0] != '$') {
+            if (available > 0 && cursor[0] != '$') {
                 fprintf(stderr, "[ERROR] parse_buffer: Expected '$' for bulk string length.\n");
                 uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
-                return; 
+                return;
             }
-            if (ctx->buffer_used < 1){
-                break; 
+            if (available < 1){
+                break;
             }
 
-            char* crlf = memchr(ctx->buffer, '\r', ctx->buffer_used);
-            if ((crlf == NULL) || (crlf + 1 >= ctx->buffer + ctx->buffer_used) || *(crlf + 1) != '\n') {
+            char* crlf = memchr(cursor, '\r', available);
+            if ((crlf == NULL) || (crlf + 1 >= cursor + available) || *(crlf + 1) != '\n') {
                 break;
             }
 
-            long len = strtol(ctx->buffer + 1, NULL, 10);
-            if (len < 0 || len > 8192) {
+            // The value of a write may be large, it goes to its own allocation
+            bool is_value = (ctx->args_parsed == VALUE_ARG_INDEX) &&
+                            command_streams_value(ctx->server_ctx->reg, command_start + ctx->arg_offsets[0]);
+
+            long len = strtol(cursor + 1, NULL, 10);
+            if (len < 0 || len > (is_value ? MAX_VALUE_SIZE : ARGUMENT_MAX_LENGTH)) {
                 fprintf(stderr, "[ERROR] parse_buffer: Invalid bulk string length: %ld\n", len);
                 uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
                 return;
@@ -185,103 +757,79 @@ void parse_buffer(client_context_t* ctx) {
             }
 
             ctx->state = PARSE_STATE_EXPECT_DATA;
+            ctx->command_parsed += (size_t)((crlf + 2) - cursor);
 
-            size_t consumed = (size_t)((crlf + 2) - ctx->buffer);
-            memmove(ctx->buffer, ctx->buffer + consumed, ctx->buffer_used - consumed);
-            ctx->buffer_used -= consumed;
-
-        } else if (ctx->state == PARSE_STATE_EXPECT_DATA) {
-            if (ctx->buffer_used < ctx->data_to_read + 2) {
-                break;
-            }
-
-            if (ctx->args_parsed == 0) {
-                ctx->temp_argv = malloc(ctx->args_total * sizeof(char*));
-                ctx->temp_arg_lengths = malloc(ctx->args_total * sizeof(size_t));
-                if (!ctx->temp_argv || !ctx->temp_arg_lengths) {
-                    fprintf(stderr, "[ERROR] parse_buffer: Failed to allocate memory for command arguments.\n");
-                    free_parser_resources(ctx);
+            if (is_value && (ctx->data_to_read >= VALUE_STREAM_MIN)) {
+                ctx->value = value_create(ctx->data_to_read);
+                if (ctx->value == NULL) {
+                    fprintf(stderr, "[ERROR] parse_buffer: Failed to allocate a streamed value.\n");
                     uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
                     return;
                 }
+
+                ctx->value_received = 0;
+                ctx->state = PARSE_STATE_EXPECT_VALUE;
+            }
+
+        } else if (ctx->state == PARSE_STATE_EXPECT_DATA) {
+            if (available < ctx->data_to_read + 2) {
+                break;
             }
 
-            ctx->temp_argv[ctx->args_parsed] = malloc(ctx->data_to_read + 1);
-            if (ctx->temp_argv[ctx->args_parsed] == NULL) {
-                fprintf(stderr, "[ERROR] parse_buffer: Failed to allocate memory for argument string.\n");
-                free_parser_resources(ctx);
+            if ((cursor[ctx->data_to_read] != '\r') || (cursor[ctx->data_to_read + 1] != '\n')) {
+                fprintf(stderr, "[ERROR] parse_buffer: Bulk string is not terminated by CRLF.\n");
                 uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
                 return;
             }
-            memcpy(ctx->temp_argv[ctx->args_parsed], ctx->buffer, ctx->data_to_read);
-            ctx->temp_argv[ctx->args_parsed][ctx->data_to_read] = '\0';
-            ctx->temp_arg_lengths[ctx->args_parsed] = ctx->data_to_read;
 
-            ctx->args_parsed++;
+            // The CR is consumed already, the argument can end there
+            cursor[ctx->data_to_read] = '\0';
+            ctx->arg_offsets[ctx->args_parsed] = ctx->command_parsed;
+            ctx->arg_lengths[ctx->args_parsed] = ctx->data_to_read;
 
-            size_t consumed = ctx->data_to_read + 2;
-            memmove(ctx->buffer, ctx->buffer + consumed, ctx->buffer_used - consumed);
-            ctx->buffer_used -= consumed;
+            ctx->args_parsed++;
+            ctx->command_parsed += ctx->data_to_read + 2;
 
             if (ctx->args_parsed == ctx->args_total) {
-                char* command_name = ctx->temp_argv[0];
-                int argc = sizet_to_int(ctx->args_total - 1, &err);
-                if (err) {
-                    fprintf(stderr, "[ERROR] parse_buffer: Argument count conversion failed.\n");
-                    free_parser_resources(ctx);
-                    uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+                if (parser_dispatch(ctx, command_start) != 0) {
                     return;
                 }
+            } else {
+                ctx->state = PARSE_STATE_EXPECT_LENGTH;
+            }
 
-                char** command_argv = (argc > 0) ? &ctx->temp_argv[1] : NULL;
-                const size_t* args_lengths = (argc > 0) ? &ctx->temp_arg_lengths[1] : NULL;
-
-                execute_result_t result = execute_command(ctx->server_ctx, command_name, argc, command_argv, args_lengths);
-
-                unsigned char* response_buffer = result.body;
-                size_t body_len = result.body_length;
-
-                unsigned char* temp_realloc = realloc(response_buffer, body_len + 1);
-                if (temp_realloc == NULL) {
-                    fprintf(stderr, "[ERROR] parse_buffer: Failed to realloc response buffer.\n");
-
-                    free(response_buffer);
-                    free_parser_resources(ctx);
+        } else if (ctx->state == PARSE_STATE_EXPECT_VALUE) {
+            data_entry_t* value = ctx->value;
+            size_t missing = value->size - ctx->value_received;
+            size_t taken = (available < missing) ? available : missing;
 
-                    uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
-                    return;
-                }
+            memcpy(value->data + ctx->value_received, cursor, taken);
+            ctx->value_received += taken;
 
-                response_buffer = temp_realloc;
-                response_buffer[body_len] = '\r';
-                response_buffer[body_len + 1] = '\n';
+            // What the value took leaves the buffer at once, only its CRLF
+            // may be left behind to wait for the next read
+            if ((ctx->value_received < value->size) || (available - taken < 2)) {
+                memmove(cursor, cursor + taken, available - taken);
+                ctx->buffer_used -= taken;
+                break;
+            }
 
-                write_req_t* req = malloc(sizeof(write_req_t));
-                if (!req) {
-                    fprintf(stderr, "[ERROR] parse_buffer: Failed to allocate write request.\n");
+            if ((cursor[taken] != '\r') || (cursor[taken + 1] != '\n')) {
+                fprintf(stderr, "[ERROR] parse_buffer: Bulk string is not terminated by CRLF.\n");
+                uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+                return;
+            }
 
-                    free(response_buffer);
-                    free_parser_resources(ctx);
+            ctx->arg_offsets[ctx->args_parsed] = ctx->command_parsed;
+            ctx->arg_lengths[ctx->args_parsed] = value->size;
 
-                    uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
-                    return;
-                }
+            ctx->args_parsed++;
+            ctx->command_parsed += taken + 2;
 
-                unsigned int write_len = sizet_to_uint(body_len + 1, &err);
-                if (err) {
-                    fprintf(stderr, "[ERROR] parse_buffer: Response length conversion failed.\n");
-                    free(response_buffer);
-                    free(req);
-                    free_parser_resources(ctx);
-                    uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+            if (ctx->args_parsed == ctx->args_total) {
+                if (parser_dispatch(ctx, command_start) != 0) {
                     return;
                 }
-
-                req->buf = uv_buf_init((char*)response_buffer, write_len);
-                uv_write((uv_write_t*)req, (uv_stream_t*)&ctx->client_handle, &req->buf, 1, on_write_complete);
-
-                // free_parser_resources(ctx);
-                // reset_parser(ctx);
             } else {
                 ctx->state = PARSE_STATE_EXPECT_LENGTH;
             }
@@ -289,33 +837,126 @@ void parse_buffer(client_context_t* ctx) {
             break;
         }
     }
+
+    parser_compact(ctx);
+}
+
+// The read went to the loop's buffer: its commands are run from there and
+// only the incomplete one left is copied to the client's own buffer.
+static void client_parse_shared(client_context_t* ctx, loop_context_t* loop_ctx, size_t received){
+    char* own_buffer = ctx->buffer;
+    size_t own_capacity = ctx->buffer_capacity;
+
+    ctx->buffer = loop_ctx->read_buffer;
+    ctx->buffer_capacity = sizeof(loop_ctx->read_buffer);
+    ctx->buffer_used = received;
+
+    parse_buffer(ctx);
+
+    char* rest = ctx->buffer;
+    ctx->buffer = own_buffer;
+    ctx->buffer_capacity = own_capacity;
+
+    if (uv_is_closing((uv_handle_t*)&ctx->client_handle)) {
+        ctx->buffer_used = 0;
+        return;
+    }
+
+    size_t pending = ctx->buffer_used;
+    ctx->buffer_used = 0;
+    if (pending == 0) {
+        return;
+    }
+
+    if (client_buffer_reserve(ctx, pending + CLIENT_READ_MIN) != 0) {
+        fprintf(stderr, "[ERROR] client_parse_shared: Failed to keep an incomplete command.\n");
+        uv_close((uv_handle_t*)&ctx->client_handle, on_client_close);
+        return;
+    }
+
+    memcpy(ctx->buffer, rest, pending);
+    ctx->buffer_used = pending;
 }
 
 void on_read(uv_stream_t* client, ssize_t nread, const uv_buf_t* buf){
     client_context_t* ctx = (client_context_t*)client->data;
+    loop_context_t* loop_ctx = client->loop->data;
     bool err;
 
-    if (nread > 0) {
-        uv_timer_start(&ctx->inactivity_timer, on_client_timeout, INACTIVITY_TIMEOUT, 0);
-
-        append_to_buffer(ctx, buf->base, ssizet_to_sizet(nread, &err));
-        if (err == true) return;
-        
-        parse_buffer(ctx);
-    } else if (nread < 0) {
-        uv_timer_stop(&ctx->inactivity_timer);
+    if (nread < 0) {
         if (nread != UV_EOF) {
             fprintf(stderr, "[ERROR] on_read: '%s'\n", uv_strerror((int)nread));
         }
         uv_close((uv_handle_t*)client, on_client_close);
+        return;
     }
 
-    if (buf->base) {
-        free(buf->base);
+    size_t received = ssizet_to_sizet(nread, &err);
+    if ((received == 0) || err) {
+        return;
+    }
+
+    ctx->last_activity = uv_now(client->loop);
+
+    if (buf->base == loop_ctx->read_buffer) {
+        client_parse_shared(ctx, loop_ctx, received);
+        return;
+    }
+
+    // Anything else landed where it belongs already
+    if ((ctx->state == PARSE_STATE_EXPECT_VALUE) && (buf->base == (char*)ctx->value->data + ctx->value_received)) {
+        ctx->value_received += received;
+    } else {
+        ctx->buffer_used += received;
+    }
+
+    parse_buffer(ctx);
+
+    if (!uv_is_closing((uv_handle_t*)client)) {
+        client_buffer_fit(ctx);
     }
 }
 
 
+// Housekeeping of one table, each task bounded so a tick never stalls clients.
+// Runs on the loop owning the table, every shard has its own.
+void database_cron(hashtable_t* db, uint64_t now_ms){
+    if (table_autoresize(db) < 0) {
+        fprintf(stderr, "[ERROR] database_cron: Automatic resize failed to start.\n");
+    }
+
+    if (table_is_rehashing(db)) {
+        uint64_t deadline = uv_hrtime() + REHASH_TICK_BUDGET;
+        while ((table_rehash_step(db, REHASH_STEPS_PER_TICK) > 0) && (uv_hrtime() < deadline)) {
+        }
+    }
+
+    // Writes only evict a few keys each, the rest of the excess goes here
+    table_update_clock(db, now_ms);
+
+    // Expired keys nobody reads again are only reclaimed here
+    uint64_t expire_deadline = uv_hrtime() + EXPIRE_TICK_BUDGET;
+    while ((table_expire_step(db, EXPIRE_WORK_PER_TICK) > 0) && (uv_hrtime() < expire_deadline)) {
+    }
+
+    uint64_t eviction_deadline = uv_hrtime() + EVICTION_TICK_BUDGET;
+    while ((table_evict(db, EVICTION_KEYS_PER_TICK, destroy_value_wrapper) == 1) &&
+           (uv_hrtime() < eviction_deadline)) {
+    }
+}
+
+// Periodic housekeeping on the event loop.
+void server_cron(uv_timer_t* timer){
+    server_context_t* server_ctx = (server_context_t*)timer->data;
+
+    if (server_ctx->db != NULL) {
+        database_cron(server_ctx->db, uv_now(timer->loop));
+    }
+
+    // Retired memory otherwise only gets freed once enough new retirements pile up
+    epoch_collect();
+}
+
 void on_new_connection(uv_stream_t* server, int status) {
     if (status < 0) {
         fprintf(stderr, "[ERROR] on_new_connection: %s.\n", uv_strerror(status));
@@ -332,15 +973,14 @@ void on_new_connection(uv_stream_t* server, int status) {
 
     ctx->client_handle.data = ctx;
     ctx->server_ctx = server->data; 
+    ctx->last_activity = uv_now(server->loop);
+    client_link(ctx);
 
     if (uv_accept(server, (uv_stream_t*)&ctx->client_handle) == 0) {
         fprintf(stderr, "[INFO] New client connected.\n"); 
 
         reset_parser(ctx);
-
-        uv_timer_init(server->loop, &ctx->inactivity_timer);
-        ctx->inactivity_timer.data = ctx; 
-        uv_timer_start(&ctx->inactivity_timer, on_client_timeout, INACTIVITY_TIMEOUT, 0);
+        ctx->protocol = RESP_DEFAULT_VERSION;
 
         uv_read_start((uv_stream_t*)&ctx->client_handle, alloc_buffer, on_read);
     } else{
@@ -350,76 +990,397 @@ void on_new_connection(uv_stream_t* server, int status) {
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        fprintf(stderr, "[ERROR] main: Wrong number of argument provided, only 1 is permitted. Example: simple_c_database <DB_SIZE>.\n");
-        return -1;
+static bool parse_ratio(const char* text, double* out){
+    char* endptr;
+    double value = strtod(text, &endptr);
+    if ((endptr == text) || (*endptr != '\0') || (value < 0.0)) {
+        return false;
     }
 
-    server_context_t g_server_ctx;
-    g_server_ctx.reg = registry_create();
-    size_t db_size = strtoul(argv[1], NULL, 10);
-    if (db_size == 0) {
-        fprintf(stderr, "[ERROR] main: Invalid DB_SIZE provided.\n");
+    *out = value;
+    return true;
+}
+
+// Plain bytes, or with a k, m or g suffix (powers of 1024)
+static bool parse_memory(const char* text, size_t* out){
+    char* endptr;
+    unsigned long long value = strtoull(text, &endptr, 10);
+    if ((endptr == text) || (text[0] == '-')) {
+        return false;
+    }
+
+    unsigned int shift = 0;
+    switch (*endptr) {
+        case 'k': case 'K': shift = 10; endptr++; break;
+        case 'm': case 'M': shift = 20; endptr++; break;
+        case 'g': case 'G': shift = 30; endptr++; break;
+        default: break;
+    }
+
+    if ((*endptr != '\0') || (value > (SIZE_MAX >> shift))) {
+        return false;
+    }
+
+    *out = (size_t)value << shift;
+    return true;
+}
+
+static bool parse_eviction_mode(const char* text, eviction_mode_t* out){
+    if (strcmp(text, "noeviction") == 0) {
+        *out = EVICTION_NONE;
+    } else if (strcmp(text, "lru") == 0) {
+        *out = EVICTION_LRU;
+    } else if (strcmp(text, "lfu") == 0) {
+        *out = EVICTION_LFU;
+    } else if (strcmp(text, "random") == 0) {
+        *out = EVICTION_RANDOM;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// simple_c_database <DB_SIZE> [--autoresize on|off] [--grow-load F] [--shrink-load F] [--grow-overflow F]
+//                             [--lock-stripes N] [--maxmemory BYTES[k|m|g]]
+//                             [--maxmemory-policy noeviction|lru|lfu|random] [--maxmemory-samples N]
+//                             [--ordered-index on|off] [--shards N] [--io-threads N]
+int parse_server_options(int argc, char** argv, server_options_t* options){
+    if (argc < 2) {
+        fprintf(stderr, "[ERROR] main: Missing DB_SIZE. Example: simple_c_database <DB_SIZE> [--option value]...\n");
         return -1;
     }
-    g_server_ctx.db = table_create(db_size);
 
-    if (g_server_ctx.db == NULL) {
-        fprintf(stderr, "[ERROR] main: Failed to create database table.\n");
+    options->db_size = strtoul(argv[1], NULL, 10);
+    if (options->db_size == 0) {
+        fprintf(stderr, "[ERROR] main: Invalid DB_SIZE provided.\n");
         return -1;
     }
 
-    fprintf(stderr, "[INFO] main: Global resources initialized.\n");
+    options->lock_stripes = LOCK_STRIPES_DEFAULT;
+
+    options->resize_policy = (hashtable_resize_policy_t){
+        .enabled = true,
+        .grow_load_factor = AUTORESIZE_GROW_LOAD,
+        .shrink_load_factor = AUTORESIZE_SHRINK_LOAD,
+        .grow_overflow_ratio = AUTORESIZE_GROW_OVERFLOW,
+        .min_buckets = options->db_size,
+    };
+
+    options->eviction_policy = (hashtable_eviction_policy_t){
+        .mode = EVICTION_NONE,
+        .max_memory = 0,
+        .samples = EVICTION_SAMPLES_DEFAULT,
+    };
+
+    options->ordered_index = false;
+    options->shards = 0;
+    options->io_threads = 1;
+
+    for (int i = 2; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            fprintf(stderr, "[ERROR] main: Option '%s' needs a value.\n", name);
+            return -1;
+        }
 
-    uv_loop_t* loop = uv_default_loop();
+        bool valid = true;
+        if (strcmp(name, "--autoresize") == 0) {
+            valid = (strcmp(value, "on") == 0) || (strcmp(value, "off") == 0);
+            options->resize_policy.enabled = (strcmp(value, "on") == 0);
+        } else if (strcmp(name, "--grow-load") == 0) {
+            valid = parse_ratio(value, &options->resize_policy.grow_load_factor);
+        } else if (strcmp(name, "--shrink-load") == 0) {
+            valid = parse_ratio(value, &options->resize_policy.shrink_load_factor);
+        } else if (strcmp(name, "--grow-overflow") == 0) {
+            valid = parse_ratio(value, &options->resize_policy.grow_overflow_ratio);
+        } else if (strcmp(name, "--lock-stripes") == 0) {
+            options->lock_stripes = stosizet(value);
+            valid = (options->lock_stripes > 0);
+        } else if (strcmp(name, "--maxmemory") == 0) {
+            valid = parse_memory(value, &options->eviction_policy.max_memory);
+        } else if (strcmp(name, "--maxmemory-policy") == 0) {
+            valid = parse_eviction_mode(value, &options->eviction_policy.mode);
+        } else if (strcmp(name, "--maxmemory-samples") == 0) {
+            options->eviction_policy.samples = stosizet(value);
+            valid = (options->eviction_policy.samples > 0);
+        } else if (strcmp(name, "--ordered-index") == 0) {
+            valid = (strcmp(value, "on") == 0) || (strcmp(value, "off") == 0);
+            options->ordered_index = (strcmp(value, "on") == 0);
+        } else if (strcmp(name, "--shards") == 0) {
+            options->shards = stosizet(value);
+            valid = ((options->shards > 0) || (strcmp(value, "0") == 0)) && (options->shards <= SHARDS_MAX);
+        } else if (strcmp(name, "--io-threads") == 0) {
+            options->io_threads = stosizet(value);
+            valid = (options->io_threads > 0) && (options->io_threads <= IO_THREADS_MAX);
+        } else {
+            fprintf(stderr, "[ERROR] main: Unknown option '%s'.\n", name);
+            return -1;
+        }
 
-    uv_tcp_t server_socket;
-    uv_tcp_init(loop, &server_socket);
-    server_socket.data = &g_server_ctx;
+        if (!valid) {
+            fprintf(stderr, "[ERROR] main: Invalid value '%s' for option '%s'.\n", value, name);
+            return -1;
+        }
+    }
 
-    struct sockaddr_in addr;
-    uv_ip4_addr("0.0.0.0", 7000, &addr);
+    // Shard queues have a single producer, the one I/O loop
+    if ((options->shards > 0) && (options->io_threads > 1)) {
+        fprintf(stderr, "[ERROR] main: --shards cannot be combined with more than one I/O thread.\n");
+        return -1;
+    }
+
+    return 0;
+}
 
-    int err = uv_tcp_bind(&server_socket, (const struct sockaddr*)&addr, 0);
+// Binds a listener on SERVER_PORT. With reuse_port every I/O loop binds its
+// own socket to the port and the kernel balances new connections among them.
+static int listener_start(uv_loop_t* loop, uv_tcp_t* listener, server_context_t* server_ctx, bool reuse_port){
+    int err = uv_tcp_init_ex(loop, listener, AF_INET);
     if (err) {
-        fprintf(stderr, "[ERROR] main: Bind error: %s\n", uv_strerror(err));
-        return 1;
+        fprintf(stderr, "[ERROR] listener_start: Socket creation failed: %s\n", uv_strerror(err));
+        return -1;
     }
+    listener->data = server_ctx;
 
     uv_os_fd_t fd;
-    err = uv_fileno((uv_handle_t*)&server_socket, &fd);
+    err = uv_fileno((uv_handle_t*)listener, &fd);
     if (err) {
-        fprintf(stderr, "[ERROR] main: uv_fileno failed: %s\n", uv_strerror(err));
-        return 1;
+        fprintf(stderr, "[ERROR] listener_start: uv_fileno failed: %s\n", uv_strerror(err));
+        return -1;
     }
 
+    // Both only take effect when set before the bind
     int on = 1;
     if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
-        perror("[WARN] main: setsockopt(SO_REUSEADDR) failed");
-    } else {
-        fprintf(stderr, "[INFO] main: SO_REUSEADDR set successfully.\n");
+        perror("[WARN] listener_start: setsockopt(SO_REUSEADDR) failed");
+    }
+    if (reuse_port && (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)) {
+        perror("[ERROR] listener_start: setsockopt(SO_REUSEPORT) failed");
+        return -1;
     }
 
-    err = uv_tcp_nodelay(&server_socket, 1);
+    struct sockaddr_in addr;
+    uv_ip4_addr("0.0.0.0", SERVER_PORT, &addr);
+
+    err = uv_tcp_bind(listener, (const struct sockaddr*)&addr, 0);
     if (err) {
-        fprintf(stderr, "[WARN] main: Failed to set TCP_NODELAY: %s\n", uv_strerror(err));
-    } else {
-        fprintf(stderr, "[INFO] main: TCP_NODELAY enabled.\n");
+        fprintf(stderr, "[ERROR] listener_start: Bind error: %s\n", uv_strerror(err));
+        return -1;
+    }
+
+    err = uv_tcp_nodelay(listener, 1);
+    if (err) {
+        fprintf(stderr, "[WARN] listener_start: Failed to set TCP_NODELAY: %s\n", uv_strerror(err));
     }
 
-    err = uv_listen((uv_stream_t*)&server_socket, 128, on_new_connection);
+    err = uv_listen((uv_stream_t*)listener, LISTEN_BACKLOG, on_new_connection);
     if (err) {
-        fprintf(stderr, "[ERROR] main: Listen error: %s\n", uv_strerror(err));
+        fprintf(stderr, "[ERROR] listener_start: Listen error: %s\n", uv_strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+    // I/O threads
+
+static void io_worker_close_walk(uv_handle_t* handle, void* arg){
+    io_worker_t* worker = arg;
+
+    if (uv_is_closing(handle)) {
+        return;
+    }
+
+    if ((handle == (uv_handle_t*)&worker->listener) || (handle == (uv_handle_t*)&worker->stop) ||
+        (handle == (uv_handle_t*)&worker->context.flush) || (handle == (uv_handle_t*)&worker->context.idle_sweep)) {
+        uv_close(handle, NULL);
+    } else if (handle->type == UV_TCP) {
+        uv_close(handle, on_client_close);
+    }
+}
+
+static void on_io_worker_stop(uv_async_t* handle){
+    io_worker_t* worker = handle->data;
+    uv_walk(&worker->loop, io_worker_close_walk, worker);
+}
+
+static void io_worker_main(void* arg){
+    io_worker_t* worker = arg;
+    uv_run(&worker->loop, UV_RUN_DEFAULT);
+}
+
+static int io_worker_start(io_worker_t* worker, server_context_t* server_ctx){
+    if (uv_loop_init(&worker->loop) != 0) {
+        fprintf(stderr, "[ERROR] io_worker_start: Failed to create an event loop.\n");
+        return -1;
+    }
+
+    uv_async_init(&worker->loop, &worker->stop, on_io_worker_stop);
+    worker->stop.data = worker;
+
+    int status = ((loop_context_start(&worker->loop, &worker->context) == 0) &&
+                  (listener_start(&worker->loop, &worker->listener, server_ctx, true) == 0))
+                     ? uv_thread_create(&worker->thread, io_worker_main, worker)
+                     : -1;
+    if (status != 0) {
+        fprintf(stderr, "[ERROR] io_worker_start: Failed to start an I/O thread.\n");
+
+        uv_walk(&worker->loop, io_worker_close_walk, worker);
+        uv_run(&worker->loop, UV_RUN_DEFAULT);
+        uv_loop_close(&worker->loop);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void io_worker_stop(io_worker_t* worker){
+    uv_async_send(&worker->stop);
+    uv_thread_join(&worker->thread);
+    uv_loop_close(&worker->loop);
+}
+
+// The database, or with shards one of them holding an even share of the
+// configured buckets and memory. A shard has a single owner, one stripe is enough.
+static hashtable_t* database_create(const server_options_t* options, size_t shards, uint64_t now_ms){
+    size_t parts = (shards > 0) ? shards : 1;
+    size_t db_size = options->db_size / parts;
+
+    hashtable_t* db = table_create((db_size > 0) ? db_size : 1, (shards > 0) ? 1 : options->lock_stripes);
+    if (db == NULL) {
+        fprintf(stderr, "[ERROR] main: Failed to create database table.\n");
+        return NULL;
+    }
+
+    hashtable_resize_policy_t resize_policy = options->resize_policy;
+    resize_policy.min_buckets = table_capacity(db) / BUCKET_CAPACITY;
+    if (table_set_resize_policy(db, &resize_policy) != 0) {
+        fprintf(stderr, "[ERROR] main: Invalid automatic resize watermarks.\n");
+        table_destroy(db, NULL);
+        return NULL;
+    }
+
+    table_set_value_sizer(db, std_value_sizer);
+    table_set_value_destroyer(db, destroy_value_wrapper);
+
+    hashtable_eviction_policy_t eviction_policy = options->eviction_policy;
+    if (eviction_policy.max_memory != 0) {
+        eviction_policy.max_memory = (eviction_policy.max_memory > parts) ? eviction_policy.max_memory / parts : 1;
+    }
+    if (table_set_eviction_policy(db, &eviction_policy) != 0) {
+        fprintf(stderr, "[ERROR] main: Invalid eviction policy.\n");
+        table_destroy(db, NULL);
+        return NULL;
+    }
+
+    if (options->ordered_index && (table_enable_ordered_index(db) != 0)) {
+        fprintf(stderr, "[ERROR] main: Failed to create the ordered index.\n");
+        table_destroy(db, NULL);
+        return NULL;
+    }
+
+    table_update_clock(db, now_ms);
+    return db;
+}
+
+int main(int argc, char** argv) {
+    server_options_t options;
+    if (parse_server_options(argc, argv, &options) != 0) {
+        return -1;
+    }
+
+    // A client gone with replies still in flight fails the write instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+
+    uv_loop_t* loop = uv_default_loop();
+
+    server_context_t g_server_ctx;
+    g_server_ctx.reg = registry_create();
+    g_server_ctx.db = NULL;
+    g_server_ctx.shards = NULL;
+
+    if (options.shards == 0) {
+        g_server_ctx.db = database_create(&options, 0, uv_now(loop));
+        if (g_server_ctx.db == NULL) {
+            return -1;
+        }
+    } else {
+        hashtable_t* tables[SHARDS_MAX];
+        for (size_t i = 0; i < options.shards; i++) {
+            tables[i] = database_create(&options, options.shards, uv_now(loop));
+            if (tables[i] == NULL) {
+                while (i-- > 0) {
+                    table_destroy(tables[i], NULL);
+                }
+                return -1;
+            }
+        }
+
+        g_server_ctx.shards = shard_pool_create(loop, g_server_ctx.reg, tables, options.shards, on_shard_reply,
+                                                database_cron);
+        if (g_server_ctx.shards == NULL) {
+            fprintf(stderr, "[ERROR] main: Failed to start the shards.\n");
+            for (size_t i = 0; i < options.shards; i++) {
+                table_destroy(tables[i], NULL);
+            }
+            return -1;
+        }
+    }
+
+    fprintf(stderr, "[INFO] main: Global resources initialized.\n");
+
+    loop_context_t loop_ctx;
+    if (loop_context_start(loop, &loop_ctx) != 0) {
+        return 1;
+    }
+
+    uv_tcp_t server_socket;
+    if (listener_start(loop, &server_socket, &g_server_ctx, options.io_threads > 1) != 0) {
         return 1;
     }
 
-    fprintf(stderr, "[INFO] main: Server listening on port 7000.\n");
+    size_t worker_count = options.io_threads - 1;
+    io_worker_t* workers = (worker_count > 0) ? calloc(worker_count, sizeof(io_worker_t)) : NULL;
+    if ((worker_count > 0) && (workers == NULL)) {
+        fprintf(stderr, "[ERROR] main: Failed to allocate the I/O threads.\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < worker_count; i++) {
+        if (io_worker_start(&workers[i], &g_server_ctx) != 0) {
+            while (i-- > 0) {
+                io_worker_stop(&workers[i]);
+            }
+            free(workers);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "[INFO] main: Server listening on port %d with %zu I/O threads.\n", SERVER_PORT, options.io_threads);
+
+    uv_timer_t cron_timer;
+    uv_timer_init(loop, &cron_timer);
+    cron_timer.data = &g_server_ctx;
+    uv_timer_start(&cron_timer, server_cron, CRON_INTERVAL, CRON_INTERVAL);
+    uv_unref((uv_handle_t*)&cron_timer);
 
     int run_result = uv_run(loop, UV_RUN_DEFAULT);
 
+    for (size_t i = 0; i < worker_count; i++) {
+        io_worker_stop(&workers[i]);
+    }
+    free(workers);
+
+    if (g_server_ctx.shards != NULL) {
+        shard_pool_destroy(g_server_ctx.shards);
+        uv_run(loop, UV_RUN_NOWAIT);
+    } else {
+        table_destroy(g_server_ctx.db, destroy_value_wrapper);
+    }
     registry_destroy(&g_server_ctx.reg);
-    table_destroy(g_server_ctx.db, destroy_value_wrapper);
+    epoch_drain();
     fprintf(stderr, "[INFO] main: Server terminated.\n");
 
     return run_result;
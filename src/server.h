@@ -5,18 +5,52 @@
 
 #include <uv.h>
 #include "command.h"
+#include "shard.h"
 
 // Macro
 
 #define MAX_URL_LENGTH      1024
 #define INACTIVITY_TIMEOUT (60 * 1000) // expressed in ms
 
+    // A read only notes the loop time; one sweep per loop closes the idle
+    // clients, so one may outlive the timeout by up to an interval.
+
+    #define IDLE_SWEEP_INTERVAL 1000        // expressed in ms
+
+#define SERVER_PORT         7000
+#define LISTEN_BACKLOG      128
+
+    // Every I/O thread runs its own loop with its own listener on the same
+    // port (SO_REUSEPORT), the kernel spreading new connections among them;
+    // a connection stays on the loop that accepted it. The first loop is
+    // the default one, which also runs the cron.
+
+    #define IO_THREADS_MAX      64
+
+#define CRON_INTERVAL           10          // expressed in ms
+#define REHASH_TICK_BUDGET      1000000     // expressed in ns, rehash work allowed per cron tick
+#define REHASH_STEPS_PER_TICK   100         // buckets moved between two budget checks
+#define EVICTION_TICK_BUDGET    1000000     // expressed in ns, eviction work allowed per cron tick
+#define EVICTION_KEYS_PER_TICK  32          // keys evicted between two budget checks
+#define EXPIRE_TICK_BUDGET      1000000     // expressed in ns, expiry work allowed per cron tick
+#define EXPIRE_WORK_PER_TICK    256         // timer wheel steps between two budget checks
+
 // Data
 
+    // Arguments are parsed where they lie in the connection buffer, except
+    // the value of a write (command flagged v) of VALUE_STREAM_MIN bytes or
+    // more: it is allocated as soon as its length is known and the socket
+    // data goes straight into it, so it is never staged whole in the buffer.
+
+    #define ARGUMENT_MAX_LENGTH 8192
+    #define VALUE_STREAM_MIN    4096
+    #define VALUE_ARG_INDEX     2       // Command name, key, then the value
+
 typedef enum {
     PARSE_STATE_EXPECT_TYPE,   
     PARSE_STATE_EXPECT_LENGTH, 
     PARSE_STATE_EXPECT_DATA,   
+    PARSE_STATE_EXPECT_VALUE,       // Streaming into value
 } parser_state_t;
 
 typedef struct client_context_t{
@@ -26,35 +60,132 @@ typedef struct client_context_t{
     char* buffer;
     size_t buffer_used;
     size_t buffer_capacity;
+    size_t buffer_parsed;     // Complete commands at the front, dropped once per read
+
+    uint8_t protocol;         // RESP version of the replies
 
     parser_state_t state;
     size_t args_total;
     size_t args_parsed;
     size_t data_to_read;
-
-    char** temp_argv;         
-    size_t* temp_arg_lengths;
-
-    uv_timer_t inactivity_timer;
+    size_t command_parsed;    // Bytes of the current command parsed so far
+    data_entry_t* value;      // Value of the current command, when streamed
+    size_t value_received;
+
+    // Views of the current command's arguments, as offsets from its first
+    // byte since the buffer may move until the command is complete. Each
+    // argument is NUL-terminated in place over its CRLF. Kept from one
+    // command to the next.
+    size_t* arg_offsets;
+    size_t* arg_lengths;
+    char** argv;
+    size_t args_capacity;
+
+    uint64_t last_activity;   // Loop time of its last read, in ms
+    struct client_context_t* clients_prev;
+    struct client_context_t* clients_next;
+
+    // Sharded mode: requests still waiting for their reply, oldest first.
+    // A closed client is freed once the last of them comes back.
+    shard_request_t* replies_head;
+    shard_request_t* replies_tail;
+    bool closed;
+
+    // Replies gathered and not written yet. While there are some the client
+    // is on the pending list of its loop.
+    struct write_req_t* output;
+    struct client_context_t* pending_prev;
+    struct client_context_t* pending_next;
 } client_context_t;
 
-typedef struct {
+    // A reply goes out as a RESP frame: its type and header, then its
+    // payload and REPLY_TRAILER when it has some, without joining them
+    // unless the payload is small enough to be copied in with the header.
+    // The replies a client gets while the loop handles its events are
+    // gathered and written with a single request (writev) just before the
+    // loop waits again; bodies and values are released when the write
+    // completes. Clients talk RESP2 until HELLO 3 switches them to RESP3.
+
+    #define REPLY_TRAILER       "\r\n"
+    #define REPLY_FRAME_ROOM    64
+    #define REPLY_BATCH_INITIAL 16
+    #define REPLY_BATCH_MAX     512     // Replies held at most before writing them out
+
+    #define RESP_DEFAULT_VERSION  2
+    #define RESP_MAX_VERSION      3
+    #define SERVER_NAME           "simple-c-database"
+    #define SERVER_VERSION        "1.0.0"
+
+typedef struct write_reply_t{
+    unsigned char* body;
+    data_entry_t* value;
+    const unsigned char* payload;  // Data of body or value, sent after the frame
+    size_t payload_length;
+    bool trailer;
+    uint8_t frame_length;
+    char frame[REPLY_FRAME_ROOM];
+} write_reply_t;
+
+typedef struct write_req_t{
     uv_write_t req;
-    uv_buf_t buf;
+    size_t count;
+    size_t capacity;
+    write_reply_t* replies;
+    uv_buf_t bufs[];               // Up to three per reply, filled when written
 } write_req_t;
 
+    // Reads go to the loop's buffer while a client has nothing pending, and
+    // its commands run from there; a client only keeps a buffer of its own
+    // for an incomplete command, reading the rest right after it, and
+    // releases it once it is parsed, so idle connections hold none.
+
+    #define READ_BUFFER_SIZE    (64 * 1024)
+    #define CLIENT_READ_MIN     (16 * 1024)     // Room a read into a client's own buffer gets at least
+    #define CLIENT_BUFFER_SLACK 4               // Times more than its pending bytes need before shrinking
+
+// One per I/O loop, set as its data.
+typedef struct loop_context_t{
+    uv_prepare_t flush;            // Writes the gathered replies before the loop waits
+    client_context_t* pending;
+    uv_timer_t idle_sweep;
+    client_context_t* clients;     // Every client of the loop
+    char read_buffer[READ_BUFFER_SIZE];
+} loop_context_t;
+
+typedef struct io_worker_t{
+    uv_thread_t thread;
+    uv_loop_t loop;
+    uv_tcp_t listener;
+    uv_async_t stop;
+    loop_context_t context;
+} io_worker_t;
+
+typedef struct server_options_t{
+    size_t db_size;
+    size_t lock_stripes;
+    hashtable_resize_policy_t resize_policy;
+    hashtable_eviction_policy_t eviction_policy;
+    bool ordered_index;
+    size_t shards;                 // 0 for a single table shared by the loops
+    size_t io_threads;
+} server_options_t;
+
 
 // Public API
 
     void parse_buffer(client_context_t* ctx);
     void reset_parser(client_context_t* ctx);
-    void append_to_buffer(client_context_t* ctx, const char* data, size_t len);
     void on_new_connection(uv_stream_t *server, int status);
     void on_read(uv_stream_t* client, ssize_t nread, const uv_buf_t* buf);
     void alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf);
     void on_close(uv_handle_t* handle);
     void on_close(uv_handle_t* handle);
     void on_write_complete(uv_write_t* req, int status);
+    int send_reply(client_context_t* ctx, execute_result_t* result);
+    int loop_context_start(uv_loop_t* loop, loop_context_t* loop_ctx);
+    void server_cron(uv_timer_t* timer);
+    void database_cron(hashtable_t* db, uint64_t now_ms);
+    int parse_server_options(int argc, char** argv, server_options_t* options);
 
 
 #endif
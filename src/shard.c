@@ -0,0 +1,461 @@
+// Header
+#include "shard.h"
+#include "server.h"
+#include "hashing_functionality.h"
+#include "string_functionality.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Private API
+
+// The table picks buckets and stripes from the low hash bits and tags from
+// the top ones, so the shard comes from a remix of the whole hash.
+static size_t shard_for_key(const shard_pool_t* pool, const char* key, size_t key_len){
+    uint64_t mixed = hash(key, key_len) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(((mixed >> 32) * pool->count) >> 32);
+}
+
+// A shard's walk ends on cursor 0, the next shard then starts from its own 0.
+static uint64_t shard_scan_cursor(const shard_pool_t* pool, size_t shard, uint64_t cursor){
+    if (cursor != 0){
+        return ((uint64_t)shard << SHARD_CURSOR_SHIFT) | cursor;
+    }
+
+    return (shard + 1 < pool->count) ? ((uint64_t)(shard + 1) << SHARD_CURSOR_SHIFT) : 0;
+}
+
+static void shard_rewrite_arg(shard_request_t* request, unsigned long long value){
+    int written = snprintf(request->rewritten, sizeof(request->rewritten), "%llu", value);
+    if ((written > 0) && ((size_t)written < sizeof(request->rewritten))){
+        request->argv[0] = request->rewritten;
+        request->arg_lengths[0] = (size_t)written;
+    }
+}
+
+// Picks the shard and adapts the arguments that depend on it. Arguments it
+// cannot read are left for the command to reject; false for a SCAN cursor
+// naming a shard that does not exist.
+static bool shard_route(shard_pool_t* pool, shard_request_t* request){
+    const command* cmd = request->cmd;
+    request->shard = 0;
+
+    if (request->broadcast){
+        // Every shard grows its part of the table
+        size_t buckets = (cmd->tag == CMD_TYPE_RESIZE) ? stosizet(request->argv[0]) : 0;
+        if (buckets != 0){
+            size_t share = buckets / pool->count;
+            shard_rewrite_arg(request, (share > 0) ? share : 1);
+        }
+        return true;
+    }
+
+    if (strchr(cmd->flags, 'k') != NULL){
+        request->shard = shard_for_key(pool, request->argv[0], request->arg_lengths[0]);
+        return true;
+    }
+
+    if ((cmd->tag == CMD_TYPE_SCAN) && (request->argv[0][0] >= '0') && (request->argv[0][0] <= '9')){
+        char* endptr;
+        unsigned long long cursor = strtoull(request->argv[0], &endptr, 10);
+        if (*endptr != '\0'){
+            return true;
+        }
+
+        request->shard = (size_t)(cursor >> SHARD_CURSOR_SHIFT);
+        if (request->shard >= pool->count){
+            return false;
+        }
+        shard_rewrite_arg(request, cursor & ((1ull << SHARD_CURSOR_SHIFT) - 1));
+    }
+
+    return true;
+}
+
+// One allocation: the request, its results, then the arguments and their
+// bytes. A value built already is pointed at instead of copied.
+static shard_request_t* shard_request_alloc(int argc, char* argv[], const size_t arg_lengths[], size_t results,
+                                            data_entry_t* value){
+    size_t args = (argc > 0) ? (size_t)argc : 0;
+
+    size_t bytes = sizeof(shard_request_t) + (results * sizeof(command_result_t)) +
+                   (args * (sizeof(char*) + sizeof(size_t)));
+    for (size_t i = 0; i < args; i++){
+        bytes += ((value != NULL) && (i == SHARD_VALUE_ARG)) ? 0 : arg_lengths[i] + 1;
+    }
+
+    shard_request_t* request = malloc(bytes);
+    if (request == NULL){
+        return NULL;
+    }
+
+    request->next = NULL;
+    request->owner = NULL;
+    request->protocol = 0;
+    request->cmd = NULL;
+    request->argc = (int)args;
+    request->shard = 0;
+    request->broadcast = false;
+    request->pending = 0;
+    request->done = false;
+    request->reply = (execute_result_t){0};
+    request->value = value;
+
+    for (size_t i = 0; i < results; i++){
+        request->results[i] = (command_result_t){ .type = CMD_TYPE_EMPTY };
+    }
+
+    request->argv = (char**)&request->results[results];
+    request->arg_lengths = (size_t*)&request->argv[args];
+
+    char* data = (char*)&request->arg_lengths[args];
+    for (size_t i = 0; i < args; i++){
+        request->arg_lengths[i] = arg_lengths[i];
+
+        if ((value != NULL) && (i == SHARD_VALUE_ARG)){
+            request->argv[i] = (char*)value->data;
+            continue;
+        }
+
+        memcpy(data, argv[i], arg_lengths[i]);
+        data[arg_lengths[i]] = '\0';
+
+        request->argv[i] = data;
+        data += arg_lengths[i] + 1;
+    }
+
+    return request;
+}
+
+static bool shard_send(shard_t* shard, shard_request_t* request){
+    if (!spsc_push(&shard->inbox, request)){
+        return false;
+    }
+
+    uv_async_send(&shard->wakeup);
+    return true;
+}
+
+// Shard side. Runs up to SHARD_BATCH requests and returns how many went
+// back; one whose reply finds the outbox full is kept aside, and the inbox
+// left alone, until the I/O thread makes room.
+static size_t shard_drain(shard_t* shard){
+    size_t sent = 0;
+
+    while (sent < SHARD_BATCH){
+        if (shard->unsent == NULL){
+            shard_request_t* request = spsc_pop(&shard->inbox);
+            if (request == NULL){
+                break;
+            }
+
+            // A broadcast is shared by every shard, which may write only its
+            // own results slot; broadcasts never carry a value.
+            if (request->broadcast){
+                request->results[shard->index] = command_run(request->cmd, shard->db, request->argc, request->argv,
+                                                             request->arg_lengths, NULL);
+            } else{
+                request->results[0] = command_run(request->cmd, shard->db, request->argc, request->argv,
+                                                  request->arg_lengths, request->value);
+                request->value = NULL;
+            }
+            shard->unsent = request;
+        }
+
+        // From here on the request belongs to the I/O thread
+        if (!spsc_push(&shard->outbox, shard->unsent)){
+            break;
+        }
+        shard->unsent = NULL;
+        sent++;
+    }
+
+    if ((sent > 0) || (shard->unsent != NULL)){
+        uv_async_send(&shard->pool->completions);
+    }
+
+    return sent;
+}
+
+static void shard_close_handles(shard_t* shard){
+    uv_close((uv_handle_t*)&shard->wakeup, NULL);
+    uv_close((uv_handle_t*)&shard->cron, NULL);
+}
+
+static void on_shard_wakeup(uv_async_t* handle){
+    shard_t* shard = handle->data;
+
+    if (atomic_load_explicit(&shard->stopping, memory_order_acquire)){
+        shard_close_handles(shard);
+        return;
+    }
+
+    // Let the cron have its turn before the next batch
+    if (shard_drain(shard) == SHARD_BATCH){
+        uv_async_send(&shard->wakeup);
+    }
+}
+
+static void on_shard_cron(uv_timer_t* timer){
+    shard_t* shard = timer->data;
+
+    shard->pool->cron(shard->db, uv_now(&shard->loop));
+
+    if ((shard->unsent != NULL) && (shard_drain(shard) == SHARD_BATCH)){
+        uv_async_send(&shard->wakeup);
+    }
+}
+
+static void shard_main(void* arg){
+    shard_t* shard = arg;
+
+    uv_run(&shard->loop, UV_RUN_DEFAULT);
+}
+
+static void shard_request_finish(shard_pool_t* pool, shard_request_t* request){
+    command_result_t result = request->broadcast ? command_merge(request->results, pool->count) : request->results[0];
+
+    if (result.type == CMD_TYPE_SCAN){
+        result.output.scan_output.cursor = shard_scan_cursor(pool, request->shard, result.output.scan_output.cursor);
+    }
+
+    request->reply = command_format(result);
+    request->done = true;
+
+    pool->on_reply(request);
+}
+
+// I/O side. Shards finish in any order, each owner puts its replies back in
+// the order it sent the requests.
+static void shard_pool_complete(shard_pool_t* pool){
+    for (size_t i = 0; i < pool->count; i++){
+        size_t popped = 0;
+        shard_request_t* request;
+
+        while ((popped < SHARD_QUEUE_CAPACITY) && ((request = spsc_pop(&pool->shards[i].outbox)) != NULL)){
+            if (--request->pending == 0){
+                shard_request_finish(pool, request);
+            }
+            popped++;
+        }
+
+        if (popped == SHARD_QUEUE_CAPACITY){
+            uv_async_send(&pool->completions);
+        }
+    }
+}
+
+static void on_shard_completions(uv_async_t* handle){
+    shard_pool_complete(handle->data);
+}
+
+static int shard_start(shard_pool_t* pool, shard_t* shard, size_t index, hashtable_t* db){
+    shard->index = index;
+    shard->pool = pool;
+    shard->db = db;
+    shard->unsent = NULL;
+    atomic_init(&shard->stopping, false);
+
+    if (spsc_init(&shard->inbox, SHARD_QUEUE_CAPACITY) != 0){
+        return -1;
+    }
+    if (spsc_init(&shard->outbox, SHARD_QUEUE_CAPACITY) != 0){
+        spsc_destroy(&shard->inbox);
+        return -1;
+    }
+    if (uv_loop_init(&shard->loop) != 0){
+        spsc_destroy(&shard->outbox);
+        spsc_destroy(&shard->inbox);
+        return -1;
+    }
+
+    table_set_single_owner(db);
+
+    uv_async_init(&shard->loop, &shard->wakeup, on_shard_wakeup);
+    shard->wakeup.data = shard;
+
+    uv_timer_init(&shard->loop, &shard->cron);
+    shard->cron.data = shard;
+    uv_timer_start(&shard->cron, on_shard_cron, CRON_INTERVAL, CRON_INTERVAL);
+
+    int status = uv_thread_create(&shard->thread, shard_main, shard);
+    if (status != 0){
+        fprintf(stderr, "[ERROR] shard_start: Failed to start shard %zu: %s.\n", index, uv_strerror(status));
+
+        shard_close_handles(shard);
+        uv_run(&shard->loop, UV_RUN_DEFAULT);
+        uv_loop_close(&shard->loop);
+        spsc_destroy(&shard->outbox);
+        spsc_destroy(&shard->inbox);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void shard_stop(shard_t* shard){
+    atomic_store_explicit(&shard->stopping, true, memory_order_release);
+    uv_async_send(&shard->wakeup);
+    uv_thread_join(&shard->thread);
+
+    uv_loop_close(&shard->loop);
+}
+
+static void on_pool_close(uv_handle_t* handle){
+    shard_pool_t* pool = handle->data;
+
+    free(pool->shards);
+    free(pool);
+}
+
+// Public API
+
+shard_pool_t* shard_pool_create(uv_loop_t* io_loop, command_registry* reg, hashtable_t** tables, size_t count,
+                                shard_reply_fn on_reply, shard_cron_fn cron){
+    if ((io_loop == NULL) || (reg == NULL) || (tables == NULL) || (count == 0) || (count > SHARDS_MAX) ||
+        (on_reply == NULL) || (cron == NULL)){
+        return NULL;
+    }
+
+    shard_pool_t* pool = malloc(sizeof(shard_pool_t));
+    if (pool == NULL){
+        return NULL;
+    }
+
+    // The queues inside want their cache lines to themselves
+    pool->shards = aligned_alloc(alignof(shard_t), count * sizeof(shard_t));
+    if (pool->shards == NULL){
+        free(pool);
+        return NULL;
+    }
+
+    pool->count = count;
+    pool->reg = reg;
+    pool->on_reply = on_reply;
+    pool->cron = cron;
+
+    uv_async_init(io_loop, &pool->completions, on_shard_completions);
+    pool->completions.data = pool;
+    uv_unref((uv_handle_t*)&pool->completions);
+
+    for (size_t i = 0; i < count; i++){
+        if (shard_start(pool, &pool->shards[i], i, tables[i]) != 0){
+            for (size_t j = 0; j < i; j++){
+                shard_stop(&pool->shards[j]);
+                spsc_destroy(&pool->shards[j].outbox);
+                spsc_destroy(&pool->shards[j].inbox);
+            }
+            uv_close((uv_handle_t*)&pool->completions, on_pool_close);
+            return NULL;
+        }
+    }
+
+    fprintf(stderr, "[INFO] shard_pool_create: %zu shards started.\n", count);
+    return pool;
+}
+
+void shard_pool_destroy(shard_pool_t* pool){
+    if (pool == NULL){
+        return;
+    }
+
+    for (size_t i = 0; i < pool->count; i++){
+        shard_stop(&pool->shards[i]);
+    }
+
+    // Requests still queued run here: with the threads gone each table
+    // still has a single owner
+    for (size_t i = 0; i < pool->count; i++){
+        shard_t* shard = &pool->shards[i];
+        while ((shard_drain(shard) > 0) || (shard->unsent != NULL)){
+            shard_pool_complete(pool);
+        }
+    }
+    shard_pool_complete(pool);
+
+    for (size_t i = 0; i < pool->count; i++){
+        table_destroy(pool->shards[i].db, destroy_value_wrapper);
+        spsc_destroy(&pool->shards[i].outbox);
+        spsc_destroy(&pool->shards[i].inbox);
+    }
+
+    uv_close((uv_handle_t*)&pool->completions, on_pool_close);
+}
+
+shard_request_t* shard_submit(shard_pool_t* pool, void* owner, const char* command_name, int argc, char* argv[],
+                              const size_t arg_lengths[], data_entry_t* value){
+    execute_result_t error;
+    const command* cmd = command_lookup(pool->reg, command_name, argc, &error);
+    bool broadcast = (cmd != NULL) && (strchr(cmd->flags, 'b') != NULL);
+
+    // Only a single shard may run a command taking a value
+    if ((value != NULL) && ((cmd == NULL) || broadcast || (strchr(cmd->flags, 'v') == NULL))){
+        destroy_value_wrapper(value);
+        value = NULL;
+    }
+
+    shard_request_t* request = shard_request_alloc((cmd != NULL) ? argc : 0, argv, arg_lengths,
+                                                   broadcast ? pool->count : 1, value);
+    if (request == NULL){
+        if (cmd == NULL){
+            free_execute_result(&error);
+        }
+        destroy_value_wrapper(value);
+        return NULL;
+    }
+
+    request->owner = owner;
+    request->cmd = cmd;
+    request->broadcast = broadcast;
+
+    if (cmd == NULL){
+        request->reply = error;
+        request->done = true;
+        return request;
+    }
+
+    if (!shard_route(pool, request)){
+        request->reply = create_error_response(400, TCP_INVALID_ARGUMENT);
+        request->done = true;
+        return request;
+    }
+
+    // A broadcast goes out whole or not at all
+    bool room = true;
+    for (size_t i = 0; broadcast && room && (i < pool->count); i++){
+        room = !spsc_full(&pool->shards[i].inbox);
+    }
+
+    if (broadcast && room){
+        request->pending = pool->count;
+        for (size_t i = 0; i < pool->count; i++){
+            shard_send(&pool->shards[i], request);
+        }
+    } else if (!broadcast && shard_send(&pool->shards[request->shard], request)){
+        request->pending = 1;
+    } else{
+        request->reply = create_error_response(503, TCP_BUSY_ERROR);
+        request->done = true;
+    }
+
+    return request;
+}
+
+void shard_request_free(shard_request_t* request){
+    destroy_value_wrapper(request->value);
+    free(request);
+}
+
+shard_request_t* shard_request_ready(void* owner, execute_result_t reply){
+    shard_request_t* request = shard_request_alloc(0, NULL, NULL, 0, NULL);
+    if (request == NULL){
+        return NULL;
+    }
+
+    request->owner = owner;
+    request->reply = reply;
+    request->done = true;
+    return request;
+}
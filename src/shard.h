@@ -0,0 +1,108 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+// Includes
+
+#include <uv.h>
+#include "command.h"
+#include "spsc_functionality.h"
+
+// Macro
+
+    // Sharded mode: the keyspace is split over independent tables, each
+    // owned by one thread running its own event loop, so no table is ever
+    // touched by two threads and none takes its stripe locks. The I/O
+    // thread parses, routes each request through the inbox of its shard
+    // and gets it back through the shard's outbox, both lock-free SPSC
+    // rings. Key commands go to the shard their key hashes to, commands
+    // flagged b run on every shard and have their results merged, SCAN
+    // walks the shards one after the other with the shard index kept in
+    // the top bits of the cursor, and the rest runs on shard 0.
+
+    #define SHARDS_MAX            64
+    #define SHARD_QUEUE_CAPACITY  4096    // Requests in flight per shard and direction
+    #define SHARD_BATCH           256     // Requests a shard runs before yielding to its loop
+    #define SHARD_CURSOR_SHIFT    56
+    #define SHARD_ARG_ROOM        24      // Room for an argument rewritten while routing
+    #define SHARD_VALUE_ARG       1       // Argument a value built already stands for
+
+// Data
+
+typedef struct shard_pool_t shard_pool_t;
+
+typedef struct shard_request_t{
+    struct shard_request_t* next;      // Owner's queue of requests waiting to be answered
+    void* owner;
+    uint8_t protocol;                  // Owner's reply encoding when it sent the request
+
+    const command* cmd;
+    int argc;
+    char** argv;                       // Copied along with the request
+    size_t* arg_lengths;
+    char rewritten[SHARD_ARG_ROOM];
+    data_entry_t* value;               // Streamed in by the parser, taken by the command
+
+    size_t shard;                      // Target, unless broadcast
+    bool broadcast;
+    size_t pending;                    // Shards still running it, I/O thread only
+    bool done;                         // reply is set
+
+    execute_result_t reply;
+    command_result_t results[];        // One per shard when broadcast, else one
+} shard_request_t;
+
+typedef void (*shard_reply_fn)(shard_request_t* request);
+typedef void (*shard_cron_fn)(hashtable_t* db, uint64_t now_ms);
+
+typedef struct shard_t{
+    size_t index;
+    shard_pool_t* pool;
+    hashtable_t* db;
+
+    uv_thread_t thread;
+    uv_loop_t loop;
+    uv_async_t wakeup;                 // Inbox not empty, or stopping
+    uv_timer_t cron;
+
+    spsc_queue_t inbox;                // I/O thread to shard
+    spsc_queue_t outbox;               // Shard to I/O thread
+    shard_request_t* unsent;           // Ran, waiting for room in the outbox
+    _Atomic(bool) stopping;
+} shard_t;
+
+struct shard_pool_t{
+    size_t count;
+    shard_t* shards;
+    command_registry* reg;
+
+    uv_async_t completions;            // On the I/O loop, some outbox is not empty
+    shard_reply_fn on_reply;
+    shard_cron_fn cron;
+};
+
+// Public API
+
+    // Takes the tables, one per shard, and starts a thread for each.
+    // on_reply runs on the I/O loop for each request once its reply is set.
+    shard_pool_t* shard_pool_create(uv_loop_t* io_loop, command_registry* reg, hashtable_t** tables, size_t count,
+                                    shard_reply_fn on_reply, shard_cron_fn cron);
+
+    // Stops and joins the threads and destroys the tables. The pool itself
+    // is freed once the I/O loop runs its close callbacks.
+    void shard_pool_destroy(shard_pool_t* pool);
+
+    // Copies the command and sends it to its shards; value, when set, is
+    // taken and goes along without being copied. Requests that cannot be
+    // sent (unknown command, bad arity, full inbox) come back done already,
+    // and on_reply is not called for them. NULL when out of memory.
+    shard_request_t* shard_submit(shard_pool_t* pool, void* owner, const char* command_name, int argc, char* argv[],
+                                  const size_t arg_lengths[], data_entry_t* value);
+    void shard_request_free(shard_request_t* request);
+
+    // A request answered already with reply, which takes its place in the
+    // owner's queue without going to any shard. NULL when out of memory,
+    // the reply is then still the caller's.
+    shard_request_t* shard_request_ready(void* owner, execute_result_t reply);
+
+
+#endif
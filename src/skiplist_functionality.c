@@ -0,0 +1,364 @@
+// Header
+#include "skiplist_functionality.h"
+#include "hashing_functionality.h"
+#include "slab_functionality.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Private API
+
+static inline const unsigned char* node_key(const skiplist_node_t* node){
+    return (const unsigned char*)&node->next[node->height];
+}
+
+static inline bool node_expired(const skiplist_node_t* node, uint32_t now){
+    uint32_t expire_at = atomic_load_explicit(&node->expire_at, memory_order_relaxed);
+    return (expire_at != 0) && (expire_at <= now);
+}
+
+static inline size_t node_size(size_t height, size_t key_len){
+    return sizeof(skiplist_node_t) + (height * sizeof(skiplist_node_t*)) + key_len;
+}
+
+static int key_compare(const unsigned char* a, size_t a_len, const unsigned char* b, size_t b_len){
+    size_t common = (a_len < b_len) ? a_len : b_len;
+
+    int order = memcmp(a, b, common);
+    if (order != 0){
+        return order;
+    }
+
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+// Two random bits per level give the 1/4 branching.
+_Static_assert(SKIPLIST_BRANCHING == 4, "skiplist_random_height draws two bits per level");
+
+static uint8_t skiplist_random_height(void){
+    static _Thread_local uint64_t state = 0;
+    static _Thread_local bool seeded = false;
+
+    if (!seeded){
+        uintptr_t address = (uintptr_t)&state;
+        state = hash(&address, sizeof(address));
+        seeded = true;
+    }
+
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+
+    unsigned int height = (z == 0) ? SKIPLIST_MAX_LEVEL : 1u + ((unsigned int)__builtin_ctzll(z) / 2u);
+    return (uint8_t)((height < SKIPLIST_MAX_LEVEL) ? height : SKIPLIST_MAX_LEVEL);
+}
+
+// Last node before key on every level, so update[0]->next[0] is the first node not below key.
+static void skiplist_find(skiplist_t* list, const unsigned char* key, size_t key_len,
+                          skiplist_node_t* update[SKIPLIST_MAX_LEVEL]){
+    skiplist_node_t* node = list->head;
+
+    for (int level = list->level - 1; level >= 0; level--){
+        while ((node->next[level] != NULL) &&
+               (key_compare(node_key(node->next[level]), node->next[level]->key_len, key, key_len) < 0)){
+            node = node->next[level];
+        }
+        update[level] = node;
+    }
+}
+
+static inline skiplist_node_t* skiplist_lower_bound(skiplist_t* list, const unsigned char* key, size_t key_len){
+    skiplist_node_t* update[SKIPLIST_MAX_LEVEL];
+    skiplist_find(list, key, key_len, update);
+
+    return update[0]->next[0];
+}
+
+static void skiplist_free_nodes(skiplist_t* list){
+    skiplist_node_t* node = list->head->next[0];
+    while (node != NULL){
+        skiplist_node_t* next = node->next[0];
+        skiplist_node_free(node);
+        node = next;
+    }
+
+    memset(list->head->next, 0, SKIPLIST_MAX_LEVEL * sizeof(skiplist_node_t*));
+    list->level = 1;
+    list->length = 0;
+    atomic_store_explicit(&list->bytes, node_size(SKIPLIST_MAX_LEVEL, 0), memory_order_relaxed);
+}
+
+// Public API
+
+skiplist_t* skiplist_create(void){
+    skiplist_t* list = malloc(sizeof(skiplist_t));
+    if (list == NULL){
+        return NULL;
+    }
+
+    list->head = calloc(1, node_size(SKIPLIST_MAX_LEVEL, 0));
+    if (list->head == NULL){
+        free(list);
+        return NULL;
+    }
+
+    list->head->height = SKIPLIST_MAX_LEVEL;
+    list->head->key_len = 0;
+    list->level = 1;
+    list->length = 0;
+    atomic_init(&list->bytes, node_size(SKIPLIST_MAX_LEVEL, 0));
+    rwspin_init(&list->lock);
+
+    return list;
+}
+
+void skiplist_destroy(skiplist_t* list){
+    if (list == NULL){
+        return;
+    }
+
+    skiplist_free_nodes(list);
+    free(list->head);
+    free(list);
+}
+
+void skiplist_clear(skiplist_t* list){
+    if (list == NULL){
+        return;
+    }
+
+    rwspin_write_lock(&list->lock);
+    skiplist_free_nodes(list);
+    rwspin_write_unlock(&list->lock);
+}
+
+skiplist_node_t* skiplist_node_create(const unsigned char* key, size_t key_len){
+    if ((key == NULL) || (key_len == 0) || (key_len > UINT8_MAX)){
+        return NULL;
+    }
+
+    uint8_t height = skiplist_random_height();
+
+    skiplist_node_t* node = slab_alloc(node_size(height, key_len));
+    if (node == NULL){
+        return NULL;
+    }
+
+    node->height = height;
+    node->key_len = (uint8_t)key_len;
+    atomic_init(&node->expire_at, 0);
+    memcpy((unsigned char*)&node->next[height], key, key_len);
+
+    return node;
+}
+
+void skiplist_node_free(skiplist_node_t* node){
+    if (node != NULL){
+        slab_free(node, node_size(node->height, node->key_len));
+    }
+}
+
+bool skiplist_insert(skiplist_t* list, skiplist_node_t* node){
+    if ((list == NULL) || (node == NULL)){
+        return false;
+    }
+
+    skiplist_node_t* update[SKIPLIST_MAX_LEVEL];
+
+    rwspin_write_lock(&list->lock);
+
+    skiplist_find(list, node_key(node), node->key_len, update);
+
+    skiplist_node_t* found = update[0]->next[0];
+    if ((found != NULL) && (key_compare(node_key(found), found->key_len, node_key(node), node->key_len) == 0)){
+        rwspin_write_unlock(&list->lock);
+        skiplist_node_free(node);
+        return false;
+    }
+
+    for (int level = list->level; level < node->height; level++){
+        update[level] = list->head;
+    }
+    if (node->height > list->level){
+        list->level = node->height;
+    }
+
+    for (int level = 0; level < node->height; level++){
+        node->next[level] = update[level]->next[level];
+        update[level]->next[level] = node;
+    }
+
+    list->length++;
+    atomic_fetch_add_explicit(&list->bytes, node_size(node->height, node->key_len), memory_order_relaxed);
+
+    rwspin_write_unlock(&list->lock);
+    return true;
+}
+
+bool skiplist_remove(skiplist_t* list, const unsigned char* key, size_t key_len){
+    if ((list == NULL) || (key == NULL)){
+        return false;
+    }
+
+    skiplist_node_t* update[SKIPLIST_MAX_LEVEL];
+
+    rwspin_write_lock(&list->lock);
+
+    skiplist_find(list, key, key_len, update);
+
+    skiplist_node_t* node = update[0]->next[0];
+    if ((node == NULL) || (key_compare(node_key(node), node->key_len, key, key_len) != 0)){
+        rwspin_write_unlock(&list->lock);
+        return false;
+    }
+
+    for (int level = 0; level < node->height; level++){
+        update[level]->next[level] = node->next[level];
+    }
+    while ((list->level > 1) && (list->head->next[list->level - 1] == NULL)){
+        list->level--;
+    }
+
+    list->length--;
+    atomic_fetch_sub_explicit(&list->bytes, node_size(node->height, node->key_len), memory_order_relaxed);
+
+    rwspin_write_unlock(&list->lock);
+
+    skiplist_node_free(node);
+    return true;
+}
+
+void skiplist_set_expiry(skiplist_t* list, const unsigned char* key, size_t key_len, uint32_t expire_at){
+    if ((list == NULL) || (key == NULL)){
+        return;
+    }
+
+    rwspin_read_lock(&list->lock);
+
+    skiplist_node_t* node = skiplist_lower_bound(list, key, key_len);
+    if ((node != NULL) && (key_compare(node_key(node), node->key_len, key, key_len) == 0)){
+        atomic_store_explicit(&node->expire_at, expire_at, memory_order_relaxed);
+    }
+
+    rwspin_read_unlock(&list->lock);
+}
+
+// Nodes a walk for limit live keys may examine, expired ones included.
+static size_t skiplist_scan_budget(size_t limit){
+    return (limit > (SIZE_MAX / SKIPLIST_SCAN_FACTOR)) ? SIZE_MAX : limit * SKIPLIST_SCAN_FACTOR;
+}
+
+// A resumed walk starts past the last key it examined, which may be gone by now.
+static skiplist_node_t* skiplist_walk_start(skiplist_t* list, const unsigned char* key, size_t key_len,
+                                            const skiplist_resume_t* resume){
+    if ((resume == NULL) || !resume->more){
+        return skiplist_lower_bound(list, key, key_len);
+    }
+
+    skiplist_node_t* node = skiplist_lower_bound(list, resume->key, resume->key_len);
+    if ((node != NULL) && (key_compare(node_key(node), node->key_len, resume->key, resume->key_len) == 0)){
+        node = node->next[0];
+    }
+    return node;
+}
+
+// last is the node examined last when the budget stopped the walk, else NULL.
+static void skiplist_walk_save(skiplist_resume_t* resume, const skiplist_node_t* last){
+    if (resume == NULL){
+        return;
+    }
+
+    resume->more = (last != NULL);
+    if (last != NULL){
+        resume->key_len = last->key_len;
+        memcpy(resume->key, node_key(last), last->key_len);
+    }
+}
+
+size_t skiplist_range(skiplist_t* list, const unsigned char* start, size_t start_len, const unsigned char* end,
+                      size_t end_len, uint32_t now, size_t limit, skiplist_visit_fn visit, void* visit_context,
+                      skiplist_resume_t* resume){
+    if ((list == NULL) || (start == NULL) || (visit == NULL)){
+        return 0;
+    }
+
+    size_t visited = 0;
+    size_t budget = skiplist_scan_budget(limit);
+    skiplist_node_t* last = NULL;
+
+    rwspin_read_lock(&list->lock);
+
+    skiplist_node_t* node = skiplist_walk_start(list, start, start_len, resume);
+    for (; (node != NULL) && (visited < limit) && (budget > 0); node = node->next[0], budget--){
+        if ((end != NULL) && (key_compare(node_key(node), node->key_len, end, end_len) > 0)){
+            node = NULL;
+            break;
+        }
+        last = node;
+        if (node_expired(node, now)){
+            continue;
+        }
+
+        visit(node_key(node), node->key_len, visit_context);
+        visited++;
+    }
+
+    skiplist_walk_save(resume, ((node != NULL) && (visited < limit)) ? last : NULL);
+
+    rwspin_read_unlock(&list->lock);
+
+    return visited;
+}
+
+size_t skiplist_prefix(skiplist_t* list, const unsigned char* prefix, size_t prefix_len, uint32_t now, size_t limit,
+                       skiplist_visit_fn visit, void* visit_context, skiplist_resume_t* resume){
+    if ((list == NULL) || (prefix == NULL) || (visit == NULL)){
+        return 0;
+    }
+
+    size_t visited = 0;
+    size_t budget = skiplist_scan_budget(limit);
+    skiplist_node_t* last = NULL;
+
+    rwspin_read_lock(&list->lock);
+
+    // Keys sharing the prefix are contiguous and start at its lower bound
+    skiplist_node_t* node = skiplist_walk_start(list, prefix, prefix_len, resume);
+    for (; (node != NULL) && (visited < limit) && (budget > 0); node = node->next[0], budget--){
+        if ((node->key_len < prefix_len) || (memcmp(node_key(node), prefix, prefix_len) != 0)){
+            node = NULL;
+            break;
+        }
+        last = node;
+        if (node_expired(node, now)){
+            continue;
+        }
+
+        visit(node_key(node), node->key_len, visit_context);
+        visited++;
+    }
+
+    skiplist_walk_save(resume, ((node != NULL) && (visited < limit)) ? last : NULL);
+
+    rwspin_read_unlock(&list->lock);
+
+    return visited;
+}
+
+  // Monitoring
+
+size_t skiplist_length(skiplist_t* list){
+    if (list == NULL){
+        return 0;
+    }
+
+    rwspin_read_lock(&list->lock);
+    size_t length = list->length;
+    rwspin_read_unlock(&list->lock);
+
+    return length;
+}
+
+size_t skiplist_memory_usage(skiplist_t* list){
+    return (list != NULL) ? atomic_load_explicit(&list->bytes, memory_order_relaxed) : 0;
+}
@@ -0,0 +1,93 @@
+#ifndef SKIPLIST_FUNCTIONALITY_H
+#define SKIPLIST_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "lock_functionality.h"
+
+// Macro and Defines
+
+    // Ordered set of byte strings (memcmp order, shorter first on a tie).
+    // Each node is one slab allocation holding its links followed by the
+    // key bytes, so a step along a level touches a single object. A node
+    // reaches the next level with probability 1/SKIPLIST_BRANCHING, which
+    // keeps towers short (1.33 links per node on average).
+    // Readers share the lock and writers take it alone; removed nodes are
+    // freed at once since no reader can hold one outside the lock. Each
+    // node also carries the second its key expires at (0 for never), so
+    // walks can skip expired keys without asking their owner. Those keys
+    // still cost a step each, so a walk stops after SKIPLIST_SCAN_FACTOR
+    // times its limit in nodes and reports where it got, letting the caller
+    // go on after the lock has been released in between.
+
+    #define SKIPLIST_MAX_LEVEL    24
+    #define SKIPLIST_BRANCHING    4
+    #define SKIPLIST_SCAN_FACTOR  4
+
+// Data
+
+typedef struct skiplist_node_t{
+    uint8_t key_len;
+    uint8_t height;
+    _Atomic(uint32_t) expire_at;      // Fills the padding before the links
+    struct skiplist_node_t* next[];   // height links, then key_len key bytes
+} skiplist_node_t;
+
+typedef struct skiplist_t{
+    rwspinlock_t lock;
+    uint8_t level;                     // Tallest tower in the list
+    size_t length;
+    _Atomic(size_t) bytes;             // Nodes, head included
+    skiplist_node_t* head;
+} skiplist_t;
+
+// Called under the read lock: it must be quick and must not modify the list.
+typedef void (*skiplist_visit_fn)(const unsigned char* key, size_t key_len, void* visit_context);
+
+// Where a walk stopped when its node budget ran out before its end
+typedef struct skiplist_resume_t{
+    bool more;
+    uint8_t key_len;
+    unsigned char key[UINT8_MAX];      // Last key examined, live or not
+} skiplist_resume_t;
+
+// Public API
+
+    skiplist_t* skiplist_create(void);
+    void skiplist_destroy(skiplist_t* list);
+    void skiplist_clear(skiplist_t* list);
+
+    // Nodes are built outside the list, so inserting never allocates.
+    // skiplist_insert takes the node and returns false, freeing it, when
+    // the key is already there.
+    skiplist_node_t* skiplist_node_create(const unsigned char* key, size_t key_len);
+    void skiplist_node_free(skiplist_node_t* node);
+    bool skiplist_insert(skiplist_t* list, skiplist_node_t* node);
+    bool skiplist_remove(skiplist_t* list, const unsigned char* key, size_t key_len);
+
+    // Only takes the read lock: the caller must keep the key from being
+    // removed meanwhile.
+    void skiplist_set_expiry(skiplist_t* list, const unsigned char* key, size_t key_len, uint32_t expire_at);
+
+    // Visit the keys not expired at now in order, at most limit of them, and
+    // return how many were visited. skiplist_range bounds are inclusive, a
+    // NULL end has none. Fewer come back when the walk spends its node
+    // budget on expired keys: resume then has more set, and passing it back
+    // as it is continues right after its key. resume may be NULL, and starts
+    // a new walk with more cleared.
+    size_t skiplist_range(skiplist_t* list, const unsigned char* start, size_t start_len, const unsigned char* end,
+                          size_t end_len, uint32_t now, size_t limit, skiplist_visit_fn visit, void* visit_context,
+                          skiplist_resume_t* resume);
+    size_t skiplist_prefix(skiplist_t* list, const unsigned char* prefix, size_t prefix_len, uint32_t now, size_t limit,
+                           skiplist_visit_fn visit, void* visit_context, skiplist_resume_t* resume);
+
+    // Monitoring
+    size_t skiplist_length(skiplist_t* list);
+    size_t skiplist_memory_usage(skiplist_t* list);
+
+
+#endif
@@ -0,0 +1,405 @@
+// Header
+#define _DEFAULT_SOURCE
+#include "slab_functionality.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+// Data
+
+// Lives in the first SLAB_PAGE_HEADER bytes of every page. Free objects are
+// linked through their first word; objects past carved were never handed out.
+typedef struct slab_page_t{
+    struct slab_page_t* prev;
+    struct slab_page_t* next;
+    void* free_list;
+    uint32_t used;                 // Objects out of the page, in callers or thread caches
+    uint32_t carved;
+    uint32_t capacity;
+    uint16_t class_index;
+    bool listed;                   // On the class list of pages with room
+} slab_page_t;
+
+_Static_assert(sizeof(slab_page_t) <= SLAB_PAGE_HEADER, "slab_page_t must fit in the page header");
+_Static_assert((SLAB_PAGE_SIZE & (SLAB_PAGE_SIZE - 1)) == 0, "SLAB_PAGE_SIZE must be a power of two");
+
+typedef struct __attribute__((aligned(64))) slab_class_t{
+    pthread_mutex_t mutex;
+    slab_page_t* partial;
+    size_t pages;
+} slab_class_t;
+
+// Counters are only written by the owning thread and summed by the stats.
+typedef struct slab_cache_t{
+    void* objects[SLAB_CLASS_COUNT][SLAB_CACHE_SIZE];
+    uint32_t count[SLAB_CLASS_COUNT];
+
+    _Atomic(int64_t) used[SLAB_CLASS_COUNT + 1];
+    _Atomic(int64_t) requested[SLAB_CLASS_COUNT + 1];
+
+    _Atomic(bool) in_use;
+    struct slab_cache_t* next;
+} slab_cache_t;
+
+static slab_class_t slab_classes[SLAB_CLASS_COUNT];
+static _Atomic(slab_cache_t*) slab_caches = NULL;
+
+static pthread_key_t slab_cache_key;
+static pthread_once_t slab_init_once = PTHREAD_ONCE_INIT;
+static bool slab_cache_key_ready = false;
+
+static _Thread_local slab_cache_t* thread_cache = NULL;
+
+// Private API
+
+static inline size_t slab_class_size(size_t class_index){
+    size_t power = (size_t)SLAB_MIN_OBJECT << (class_index / 2);
+    return (class_index % 2 == 0) ? power : power + power / 2;
+}
+
+// 2^b < size <= 2^(b+1) goes to 1.5 * 2^b when it fits there, to 2^(b+1) otherwise
+static inline size_t slab_class_for(size_t size){
+    if (size <= SLAB_MIN_OBJECT){
+        return 0;
+    }
+
+    size_t b = (size_t)(63 - __builtin_clzll((unsigned long long)(size - 1)));
+    if (size <= ((size_t)3 << (b - 1))){
+        return 2 * (b - 4) + 1;
+    }
+
+    return 2 * (b + 1 - 4);
+}
+
+static inline slab_page_t* slab_page_of(void* ptr){
+    return (slab_page_t*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+}
+
+static void slab_list_push(slab_class_t* slab_class, slab_page_t* page){
+    page->prev = NULL;
+    page->next = slab_class->partial;
+    if (slab_class->partial != NULL){
+        slab_class->partial->prev = page;
+    }
+
+    slab_class->partial = page;
+    page->listed = true;
+}
+
+static void slab_list_unlink(slab_class_t* slab_class, slab_page_t* page){
+    if (page->prev != NULL){
+        page->prev->next = page->next;
+    } else{
+        slab_class->partial = page->next;
+    }
+
+    if (page->next != NULL){
+        page->next->prev = page->prev;
+    }
+
+    page->prev = NULL;
+    page->next = NULL;
+    page->listed = false;
+}
+
+// Maps twice the page size and trims it so the page starts on a page-size boundary.
+static slab_page_t* slab_page_create(size_t class_index){
+    size_t span = 2 * (size_t)SLAB_PAGE_SIZE;
+
+    uint8_t* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED){
+        return NULL;
+    }
+
+    uintptr_t aligned = ((uintptr_t)raw + SLAB_PAGE_SIZE - 1) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+    size_t head = aligned - (uintptr_t)raw;
+    size_t tail = span - head - SLAB_PAGE_SIZE;
+
+    if (head != 0){
+        munmap(raw, head);
+    }
+    if (tail != 0){
+        munmap((uint8_t*)aligned + SLAB_PAGE_SIZE, tail);
+    }
+
+    slab_page_t* page = (slab_page_t*)aligned;
+    memset(page, 0, sizeof(slab_page_t));
+    page->class_index = (uint16_t)class_index;
+    page->capacity = (uint32_t)((SLAB_PAGE_SIZE - SLAB_PAGE_HEADER) / slab_class_size(class_index));
+
+    return page;
+}
+
+// Pops up to wanted objects from the class pages into out. Class lock held.
+static size_t slab_class_take(size_t class_index, void** out, size_t wanted){
+    slab_class_t* slab_class = &slab_classes[class_index];
+    size_t object_size = slab_class_size(class_index);
+    size_t taken = 0;
+
+    while (taken < wanted){
+        slab_page_t* page = slab_class->partial;
+        if (page == NULL){
+            page = slab_page_create(class_index);
+            if (page == NULL){
+                break;
+            }
+
+            slab_class->pages++;
+            slab_list_push(slab_class, page);
+        }
+
+        while ((taken < wanted) && (page->used < page->capacity)){
+            void* object = page->free_list;
+            if (object != NULL){
+                page->free_list = *(void**)object;
+            } else{
+                object = (uint8_t*)page + SLAB_PAGE_HEADER + (size_t)page->carved * object_size;
+                page->carved++;
+            }
+
+            page->used++;
+            out[taken++] = object;
+        }
+
+        if (page->used == page->capacity){
+            slab_list_unlink(slab_class, page);
+        }
+    }
+
+    return taken;
+}
+
+// Returns objects to their pages and unmaps pages left empty, keeping one per class. Class lock held.
+static void slab_class_give(size_t class_index, void** objects, size_t count){
+    slab_class_t* slab_class = &slab_classes[class_index];
+
+    for (size_t i = 0; i < count; i++){
+        slab_page_t* page = slab_page_of(objects[i]);
+
+        *(void**)objects[i] = page->free_list;
+        page->free_list = objects[i];
+        page->used--;
+
+        if (!page->listed){
+            slab_list_push(slab_class, page);
+        }
+
+        if ((page->used == 0) && ((page->prev != NULL) || (page->next != NULL))){
+            slab_list_unlink(slab_class, page);
+            munmap(page, SLAB_PAGE_SIZE);
+            slab_class->pages--;
+        }
+    }
+}
+
+static void slab_cache_release(void* arg){
+    slab_cache_t* cache = arg;
+
+    for (size_t c = 0; c < SLAB_CLASS_COUNT; c++){
+        if (cache->count[c] == 0){
+            continue;
+        }
+
+        pthread_mutex_lock(&slab_classes[c].mutex);
+        slab_class_give(c, cache->objects[c], cache->count[c]);
+        pthread_mutex_unlock(&slab_classes[c].mutex);
+
+        cache->count[c] = 0;
+    }
+
+    atomic_store_explicit(&cache->in_use, false, memory_order_release);
+}
+
+static void slab_init(void){
+    for (size_t c = 0; c < SLAB_CLASS_COUNT; c++){
+        pthread_mutex_init(&slab_classes[c].mutex, NULL);
+    }
+
+    slab_cache_key_ready = (pthread_key_create(&slab_cache_key, slab_cache_release) == 0);
+}
+
+// Caches of exited threads are reused; they keep their counters so the stats stay whole.
+// Also the entry point of every thread, so it runs the one time initialization.
+static slab_cache_t* slab_cache_get(void){
+    if (thread_cache != NULL){
+        return thread_cache;
+    }
+
+    pthread_once(&slab_init_once, slab_init);
+
+    slab_cache_t* cache = NULL;
+    for (slab_cache_t* it = atomic_load_explicit(&slab_caches, memory_order_acquire); it != NULL; it = it->next){
+        bool expected = false;
+        if (!atomic_load_explicit(&it->in_use, memory_order_relaxed) &&
+            atomic_compare_exchange_strong(&it->in_use, &expected, true)){
+            cache = it;
+            break;
+        }
+    }
+
+    if (cache == NULL){
+        cache = calloc(1, sizeof(slab_cache_t));
+        if (cache == NULL){
+            return NULL;
+        }
+
+        atomic_init(&cache->in_use, true);
+
+        slab_cache_t* head = atomic_load_explicit(&slab_caches, memory_order_relaxed);
+        do {
+            cache->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&slab_caches, &head, cache, memory_order_release, memory_order_relaxed));
+    }
+
+    if (slab_cache_key_ready){
+        pthread_setspecific(slab_cache_key, cache);
+    }
+
+    thread_cache = cache;
+    return cache;
+}
+
+static inline void slab_cache_count(slab_cache_t* cache, size_t row, int64_t used, int64_t requested){
+    atomic_store_explicit(&cache->used[row], atomic_load_explicit(&cache->used[row], memory_order_relaxed) + used,
+                          memory_order_relaxed);
+    atomic_store_explicit(&cache->requested[row], atomic_load_explicit(&cache->requested[row], memory_order_relaxed) + requested,
+                          memory_order_relaxed);
+}
+
+// Public API
+
+void* slab_alloc(size_t size){
+    slab_cache_t* cache = slab_cache_get();
+
+    if (size > SLAB_MAX_OBJECT){
+        void* ptr = malloc(size);
+        if ((ptr != NULL) && (cache != NULL)){
+            slab_cache_count(cache, SLAB_CLASS_COUNT, 1, (int64_t)size);
+        }
+        return ptr;
+    }
+
+    size_t class_index = slab_class_for(size);
+    void* object = NULL;
+
+    if (cache == NULL){
+        pthread_mutex_lock(&slab_classes[class_index].mutex);
+        slab_class_take(class_index, &object, 1);
+        pthread_mutex_unlock(&slab_classes[class_index].mutex);
+        return object;
+    }
+
+    if (cache->count[class_index] == 0){
+        pthread_mutex_lock(&slab_classes[class_index].mutex);
+        cache->count[class_index] = (uint32_t)slab_class_take(class_index, cache->objects[class_index], SLAB_CACHE_BATCH);
+        pthread_mutex_unlock(&slab_classes[class_index].mutex);
+
+        if (cache->count[class_index] == 0){
+            return NULL;
+        }
+    }
+
+    object = cache->objects[class_index][--cache->count[class_index]];
+
+    slab_cache_count(cache, class_index, 1, (int64_t)size);
+
+    return object;
+}
+
+void slab_free(void* ptr, size_t size){
+    if (ptr == NULL){
+        return;
+    }
+
+    slab_cache_t* cache = slab_cache_get();
+
+    if (size > SLAB_MAX_OBJECT){
+        free(ptr);
+        if (cache != NULL){
+            slab_cache_count(cache, SLAB_CLASS_COUNT, -1, -(int64_t)size);
+        }
+        return;
+    }
+
+    size_t class_index = slab_class_for(size);
+
+    if (cache == NULL){
+        pthread_mutex_lock(&slab_classes[class_index].mutex);
+        slab_class_give(class_index, &ptr, 1);
+        pthread_mutex_unlock(&slab_classes[class_index].mutex);
+        return;
+    }
+
+    // Hand the oldest half back so the objects still cached are the warm ones
+    if (cache->count[class_index] == SLAB_CACHE_SIZE){
+        void** objects = cache->objects[class_index];
+
+        pthread_mutex_lock(&slab_classes[class_index].mutex);
+        slab_class_give(class_index, objects, SLAB_CACHE_BATCH);
+        pthread_mutex_unlock(&slab_classes[class_index].mutex);
+
+        memmove(objects, objects + SLAB_CACHE_BATCH, (SLAB_CACHE_SIZE - SLAB_CACHE_BATCH) * sizeof(void*));
+        cache->count[class_index] -= SLAB_CACHE_BATCH;
+    }
+
+    cache->objects[class_index][cache->count[class_index]++] = ptr;
+
+    slab_cache_count(cache, class_index, -1, -(int64_t)size);
+}
+
+size_t slab_usable_size(size_t size){
+    if (size > SLAB_MAX_OBJECT){
+        return size;
+    }
+
+    return slab_class_size(slab_class_for(size));
+}
+
+  // Monitoring
+
+int slab_class_stats(size_t class_index, slab_class_stats_t* out){
+    if ((class_index > SLAB_CLASS_COUNT) || (out == NULL)){
+        return -1;
+    }
+
+    pthread_once(&slab_init_once, slab_init);
+
+    int64_t used = 0;
+    int64_t requested = 0;
+
+    for (slab_cache_t* cache = atomic_load_explicit(&slab_caches, memory_order_acquire); cache != NULL; cache = cache->next){
+        used += atomic_load_explicit(&cache->used[class_index], memory_order_relaxed);
+        requested += atomic_load_explicit(&cache->requested[class_index], memory_order_relaxed);
+    }
+
+    memset(out, 0, sizeof(slab_class_stats_t));
+    out->used = (used > 0) ? (size_t)used : 0;
+    out->requested_bytes = (requested > 0) ? (size_t)requested : 0;
+
+    if (class_index == SLAB_CLASS_COUNT){
+        return 0;
+    }
+
+    slab_class_t* slab_class = &slab_classes[class_index];
+
+    pthread_mutex_lock(&slab_class->mutex);
+    size_t pages = slab_class->pages;
+    pthread_mutex_unlock(&slab_class->mutex);
+
+    size_t object_size = slab_class_size(class_index);
+    size_t capacity = pages * ((SLAB_PAGE_SIZE - SLAB_PAGE_HEADER) / object_size);
+
+    out->object_size = object_size;
+    out->pages = pages;
+    out->free = (capacity > out->used) ? capacity - out->used : 0;
+
+    if (pages != 0){
+        double reserved = (double)pages * (double)SLAB_PAGE_SIZE;
+        out->fragmentation = 1.0 - ((double)out->requested_bytes / reserved);
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef SLAB_FUNCTIONALITY_H
+#define SLAB_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Macro and Defines
+
+    // Objects are carved from SLAB_PAGE_SIZE pages mapped at a multiple of
+    // their size, so the page of any object is found by masking its address.
+    // Size classes go 16, 24, 32, 48, 64, 96 ... up to SLAB_MAX_OBJECT (two
+    // per power of two); larger requests fall through to malloc. A page left
+    // empty is unmapped unless it is the last one with room in its class.
+
+    #define SLAB_PAGE_SIZE        (64 * 1024)
+    #define SLAB_PAGE_HEADER      64
+    #define SLAB_MIN_OBJECT       16
+    #define SLAB_MAX_OBJECT       8192
+    #define SLAB_CLASS_COUNT      19
+
+    // Each thread keeps up to SLAB_CACHE_SIZE free objects per class and
+    // moves SLAB_CACHE_BATCH at a time to or from the shared pages.
+
+    #define SLAB_CACHE_SIZE       64
+    #define SLAB_CACHE_BATCH      32
+
+// Data
+
+typedef struct slab_class_stats_t{
+    size_t object_size;            // 0 for the row of requests served by malloc
+    size_t pages;
+    size_t used;                   // Objects held by callers
+    size_t free;                   // Slots in the pages not held by callers
+    size_t requested_bytes;        // What callers asked for, before rounding
+    double fragmentation;          // Share of page memory not holding requested bytes
+} slab_class_stats_t;
+
+// Public API
+
+    // Sized allocator: slab_free must get the size passed to slab_alloc.
+    void* slab_alloc(size_t size);
+    void slab_free(void* ptr, size_t size);
+
+    // Bytes really reserved for an allocation of size bytes.
+    size_t slab_usable_size(size_t size);
+
+    // Monitoring, class_index goes up to SLAB_CLASS_COUNT included, the last
+    // one describing the requests that bypassed the slabs.
+    int slab_class_stats(size_t class_index, slab_class_stats_t* out);
+
+
+#endif
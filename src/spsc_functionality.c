@@ -0,0 +1,78 @@
+// Header
+#include "spsc_functionality.h"
+#include "bitwise_functionality.h"
+#include <stdlib.h>
+
+// Public API
+
+int spsc_init(spsc_queue_t* queue, size_t capacity){
+    if ((queue == NULL) || (capacity == 0)){
+        return -1;
+    }
+
+    capacity = next_power_of_2(capacity);
+
+    queue->slots = calloc(capacity, sizeof(void*));
+    if (queue->slots == NULL){
+        return -1;
+    }
+
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->tail_cache = 0;
+    queue->head_cache = 0;
+
+    return 0;
+}
+
+void spsc_destroy(spsc_queue_t* queue){
+    if (queue == NULL){
+        return;
+    }
+
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+bool spsc_push(spsc_queue_t* queue, void* item){
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (tail - queue->head_cache > queue->mask){
+        queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail - queue->head_cache > queue->mask){
+            return false;
+        }
+    }
+
+    queue->slots[tail & queue->mask] = item;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+bool spsc_full(spsc_queue_t* queue){
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (tail - queue->head_cache > queue->mask){
+        queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+    }
+
+    return tail - queue->head_cache > queue->mask;
+}
+
+void* spsc_pop(spsc_queue_t* queue){
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head == queue->tail_cache){
+        queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->tail_cache){
+            return NULL;
+        }
+    }
+
+    void* item = queue->slots[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return item;
+}
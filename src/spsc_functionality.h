@@ -0,0 +1,49 @@
+#ifndef SPSC_FUNCTIONALITY_H
+#define SPSC_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Macro and Defines
+
+    // Bounded ring of pointers between exactly one producer thread and one
+    // consumer thread, without locks: each side owns one index and only
+    // reads the other's, keeping a cached copy so that it touches the
+    // other side's cache line only when the ring looks full or empty.
+
+    #define SPSC_CACHE_LINE       64
+
+// Data
+
+typedef struct spsc_queue_t{
+    __attribute__((aligned(SPSC_CACHE_LINE))) _Atomic(size_t) head;   // Next slot to pop, owned by the consumer
+    size_t tail_cache;
+
+    __attribute__((aligned(SPSC_CACHE_LINE))) _Atomic(size_t) tail;   // Next slot to fill, owned by the producer
+    size_t head_cache;
+
+    __attribute__((aligned(SPSC_CACHE_LINE))) size_t mask;
+    void** slots;
+} spsc_queue_t;
+
+// Public API
+
+    // Capacity is rounded up to a power of two.
+    int spsc_init(spsc_queue_t* queue, size_t capacity);
+    void spsc_destroy(spsc_queue_t* queue);
+
+    // Producer side, false when the ring is full. Items must not be NULL.
+    // Only the consumer can make room, so once spsc_full returns false the
+    // next push is sure to succeed.
+    bool spsc_push(spsc_queue_t* queue, void* item);
+    bool spsc_full(spsc_queue_t* queue);
+
+    // Consumer side, NULL when the ring is empty.
+    void* spsc_pop(spsc_queue_t* queue);
+
+
+#endif
@@ -250,6 +250,103 @@ ssize_t strscpy(char* d, const char* s, size_t n){
     return -1;
 }
 
-bool is_key_valid(const unsigned char* key){
-    return ((key != NULL) && (key[0] != '\0'));
+bool is_key_valid(const unsigned char* key, size_t key_len){
+    return ((key != NULL) && (key_len > 0) && (key_len < KEY_MAX_LEN));
+}
+
+// Pattern Matching
+
+// i starts after the '[' and is left on the closing ']', or at the end when there is none.
+static bool glob_set_match(const unsigned char* pattern, size_t pattern_len, size_t* i, unsigned char c){
+    size_t p = *i;
+    bool negate = false;
+    bool matched = false;
+
+    if ((p < pattern_len) && ((pattern[p] == '^') || (pattern[p] == '!'))){
+        negate = true;
+        p++;
+    }
+
+    while ((p < pattern_len) && (pattern[p] != ']')){
+        if ((pattern[p] == '\\') && (p + 1 < pattern_len)){
+            matched |= (pattern[p + 1] == c);
+            p += 2;
+        } else if ((p + 2 < pattern_len) && (pattern[p + 1] == '-') && (pattern[p + 2] != ']')){
+            unsigned char low = pattern[p];
+            unsigned char high = pattern[p + 2];
+            if (low > high){
+                unsigned char swap = low;
+                low = high;
+                high = swap;
+            }
+            matched |= ((c >= low) && (c <= high));
+            p += 3;
+        } else{
+            matched |= (pattern[p] == c);
+            p++;
+        }
+    }
+
+    *i = p;
+    return matched != negate;
+}
+
+// A star only ever backtracks to the latest one seen, so the cost stays
+// bounded by pattern_len * text_len whatever the pattern.
+bool glob_match(const unsigned char* pattern, size_t pattern_len, const unsigned char* text, size_t text_len){
+    if ((pattern == NULL) || ((text == NULL) && (text_len != 0))){
+        return false;
+    }
+
+    size_t p = 0;
+    size_t t = 0;
+    size_t star_p = SIZE_MAX;
+    size_t star_t = 0;
+
+    while (t < text_len){
+        if (p < pattern_len){
+            unsigned char c = pattern[p];
+            size_t next = p + 1;
+            bool matched;
+
+            if (c == '*'){
+                star_p = p + 1;
+                star_t = t;
+                p++;
+                continue;
+            }
+
+            if (c == '?'){
+                matched = true;
+            } else if (c == '['){
+                size_t i = p + 1;
+                matched = glob_set_match(pattern, pattern_len, &i, text[t]);
+                next = (i < pattern_len) ? i + 1 : i;
+            } else if ((c == '\\') && (p + 1 < pattern_len)){
+                matched = (pattern[p + 1] == text[t]);
+                next = p + 2;
+            } else{
+                matched = (c == text[t]);
+            }
+
+            if (matched){
+                p = next;
+                t++;
+                continue;
+            }
+        }
+
+        if (star_p == SIZE_MAX){
+            return false;
+        }
+
+        p = star_p;
+        t = ++star_t;
+    }
+
+    while ((p < pattern_len) && (pattern[p] == '*')){
+        p++;
+    }
+
+    return p == pattern_len;
 }
@@ -29,7 +29,11 @@
     size_t ustrlen(const unsigned char* str);
     unsigned char* ustrdup(const char *src);
     int ustrcmp(const unsigned char* s1, const unsigned char* s2);
-    bool is_key_valid(const unsigned char* key);
+    bool is_key_valid(const unsigned char* key, size_t key_len);
+
+    // Glob over byte strings: * any run, ? any byte, [abc] [a-z] [^a] sets,
+    // and \ escapes the next byte.
+    bool glob_match(const unsigned char* pattern, size_t pattern_len, const unsigned char* text, size_t text_len);
 
 
 #endif 
@@ -0,0 +1,237 @@
+// Header
+#include "timer_wheel_functionality.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Private API
+
+static int wheel_list_push(timer_wheel_t* wheel, wheel_list_t* list, const wheel_entry_t* entry){
+    wheel_chunk_t* head = list->head;
+
+    if ((head == NULL) || (head->count == WHEEL_CHUNK_ENTRIES)){
+        wheel_chunk_t* chunk = malloc(sizeof(wheel_chunk_t));
+        if (chunk == NULL){
+            return -1;
+        }
+
+        chunk->next = head;
+        chunk->count = 0;
+        list->head = chunk;
+        if (list->tail == NULL){
+            list->tail = chunk;
+        }
+
+        atomic_fetch_add_explicit(&wheel->chunks, 1, memory_order_relaxed);
+        head = chunk;
+    }
+
+    head->entries[head->count++] = *entry;
+    return 0;
+}
+
+// Spliced lists may leave partly filled chunks in the middle, so empty ones are skipped too.
+static bool wheel_list_pop(timer_wheel_t* wheel, wheel_list_t* list, wheel_entry_t* out){
+    while ((list->head != NULL) && (list->head->count == 0)){
+        wheel_chunk_t* empty = list->head;
+        list->head = empty->next;
+        free(empty);
+        atomic_fetch_sub_explicit(&wheel->chunks, 1, memory_order_relaxed);
+    }
+
+    if (list->head == NULL){
+        list->tail = NULL;
+        return false;
+    }
+
+    *out = list->head->entries[--list->head->count];
+    return true;
+}
+
+static void wheel_list_splice(wheel_list_t* dest, wheel_list_t* src){
+    if (src->head == NULL){
+        return;
+    }
+
+    if (dest->head == NULL){
+        *dest = *src;
+    } else{
+        src->tail->next = dest->head;
+        dest->head = src->head;
+    }
+
+    src->head = NULL;
+    src->tail = NULL;
+}
+
+static void wheel_list_free(timer_wheel_t* wheel, wheel_list_t* list){
+    wheel_chunk_t* chunk = list->head;
+    while (chunk != NULL){
+        wheel_chunk_t* next = chunk->next;
+        free(chunk);
+        atomic_fetch_sub_explicit(&wheel->chunks, 1, memory_order_relaxed);
+        chunk = next;
+    }
+
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+// The lowest level whose span covers the deadline. Deadlines past the last
+// level wait in its farthest slot and are placed again when it fires.
+static wheel_list_t* wheel_slot_for(timer_wheel_t* wheel, uint32_t deadline){
+    uint32_t delta = deadline - wheel->now;
+
+    for (unsigned int level = 0; level < WHEEL_LEVELS; level++){
+        unsigned int shift = WHEEL_SLOT_BITS * level;
+        if ((uint64_t)delta < ((uint64_t)1 << (shift + WHEEL_SLOT_BITS))){
+            return &wheel->slots[level][(deadline >> shift) & (WHEEL_SLOTS - 1)];
+        }
+    }
+
+    unsigned int last_shift = WHEEL_SLOT_BITS * (WHEEL_LEVELS - 1);
+    uint32_t parked = wheel->now + (uint32_t)(((uint64_t)1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1);
+
+    return &wheel->slots[WHEEL_LEVELS - 1][(parked >> last_shift) & (WHEEL_SLOTS - 1)];
+}
+
+static int wheel_insert(timer_wheel_t* wheel, const wheel_entry_t* entry){
+    wheel_list_t* list = (entry->deadline <= wheel->now) ? &wheel->due : wheel_slot_for(wheel, entry->deadline);
+    return wheel_list_push(wheel, list, entry);
+}
+
+// One tick forward. Every upper level that wraps hands its current slot to
+// cascade and level 0 hands its slot to due, all by splicing.
+static void wheel_tick(timer_wheel_t* wheel){
+    wheel->now++;
+
+    for (unsigned int level = 1; level < WHEEL_LEVELS; level++){
+        unsigned int shift = WHEEL_SLOT_BITS * level;
+        if ((wheel->now & ((1u << shift) - 1u)) != 0){
+            break;
+        }
+        wheel_list_splice(&wheel->cascade, &wheel->slots[level][(wheel->now >> shift) & (WHEEL_SLOTS - 1)]);
+    }
+
+    wheel_list_splice(&wheel->due, &wheel->slots[0][wheel->now & (WHEEL_SLOTS - 1)]);
+}
+
+// Public API
+
+int wheel_init(timer_wheel_t* wheel){
+    if (wheel == NULL){
+        return -1;
+    }
+
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->cascade = (wheel_list_t){ NULL, NULL };
+    wheel->due = (wheel_list_t){ NULL, NULL };
+    wheel->now = 0;
+    wheel->pending = 0;
+    atomic_init(&wheel->chunks, 0);
+
+    return (pthread_mutex_init(&wheel->mutex, NULL) == 0) ? 0 : -1;
+}
+
+void wheel_clear(timer_wheel_t* wheel){
+    if (wheel == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    for (unsigned int level = 0; level < WHEEL_LEVELS; level++){
+        for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++){
+            wheel_list_free(wheel, &wheel->slots[level][slot]);
+        }
+    }
+    wheel_list_free(wheel, &wheel->cascade);
+    wheel_list_free(wheel, &wheel->due);
+    wheel->pending = 0;
+
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+void wheel_destroy(timer_wheel_t* wheel){
+    if (wheel == NULL){
+        return;
+    }
+
+    wheel_clear(wheel);
+    pthread_mutex_destroy(&wheel->mutex);
+}
+
+int wheel_add(timer_wheel_t* wheel, uint64_t id, uint32_t deadline, uint32_t now){
+    if (wheel == NULL){
+        return -1;
+    }
+
+    wheel_entry_t entry = { .id = id, .deadline = deadline };
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    if ((wheel->pending == 0) && (now > wheel->now)){
+        wheel->now = now;
+    }
+
+    int status = wheel_insert(wheel, &entry);
+    if (status == 0){
+        wheel->pending++;
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+
+    return status;
+}
+
+size_t wheel_advance(timer_wheel_t* wheel, uint32_t now, wheel_entry_t* out, size_t max, size_t* out_count){
+    size_t work = 0;
+    size_t count = 0;
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    // Nothing can fire on the way
+    if ((wheel->pending == 0) && (now > wheel->now)){
+        wheel->now = now;
+    }
+
+    while (work < max){
+        wheel_entry_t entry;
+
+        if (wheel_list_pop(wheel, &wheel->due, &entry)){
+            out[count++] = entry;
+            wheel->pending--;
+        } else if (wheel_list_pop(wheel, &wheel->cascade, &entry)){
+            if (wheel_insert(wheel, &entry) != 0){
+                fprintf(stderr, "[ERROR] wheel_advance: Failed to allocate a chunk, handing an entry out early.\n");
+                out[count++] = entry;
+                wheel->pending--;
+            }
+        } else if (wheel->now < now){
+            wheel_tick(wheel);
+        } else{
+            break;
+        }
+
+        work++;
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+
+    *out_count = count;
+    return work;
+}
+
+  // Monitoring
+
+size_t wheel_pending(timer_wheel_t* wheel){
+    pthread_mutex_lock(&wheel->mutex);
+    size_t pending = wheel->pending;
+    pthread_mutex_unlock(&wheel->mutex);
+
+    return pending;
+}
+
+size_t wheel_memory_usage(timer_wheel_t* wheel){
+    return atomic_load_explicit(&wheel->chunks, memory_order_relaxed) * sizeof(wheel_chunk_t);
+}
@@ -0,0 +1,76 @@
+#ifndef TIMER_WHEEL_FUNCTIONALITY_H
+#define TIMER_WHEEL_FUNCTIONALITY_H
+
+// Includes
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Macro and Defines
+
+    // Hierarchical timer wheel over whole ticks: level L has WHEEL_SLOTS
+    // slots of WHEEL_SLOTS^L ticks each, so four levels of 64 cover about
+    // 16.7 million ticks and later deadlines wait in the last level until
+    // they come in range. Firing or cascading a slot only splices its list,
+    // the entries themselves are moved later by wheel_advance a bounded
+    // number at a time, so no tick costs more than a constant however many
+    // entries share it.
+
+    #define WHEEL_LEVELS          4
+    #define WHEEL_SLOT_BITS       6
+    #define WHEEL_SLOTS           (1u << WHEEL_SLOT_BITS)
+    #define WHEEL_CHUNK_ENTRIES   255
+
+// Data
+
+typedef struct wheel_entry_t{
+    uint64_t id;
+    uint32_t deadline;
+} wheel_entry_t;
+
+typedef struct wheel_chunk_t{
+    struct wheel_chunk_t* next;
+    size_t count;
+    wheel_entry_t entries[WHEEL_CHUNK_ENTRIES];
+} wheel_chunk_t;
+
+// Chunks are filled and emptied at the head; tail only makes splicing O(1)
+typedef struct wheel_list_t{
+    wheel_chunk_t* head;
+    wheel_chunk_t* tail;
+} wheel_list_t;
+
+typedef struct timer_wheel_t{
+    pthread_mutex_t mutex;
+    uint32_t now;                                   // Last tick processed
+    wheel_list_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    wheel_list_t cascade;                           // Fired slots of upper levels, still to re-add
+    wheel_list_t due;                               // Entries whose deadline has passed
+    size_t pending;                                 // Entries anywhere in the wheel
+    _Atomic(size_t) chunks;
+} timer_wheel_t;
+
+// Public API
+
+    int wheel_init(timer_wheel_t* wheel);
+    void wheel_destroy(timer_wheel_t* wheel);
+    void wheel_clear(timer_wheel_t* wheel);
+
+    // An empty wheel first jumps to now, so idle time is never ticked through.
+    int wheel_add(timer_wheel_t* wheel, uint64_t id, uint32_t deadline, uint32_t now);
+
+    // Ticks up to now and copies at most max due entries to out, setting
+    // out_count. Returns the work done (ticks, entries moved and entries
+    // handed out, never more than max) and 0 once nothing is left to do
+    // up to now.
+    size_t wheel_advance(timer_wheel_t* wheel, uint32_t now, wheel_entry_t* out, size_t max, size_t* out_count);
+
+    // Monitoring
+    size_t wheel_pending(timer_wheel_t* wheel);
+    size_t wheel_memory_usage(timer_wheel_t* wheel);
+
+
+#endif